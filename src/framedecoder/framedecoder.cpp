@@ -9,6 +9,9 @@
 #include <QFileInfo>
 #include <QImage>
 
+#include <algorithm>
+#include <limits>
+
 extern "C" {
 #include <libavfilter/buffersink.h>
 #include <libavfilter/buffersrc.h>
@@ -18,17 +21,46 @@ extern "C" {
 
 using namespace std;
 
-FrameDecoder::FrameDecoder(const QString &filename, AVFormatContext *pavContext)
+namespace
+{
+// without an index, frames at most this far ahead are reached by decoding instead of seeking
+constexpr qint64 MaxForwardDecodeMs = 2000;
+// thumbnails are made on all the TaskScheduler threads at once, more
+// threads per decoder would only compete with the other thumbnails
+constexpr int ThumbnailThreadCount = 2;
+
+// the frame flags replaced the fields in libavutil 58.7.100
+bool isKeyFrame(const AVFrame *frame)
+{
+#if LIBAVUTIL_VERSION_INT < AV_VERSION_INT(58, 7, 100)
+    return frame->key_frame;
+#else
+    return frame->flags & AV_FRAME_FLAG_KEY;
+#endif
+}
+
+bool isInterlaced(const AVFrame *frame)
+{
+#if LIBAVUTIL_VERSION_INT < AV_VERSION_INT(58, 7, 100)
+    return frame->interlaced_frame;
+#else
+    return frame->flags & AV_FRAME_FLAG_INTERLACED;
+#endif
+}
+} // namespace
+
+FrameDecoder::FrameDecoder(const QString &filename, AVFormatContext *pavContext, Mode mode, int targetSize)
     : m_VideoStream(-1)
     , m_pFormatContext(pavContext)
     , m_pVideoCodecContext(nullptr)
     , m_pVideoCodec(nullptr)
     , m_pFrame(nullptr)
-    , m_pFrameBuffer(nullptr)
     , m_pPacket(nullptr)
     , m_FormatContextWasGiven(pavContext != nullptr)
     , m_AllowSeek(true)
     , m_initialized(false)
+    , m_mode(mode)
+    , m_targetSize(targetSize)
     , m_bufferSinkContext(nullptr)
     , m_bufferSourceContext(nullptr)
     , m_filterGraph(nullptr)
@@ -69,8 +101,10 @@ void FrameDecoder::initialize(const QString &filename)
         return;
     }
     m_pFrame = av_frame_alloc();
+    // reused for every packet read
+    m_pPacket = av_packet_alloc();
 
-    if (m_pFrame) {
+    if (m_pFrame && m_pPacket) {
         m_initialized = true;
     }
 }
@@ -97,19 +131,27 @@ void FrameDecoder::destroy()
     }
 
     if (m_pPacket) {
-        av_packet_unref(m_pPacket);
-        delete m_pPacket;
-        m_pPacket = nullptr;
+        av_packet_free(&m_pPacket);
     }
 
     if (m_pFrame) {
         av_frame_free(&m_pFrame);
         m_pFrame = nullptr;
     }
+    m_framePts = AV_NOPTS_VALUE;
+
+    if (m_pScaledFrame) {
+        av_frame_free(&m_pScaledFrame);
+    }
+
+    if (m_pScaledFrameBuffer) {
+        av_free(m_pScaledFrameBuffer);
+        m_pScaledFrameBuffer = nullptr;
+    }
 
-    if (m_pFrameBuffer) {
-        av_free(m_pFrameBuffer);
-        m_pFrameBuffer = nullptr;
+    if (m_swsContext) {
+        sws_freeContext(m_swsContext);
+        m_swsContext = nullptr;
     }
 }
 
@@ -142,6 +184,23 @@ bool FrameDecoder::initializeVideo()
 
     m_pVideoCodecContext->workaround_bugs = 1;
 
+    if (m_mode == Mode::Thumbnail) {
+        // frame threads would have to be filled with packets before the first frame comes out
+        m_pVideoCodecContext->thread_count = ThumbnailThreadCount;
+        m_pVideoCodecContext->thread_type = FF_THREAD_SLICE;
+        m_pVideoCodecContext->skip_frame = AVDISCARD_NONKEY;
+        m_pVideoCodecContext->skip_loop_filter = AVDISCARD_ALL;
+        m_pVideoCodecContext->flags2 |= AV_CODEC_FLAG2_FAST;
+
+        // each lowres step halves the decoded size, only a few codecs (e.g. mjpeg) support it
+        const int width = m_pFormatContext->streams[m_VideoStream]->codecpar->width;
+        int lowres = 0;
+        while (m_targetSize > 0 && lowres < m_pVideoCodec->max_lowres && (width >> (lowres + 1)) >= m_targetSize) {
+            ++lowres;
+        }
+        m_pVideoCodecContext->lowres = lowres;
+    }
+
     if (avcodec_open2(m_pVideoCodecContext, m_pVideoCodec, nullptr) < 0) {
         qDebug() << "Could not open video codec";
         return false;
@@ -192,32 +251,34 @@ void FrameDecoder::seek(int timeInSeconds)
     int ret = av_seek_frame(m_pFormatContext, -1, timestamp, 0);
     if (ret >= 0) {
         avcodec_flush_buffers(m_pVideoCodecContext);
+        m_framePts = AV_NOPTS_VALUE;
     } else {
         qDebug() << "Seeking in video failed";
         return;
     }
 
+    // decode until a keyframe, in thumbnail mode the decoder only outputs keyframes
     int keyFrameAttempts = 0;
-    bool gotFrame = 0;
+    bool gotFrame = false;
+    bool endOfFile = false;
 
     do {
         int count = 0;
-        gotFrame = 0;
+        gotFrame = false;
 
         while (!gotFrame && count < 20) {
-            getVideoPacket();
+            if (!getVideoPacket()) {
+                endOfFile = true;
+                break;
+            }
             gotFrame = decodeVideoPacket();
             ++count;
         }
 
         ++keyFrameAttempts;
-#if (LIBAVFORMAT_VERSION_MAJOR < 61)
-    } while ((!gotFrame || m_pFrame->flags & AV_PKT_FLAG_KEY) && keyFrameAttempts < 200);
-#else
-    } while ((!gotFrame || m_pFrame->flags & AV_FRAME_FLAG_KEY) && keyFrameAttempts < 200);
-#endif
+    } while (!endOfFile && (!gotFrame || !isKeyFrame(m_pFrame)) && keyFrameAttempts < 200);
 
-    if (gotFrame == 0) {
+    if (!gotFrame) {
         qDebug() << "Seeking in video failed";
     }
 }
@@ -230,6 +291,15 @@ bool FrameDecoder::decodeVideoFrame()
         frameFinished = decodeVideoPacket();
     }
 
+    if (!frameFinished) {
+        // end of the file, the decoder still holds the last frames
+        avcodec_send_packet(m_pVideoCodecContext, nullptr);
+        frameFinished = avcodec_receive_frame(m_pVideoCodecContext, m_pFrame) == 0;
+        if (frameFinished) {
+            m_framePts = m_pFrame->best_effort_timestamp;
+        }
+    }
+
     if (!frameFinished) {
         qDebug() << "decodeVideoFrame() failed: frame not finished";
     }
@@ -245,15 +315,95 @@ bool FrameDecoder::decodeVideoPacket()
 
     av_frame_unref(m_pFrame);
 
-    avcodec_send_packet(m_pVideoCodecContext, m_pPacket);
-    int ret = avcodec_receive_frame(m_pVideoCodecContext, m_pFrame);
-    if (ret == AVERROR(EAGAIN)) {
+    int ret = avcodec_send_packet(m_pVideoCodecContext, m_pPacket);
+    if (ret < 0 && ret != AVERROR(EAGAIN)) {
         return false;
     }
-
+    // EAGAIN, the decoder needs more packets; skipped non-keyframes give no frame either
+    ret = avcodec_receive_frame(m_pVideoCodecContext, m_pFrame);
+    if (ret != 0) {
+        return false;
+    }
+    m_framePts = m_pFrame->best_effort_timestamp;
     return true;
 }
 
+QImage FrameDecoder::frameAt(qint64 timeMs, int scaledSize, bool maintainAspectRatio)
+{
+    QImage image;
+    if (!m_initialized) {
+        return image;
+    }
+
+    const AVStream *stream = m_pFormatContext->streams[m_VideoStream];
+    int64_t target = av_rescale_q(std::max<qint64>(timeMs, 0), AVRational{1, 1000}, stream->time_base);
+    if (stream->start_time != AV_NOPTS_VALUE) {
+        target += stream->start_time;
+    }
+    const int64_t keyFrame = keyFrameBefore(target);
+
+    bool decoded = false;
+    if (m_framePts != AV_NOPTS_VALUE && target >= m_framePts) {
+        if (m_mode == Mode::Thumbnail && keyFrame != AV_NOPTS_VALUE && keyFrame <= m_framePts) {
+            // only keyframes are decoded, the current frame is the last one before target
+            decoded = true;
+        } else if (keyFrame != AV_NOPTS_VALUE ? keyFrame <= m_framePts
+                                               : av_rescale_q(target - m_framePts, stream->time_base, AVRational{1, 1000}) <= MaxForwardDecodeMs) {
+            // seeking would go back to a frame before this one, or not much further
+            decoded = decodeUntil(target);
+        }
+    }
+
+    if (!decoded && m_AllowSeek) {
+        if (av_seek_frame(m_pFormatContext, m_VideoStream, target, AVSEEK_FLAG_BACKWARD) >= 0) {
+            avcodec_flush_buffers(m_pVideoCodecContext);
+            m_framePts = AV_NOPTS_VALUE;
+            // the seek lands on the keyframe, in thumbnail mode that is the frame shown for target
+            decoded = decodeUntil(m_mode == Mode::Thumbnail ? std::numeric_limits<int64_t>::min() : target);
+        } else {
+            qDebug() << "Seeking in video failed";
+        }
+    }
+
+    if (decoded) {
+        getScaledVideoFrame(scaledSize, maintainAspectRatio, image);
+    }
+    return image;
+}
+
+QList<QImage> FrameDecoder::framesAt(const QList<qint64> &timesMs, int scaledSize, bool maintainAspectRatio)
+{
+    QList<QImage> images;
+    images.reserve(timesMs.size());
+    for (const auto timeMs : timesMs) {
+        images.append(frameAt(timeMs, scaledSize, maintainAspectRatio));
+    }
+    return images;
+}
+
+bool FrameDecoder::decodeUntil(int64_t pts)
+{
+    while (decodeVideoFrame()) {
+        if (m_framePts == AV_NOPTS_VALUE || m_framePts >= pts) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int64_t FrameDecoder::keyFrameBefore(int64_t pts)
+{
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+    const AVIndexEntry *entry = avformat_index_get_entry_from_timestamp(m_pFormatContext->streams[m_VideoStream], pts, AVSEEK_FLAG_BACKWARD);
+    if (entry) {
+        return entry->timestamp;
+    }
+#else
+    Q_UNUSED(pts)
+#endif
+    return AV_NOPTS_VALUE;
+}
+
 bool FrameDecoder::getVideoPacket()
 {
     bool framesAvailable = true;
@@ -261,12 +411,7 @@ bool FrameDecoder::getVideoPacket()
 
     int attempts = 0;
 
-    if (m_pPacket) {
-        av_packet_unref(m_pPacket);
-        delete m_pPacket;
-    }
-
-    m_pPacket = new AVPacket();
+    av_packet_unref(m_pPacket);
 
     while (framesAvailable && !frameDecoded && (attempts++ < 1000)) {
         framesAvailable = av_read_frame(m_pFormatContext, m_pPacket) >= 0;
@@ -334,85 +479,90 @@ bool FrameDecoder::initFilterGraph(enum AVPixelFormat pixfmt, int width, int hei
     return true;
 }
 
-bool FrameDecoder::processFilterGraph(AVFrame *dst, const AVFrame *src, enum AVPixelFormat pixfmt, int width, int height)
+bool FrameDecoder::deinterlaceFrame()
 {
-    if (!m_filterGraph || width != m_lastWidth || height != m_lastHeight || pixfmt != m_lastPixfmt) {
-        if (!initFilterGraph(pixfmt, width, height)) {
-            return false;
-        }
-    }
-
-    memcpy(m_filterFrame->data, src->data, sizeof(src->data));
-    memcpy(m_filterFrame->linesize, src->linesize, sizeof(src->linesize));
-    m_filterFrame->width = width;
-    m_filterFrame->height = height;
-    m_filterFrame->format = pixfmt;
-
-    int ret = av_buffersrc_add_frame(m_bufferSourceContext, m_filterFrame);
-    if (ret < 0) {
+    // yadif waits for the next frame, ending the input makes it output this one,
+    // so the graph is built for every frame, from the size the frame was decoded with
+    if (!initFilterGraph(static_cast<AVPixelFormat>(m_pFrame->format), m_pFrame->width, m_pFrame->height)) {
+        deleteFilterGraph();
         return false;
     }
 
-    ret = av_buffersink_get_frame(m_bufferSinkContext, m_filterFrame);
-    if (ret < 0) {
-        return false;
+    int ret = av_buffersrc_add_frame_flags(m_bufferSourceContext, m_pFrame, AV_BUFFERSRC_FLAG_KEEP_REF);
+    if (ret >= 0) {
+        ret = av_buffersrc_add_frame(m_bufferSourceContext, nullptr);
     }
+    if (ret >= 0) {
+        ret = av_buffersink_get_frame(m_bufferSinkContext, m_filterFrame);
+    }
+    if (ret >= 0) {
+        av_frame_unref(m_pFrame);
+        av_frame_move_ref(m_pFrame, m_filterFrame);
+    }
+    deleteFilterGraph();
 
-    av_image_copy(dst->data, dst->linesize, (const uint8_t **)m_filterFrame->data, m_filterFrame->linesize, pixfmt, width, height);
-    av_frame_unref(m_filterFrame);
-
-    return true;
+    return ret >= 0;
 }
 
 void FrameDecoder::getScaledVideoFrame(int scaledSize, bool maintainAspectRatio, QImage &videoFrame)
 {
-#if (LIBAVFORMAT_VERSION_MAJOR < 61)
-    if (m_pFrame->flags & AV_CODEC_FLAG_INTERLACED_ME) {
-#else
-    if (m_pFrame->flags & AV_FRAME_FLAG_INTERLACED) {
-#endif
-        processFilterGraph((AVFrame *)m_pFrame, (AVFrame *)m_pFrame, m_pVideoCodecContext->pix_fmt, m_pVideoCodecContext->width, m_pVideoCodecContext->height);
+    if (!m_pFrame->data[0]) {
+        videoFrame = QImage();
+        return;
+    }
+
+    if (isInterlaced(m_pFrame)) {
+        deinterlaceFrame();
     }
 
     int scaledWidth, scaledHeight;
-    convertAndScaleFrame(AV_PIX_FMT_RGB24, scaledSize, maintainAspectRatio, scaledWidth, scaledHeight);
+    if (!convertAndScaleFrame(AV_PIX_FMT_RGB24, scaledSize, maintainAspectRatio, scaledWidth, scaledHeight)) {
+        videoFrame = QImage();
+        return;
+    }
     // .copy() since QImage otherwise assumes the memory will continue to be available.
     // We could instead pass a custom deleter, but meh.
-    videoFrame = QImage(m_pFrame->data[0], scaledWidth, scaledHeight, m_pFrame->linesize[0], QImage::Format_RGB888).copy();
+    videoFrame = QImage(m_pScaledFrame->data[0], scaledWidth, scaledHeight, m_pScaledFrame->linesize[0], QImage::Format_RGB888).copy();
 }
 
-void FrameDecoder::convertAndScaleFrame(AVPixelFormat format, int scaledSize, bool maintainAspectRatio, int &scaledWidth, int &scaledHeight)
+bool FrameDecoder::convertAndScaleFrame(AVPixelFormat format, int scaledSize, bool maintainAspectRatio, int &scaledWidth, int &scaledHeight)
 {
     calculateDimensions(scaledSize, maintainAspectRatio, scaledWidth, scaledHeight);
-    SwsContext *scaleContext = sws_getContext(m_pVideoCodecContext->width,
-                                              m_pVideoCodecContext->height,
-                                              m_pVideoCodecContext->pix_fmt,
-                                              scaledWidth,
-                                              scaledHeight,
-                                              format,
-                                              SWS_BICUBIC,
-                                              nullptr,
-                                              nullptr,
-                                              nullptr);
-
-    if (nullptr == scaleContext) {
+    // straight from the decoded frame, which is smaller than the video when decoded with lowres;
+    // area averaging is cheaper than bicubic and as good when shrinking to a thumbnail.
+    // The context is only recreated when the sizes or formats change.
+    const int srcHeight = m_pFrame->height;
+    m_swsContext = sws_getCachedContext(m_swsContext,
+                                        m_pFrame->width,
+                                        srcHeight,
+                                        static_cast<AVPixelFormat>(m_pFrame->format),
+                                        scaledWidth,
+                                        scaledHeight,
+                                        format,
+                                        m_mode == Mode::Thumbnail ? SWS_AREA : SWS_BICUBIC,
+                                        nullptr,
+                                        nullptr,
+                                        nullptr);
+
+    if (nullptr == m_swsContext) {
         qDebug() << "Failed to create resize context";
-        return;
+        return false;
     }
 
-    AVFrame *convertedFrame = nullptr;
-    uint8_t *convertedFrameBuffer = nullptr;
-
-    createAVFrame(&convertedFrame, &convertedFrameBuffer, scaledWidth, scaledHeight, format);
-
-    sws_scale(scaleContext, m_pFrame->data, m_pFrame->linesize, 0, m_pVideoCodecContext->height, convertedFrame->data, convertedFrame->linesize);
-    sws_freeContext(scaleContext);
+    if (!m_pScaledFrame || scaledWidth != m_scaledWidth || scaledHeight != m_scaledHeight || format != m_scaledFormat) {
+        if (m_pScaledFrame) {
+            av_frame_free(&m_pScaledFrame);
+            av_free(m_pScaledFrameBuffer);
+        }
+        createAVFrame(&m_pScaledFrame, &m_pScaledFrameBuffer, scaledWidth, scaledHeight, format);
+        m_scaledWidth = scaledWidth;
+        m_scaledHeight = scaledHeight;
+        m_scaledFormat = format;
+    }
 
-    av_frame_free(&m_pFrame);
-    av_free(m_pFrameBuffer);
+    sws_scale(m_swsContext, m_pFrame->data, m_pFrame->linesize, 0, srcHeight, m_pScaledFrame->data, m_pScaledFrame->linesize);
 
-    m_pFrame = convertedFrame;
-    m_pFrameBuffer = convertedFrameBuffer;
+    return true;
 }
 
 void FrameDecoder::calculateDimensions(int squareSize, bool maintainAspectRatio, int &destWidth, int &destHeight)
@@ -7,6 +7,7 @@
 #ifndef MOVIEDECODER_H
 #define MOVIEDECODER_H
 
+#include <QList>
 #include <QString>
 
 extern "C" {
@@ -16,11 +17,20 @@ extern "C" {
 }
 
 class QImage;
+struct SwsContext;
 
 class FrameDecoder
 {
 public:
-    explicit FrameDecoder(const QString &filename, AVFormatContext *pavContext = nullptr);
+    enum class Mode {
+        // every frame is decoded at full resolution
+        Exact,
+        // only keyframes are decoded, with the decoder's shortcuts, at the lowest
+        // resolution the codec can decode that is still at least targetSize wide
+        Thumbnail,
+    };
+
+    explicit FrameDecoder(const QString &filename, AVFormatContext *pavContext = nullptr, Mode mode = Mode::Exact, int targetSize = 0);
     ~FrameDecoder();
 
     QString getCodec();
@@ -28,6 +38,14 @@ public:
     bool decodeVideoFrame();
     void getScaledVideoFrame(int scaledSize, bool maintainAspectRatio, QImage &videoFrame);
 
+    // The frame at timeMs, a null image when it can't be decoded. The decoder keeps its
+    // position between calls: when the keyframe before the next time was already passed,
+    // the file is decoded forward from the current frame instead of seeking, so frames
+    // (storyboards, chapter thumbnails) are best requested in ascending order.
+    QImage frameAt(qint64 timeMs, int scaledSize, bool maintainAspectRatio = true);
+    // frameAt() for each of timesMs, which should be ascending
+    QList<QImage> framesAt(const QList<qint64> &timesMs, int scaledSize, bool maintainAspectRatio = true);
+
     int getWidth();
     int getHeight();
     int getDuration();
@@ -41,13 +59,19 @@ private:
 
     bool decodeVideoPacket();
     bool getVideoPacket();
-    void convertAndScaleFrame(AVPixelFormat format, int scaledSize, bool maintainAspectRatio, int &scaledWidth, int &scaledHeight);
+    // decodes frames until one at or after pts, in stream time base
+    bool decodeUntil(int64_t pts);
+    // the timestamp of the keyframe at or before pts, AV_NOPTS_VALUE when the file has no index
+    int64_t keyFrameBefore(int64_t pts);
+    // into m_pScaledFrame, the decoded frame is kept
+    bool convertAndScaleFrame(AVPixelFormat format, int scaledSize, bool maintainAspectRatio, int &scaledWidth, int &scaledHeight);
     void createAVFrame(AVFrame **avFrame, quint8 **frameBuffer, int width, int height, AVPixelFormat format);
     void calculateDimensions(int squareSize, bool maintainAspectRatio, int &destWidth, int &destHeight);
 
     void deleteFilterGraph();
     bool initFilterGraph(enum AVPixelFormat pixfmt, int width, int height);
-    bool processFilterGraph(AVFrame *dst, const AVFrame *src, enum AVPixelFormat pixfmt, int width, int height);
+    // replaces the decoded frame with the deinterlaced one
+    bool deinterlaceFrame();
 
 private:
     int m_VideoStream;
@@ -59,11 +83,21 @@ private:
     const AVCodec *m_pVideoCodec{nullptr};
 #endif
     AVFrame *m_pFrame{nullptr};
-    quint8 *m_pFrameBuffer{nullptr};
+    // timestamp of m_pFrame, AV_NOPTS_VALUE when there is no decoded frame
+    int64_t m_framePts{AV_NOPTS_VALUE};
+    // the scaled frame and its context are reused while the size and format stay the same
+    AVFrame *m_pScaledFrame{nullptr};
+    quint8 *m_pScaledFrameBuffer{nullptr};
+    int m_scaledWidth{0};
+    int m_scaledHeight{0};
+    AVPixelFormat m_scaledFormat{AV_PIX_FMT_NONE};
+    SwsContext *m_swsContext{nullptr};
     AVPacket *m_pPacket{nullptr};
     bool m_FormatContextWasGiven;
     bool m_AllowSeek;
     bool m_initialized;
+    Mode m_mode;
+    int m_targetSize;
     AVFilterContext *m_bufferSinkContext{nullptr};
     AVFilterContext *m_bufferSourceContext{nullptr};
     AVFilterGraph *m_filterGraph{nullptr};
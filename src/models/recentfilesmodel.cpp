@@ -28,7 +28,9 @@ RecentFilesModel::RecentFilesModel(QObject *parent)
     : QAbstractListModel(parent)
 {
     connect(&youtube, &YouTube::videoInfoRetrieved, this, [this](YTVideoInfo info, QVariantMap data) {
-        addRecentFile(info.url, data.value(QStringLiteral("openedFrom")).value<OpenedFrom>(), info.mediaTitle);
+        // without a title (yt-dlp failed) the url is the name, otherwise addRecentFile would ask again
+        const auto name = info.mediaTitle.isEmpty() ? info.url.toString() : info.mediaTitle;
+        addRecentFile(info.url, data.value(QStringLiteral("openedFrom")).value<OpenedFrom>(), name);
     });
     getItems();
 }
@@ -30,6 +30,7 @@
 #include "miscutils.h"
 #include "mpvproperties.h"
 #include "pathutils.h"
+#include "performancelog.h"
 #include "playbacksettings.h"
 #include "playlistfilterproxymodel.h"
 #include "playlistmodel.h"
@@ -51,6 +52,12 @@
 
 using namespace Qt::StringLiterals;
 
+namespace
+{
+// seconds before the end of the current item when the next one is queued for gapless playback
+constexpr double GaplessQueueTime = 10.0;
+} // namespace
+
 MpvItem::MpvItem(QQuickItem *parent)
     : MpvAbstractItem(parent)
     , m_audioTracksModel{std::make_unique<TracksModel>()}
@@ -205,6 +212,9 @@ void MpvItem::setupConnections()
     connect(mpvController(), &MpvController::fileStarted,
             this, &MpvItem::fileStarted, Qt::QueuedConnection);
 
+    connect(this, &MpvItem::fileStarted,
+            this, &MpvItem::onFileStarted);
+
     connect(mpvController(), &MpvController::endFile,
             this, &MpvItem::onEndFile, Qt::QueuedConnection);
 
@@ -230,6 +240,10 @@ void MpvItem::setupConnections()
         Q_EMIT setProperty(MpvProperties::self()->ABLoopB, QStringLiteral("no"));
 
         setFinishedLoading(true);
+        if (m_transitionTimer.isValid()) {
+            qCDebug(HARUNA_PERFORMANCE) << "Next item loaded" << m_transitionTimer.nsecsElapsed() / 1000000.0 << "ms after the previous one ended";
+            m_transitionTimer.invalidate();
+        }
         Q_EMIT fileLoaded();
     }, Qt::QueuedConnection);
 
@@ -255,9 +269,12 @@ void MpvItem::setupConnections()
 
     connect(m_playlists.get(), &PlaylistMultiProxiesModel::playingItemChanged, this, [=]() {
         const auto playlistModel = activeFilterProxyModel()->playlistModel();
-        const auto url = playlistModel->m_playlist[playlistModel->m_playingItem].url;
+        const auto url = playlistModel->m_playlist[playlistModel->m_playingItem].url();
         const auto mediaTitle = playlistModel->m_playlist[playlistModel->m_playingItem].mediaTitle;
-        loadFile(url.toString());
+        if (!m_switchingToQueued) {
+            // when switching to the queued item, mpv already plays it
+            loadFile(url.toString());
+        }
         Q_EMIT addToRecentFiles(url, RecentFilesModel::OpenedFrom::Playlist, mediaTitle);
     });
 
@@ -266,8 +283,16 @@ void MpvItem::setupConnections()
     });
 
     connect(m_playlists.get(), &PlaylistMultiProxiesModel::activeIndexChanged, this, [=]() {
+        watchActivePlaylist();
+        checkQueuedItem();
         Q_EMIT activeFilterProxyModelChanged();
     });
+    watchActivePlaylist();
+
+    // a queued next item has to follow the playlist settings too
+    connect(PlaylistSettings::self(), &PlaylistSettings::PlaybackBehaviorChanged, this, &MpvItem::checkQueuedItem, Qt::QueuedConnection);
+    connect(PlaylistSettings::self(), &PlaylistSettings::RandomPlaybackChanged, this, &MpvItem::checkQueuedItem, Qt::QueuedConnection);
+    connect(PlaybackSettings::self(), &PlaybackSettings::GaplessPlaybackChanged, this, &MpvItem::checkQueuedItem, Qt::QueuedConnection);
 
 #if HAVE_DBUS
     // register mpris dbus service
@@ -354,6 +379,13 @@ void MpvItem::onReady()
 void MpvItem::onEndFile(const QString &reason)
 {
     // this runs after the file has been unloaded from mpv
+    if (reason == QStringLiteral("eof") && !m_queuedUrl.isEmpty()) {
+        // mpv goes on with the queued item by itself, see onFileStarted
+        m_switchingToQueued = true;
+        m_transitionTimer.start();
+        return;
+    }
+
     if (reason == QStringLiteral("error")) {
         auto proxyModel = activeFilterProxyModel();
         if (proxyModel->rowCount() == 0) {
@@ -405,9 +437,131 @@ void MpvItem::onEndOfFileReached()
         return;
     }
 
+    m_transitionTimer.start();
     proxyModel->playNext();
 }
 
+void MpvItem::onFileStarted()
+{
+    if (!m_switchingToQueued) {
+        return;
+    }
+
+    // mpv moved on to the queued item, catch up without loading it again;
+    // the finished item is dropped from mpv's playlist and mpv stops at the end of the new one again
+    Q_EMIT setProperty(MpvProperties::self()->KeepOpen, QStringLiteral("always"));
+    Q_EMIT command(QStringList{QStringLiteral("playlist-clear")});
+
+    const auto playlistModel = activeFilterProxyModel()->playlistModel();
+    const int row = playlistModel->rowOfId(m_queuedId);
+    if (row < 0) {
+        // removed while mpv was already switching to it, play what comes next in the playlist instead
+        m_switchingToQueued = false;
+        m_queuedUrl.clear();
+        m_queuedId = 0;
+        activeFilterProxyModel()->playNext();
+        return;
+    }
+
+    m_currentUrl = m_queuedUrl;
+    Q_EMIT currentUrlChanged();
+    playlistModel->setPlayingItem(row);
+
+    if (SubtitlesSettings::recursiveSubtitlesSearch()) {
+        QMetaObject::invokeMethod(Worker::instance(), &Worker::findRecursiveSubtitles, Qt::QueuedConnection, m_currentUrl);
+    }
+
+    m_switchingToQueued = false;
+    m_queuedUrl.clear();
+    m_queuedId = 0;
+}
+
+int MpvItem::gaplessNextRow()
+{
+    // the behaviors that don't go on with the next item are handled by onEndOfFileReached
+    auto proxyModel = activeFilterProxyModel();
+    const auto behavior = PlaylistSettings::playbackBehavior();
+    if (behavior == QStringLiteral("RepeatItem") || behavior == QStringLiteral("StopAfterItem")) {
+        return -1;
+    }
+    if (behavior == QStringLiteral("StopAfterLast") && proxyModel->isLastItem(proxyModel->getPlayingItem())) {
+        return -1;
+    }
+    if (proxyModel->rowCount() < 2) {
+        return -1;
+    }
+    return proxyModel->nextPlaylistModelRow();
+}
+
+void MpvItem::queueNextItem()
+{
+    if (!PlaybackSettings::gaplessPlayback() || !m_queuedUrl.isEmpty() || !finishedLoading() || m_isRadioStream) {
+        return;
+    }
+
+    const int row = gaplessNextRow();
+    if (row < 0) {
+        return;
+    }
+    auto proxyModel = activeFilterProxyModel();
+    const auto &item = proxyModel->playlistModel()->m_playlist[row];
+    const auto url = item.url();
+    if (url.isLocalFile()) {
+        if (!QFileInfo::exists(url.toLocalFile())) {
+            // left to loadFile, which reports it
+            return;
+        }
+        QMetaObject::invokeMethod(Worker::instance(), &Worker::prefetchFile, Qt::QueuedConnection, url.toLocalFile());
+    }
+
+    Q_EMIT setProperty(MpvProperties::self()->GaplessAudio, QStringLiteral("yes"));
+    Q_EMIT setProperty(MpvProperties::self()->PrefetchPlaylist, QStringLiteral("yes"));
+    Q_EMIT command(QStringList{QStringLiteral("loadfile"), url.toString(), QStringLiteral("append")});
+    // at the end of the current item mpv goes on with the queued one instead of stopping
+    Q_EMIT setProperty(MpvProperties::self()->KeepOpen, QStringLiteral("no"));
+
+    m_queuedUrl = url;
+    m_queuedId = item.id;
+}
+
+void MpvItem::checkQueuedItem()
+{
+    if (m_queuedUrl.isEmpty() || m_switchingToQueued) {
+        return;
+    }
+
+    const int row = gaplessNextRow();
+    if (PlaybackSettings::gaplessPlayback() && row >= 0 && activeFilterProxyModel()->playlistModel()->m_playlist[row].id == m_queuedId) {
+        return;
+    }
+
+    // the playlist or the behavior changed since the item was queued,
+    // drop it from mpv's playlist (the current item stays) and queue the new choice
+    Q_EMIT command(QStringList{QStringLiteral("playlist-clear")});
+    Q_EMIT setProperty(MpvProperties::self()->KeepOpen, QStringLiteral("always"));
+    m_queuedUrl.clear();
+    m_queuedId = 0;
+
+    if (m_remaining > 0 && m_remaining < GaplessQueueTime) {
+        queueNextItem();
+    }
+}
+
+void MpvItem::watchActivePlaylist()
+{
+    for (const auto &connection : std::as_const(m_activePlaylistConnections)) {
+        disconnect(connection);
+    }
+    m_activePlaylistConnections.clear();
+
+    // queued, so the playlist finished updating its order and shuffle queue first
+    auto proxyModel = activeFilterProxyModel();
+    auto playlistModel = proxyModel->playlistModel();
+    m_activePlaylistConnections << connect(proxyModel, &PlaylistFilterProxyModel::orderChanged, this, &MpvItem::checkQueuedItem, Qt::QueuedConnection);
+    m_activePlaylistConnections << connect(playlistModel, &PlaylistModel::itemsRemoved, this, &MpvItem::checkQueuedItem, Qt::QueuedConnection);
+    m_activePlaylistConnections << connect(playlistModel, &QAbstractItemModel::rowsInserted, this, &MpvItem::checkQueuedItem, Qt::QueuedConnection);
+}
+
 void MpvItem::onPropertyChanged(const QString &property, const QVariant &value)
 {
     if (property == MpvProperties::self()->MediaTitle) {
@@ -424,6 +578,10 @@ void MpvItem::onPropertyChanged(const QString &property, const QVariant &value)
         m_formattedRemaining = MiscUtils::formatTime(m_remaining);
         Q_EMIT remainingChanged();
 
+        if (m_remaining > 0 && m_remaining < GaplessQueueTime) {
+            queueNextItem();
+        }
+
     } else if (property == MpvProperties::self()->Duration) {
         m_duration = value.toDouble();
         m_formattedDuration = MiscUtils::formatTime(m_duration);
@@ -494,6 +652,10 @@ void MpvItem::loadFile(const QString &file)
 {
     // must be set to always for the playback behavior to work as intended
     Q_EMIT setProperty(MpvProperties::self()->KeepOpen, QStringLiteral("always"));
+    // loadfile replaces mpv's playlist, including a queued item
+    m_queuedUrl.clear();
+    m_queuedId = 0;
+    m_switchingToQueued = false;
 
     auto url = QUrl::fromUserInput(file);
     if (m_currentUrl != url) {
@@ -667,7 +829,7 @@ void MpvItem::saveTimePosition()
 double MpvItem::loadTimePosition()
 {
     const auto playlistModel = activeFilterProxyModel()->playlistModel();
-    PlaylistItem item{playlistModel->m_playlist[playlistModel->m_playingItem]};
+    const auto &item = playlistModel->m_playlist[playlistModel->m_playingItem];
     auto duration{item.duration};
 
     if (qFuzzyCompare(duration, 0.0)) {
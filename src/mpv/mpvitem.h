@@ -9,6 +9,7 @@
 #define MPVOBJECT_H
 
 #include <MpvAbstractItem>
+#include <QElapsedTimer>
 
 #include <memory>
 
@@ -227,6 +228,15 @@ private:
     void onReady();
     void onEndFile(const QString &reason);
     void onEndOfFileReached();
+    void onFileStarted();
+    // gapless playback, queues the next playlist item in mpv before the current one ends
+    void queueNextItem();
+    // the PlaylistModel row queueNextItem() would queue now, -1 when nothing should be queued
+    int gaplessNextRow();
+    // replaces the queued item when it's no longer the next one
+    void checkQueuedItem();
+    // checks the queued item when the active playlist changes
+    void watchActivePlaylist();
     void onPropertyChanged(const QString &property, const QVariant &value);
     void saveTimePosition();
     double loadTimePosition();
@@ -269,6 +279,16 @@ private:
     bool m_finishedLoading{false};
     std::unique_ptr<QTimer> m_saveTimePositionTimer;
 
+    // gapless playback
+    // the playlist item queued in mpv after the current one, mpv switches to it by itself
+    QUrl m_queuedUrl;
+    quint32 m_queuedId{0};
+    // the current item ended and mpv is starting the queued one
+    bool m_switchingToQueued{false};
+    QList<QMetaObject::Connection> m_activePlaylistConnections;
+    // from the end of an item until the next one is loaded
+    QElapsedTimer m_transitionTimer;
+
     RadioStationsModel *m_radioStationsModel{nullptr};
     bool m_isRadioStream{false};
     QString m_currentRadioStation;
@@ -226,6 +226,12 @@ public:
     Q_PROPERTY(QString EofReached MEMBER EofReached CONSTANT)
     const QString EofReached{QStringLiteral("eof-reached")};
 
+    Q_PROPERTY(QString GaplessAudio MEMBER GaplessAudio CONSTANT)
+    const QString GaplessAudio{QStringLiteral("gapless-audio")};
+
+    Q_PROPERTY(QString PrefetchPlaylist MEMBER PrefetchPlaylist CONSTANT)
+    const QString PrefetchPlaylist{QStringLiteral("prefetch-playlist")};
+
     Q_PROPERTY(QString ReplayGain MEMBER ReplayGain CONSTANT)
     const QString ReplayGain{QStringLiteral("replaygain")};
 
@@ -22,6 +22,19 @@ Item {
     property var mpv
     property var contextMenuLoader
     property bool isSmallWindowSize: Window.window.width < 600
+    // the search field searches all playlists, the matches replace the playlist view
+    property bool searchAllPlaylists: false
+    property bool globalResultsVisible: false
+    readonly property var globalSearch: root.mpv?.playlists?.globalSearch ?? null
+
+    function updateSearch() {
+        if (root.searchAllPlaylists) {
+            root.globalSearch.searchText = searchField.text
+            root.globalResultsVisible = searchField.text !== ""
+        } else if (root.filterProxyModel) {
+            root.filterProxyModel.searchText = searchField.text
+        }
+    }
 
     ColumnLayout {
         anchors.fill: parent
@@ -114,25 +127,73 @@ Item {
                         MenuItem {
                             text: i18nc("@action:button", "Name, ascending")
                             onTriggered: {
-                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistSortProxyModel.NameAscending)
+                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistFilterProxyModel.NameAscending)
                             }
                         }
                         MenuItem {
                             text: i18nc("@action:button", "Name, descending")
                             onTriggered: {
-                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistSortProxyModel.NameDescending)
+                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistFilterProxyModel.NameDescending)
                             }
                         }
                         MenuItem {
                             text: i18nc("@action:button", "Duration, ascending")
                             onTriggered: {
-                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistSortProxyModel.DurationAscending)
+                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistFilterProxyModel.DurationAscending)
                             }
                         }
                         MenuItem {
                             text: i18nc("@action:button", "Duration, descending")
                             onTriggered: {
-                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistSortProxyModel.DurationDescending)
+                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistFilterProxyModel.DurationDescending)
+                            }
+                        }
+                        MenuItem {
+                            text: i18nc("@action:button", "Modified, oldest first")
+                            onTriggered: {
+                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistFilterProxyModel.LastModifiedAscending)
+                            }
+                        }
+                        MenuItem {
+                            text: i18nc("@action:button", "Modified, newest first")
+                            onTriggered: {
+                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistFilterProxyModel.LastModifiedDescending)
+                            }
+                        }
+                        MenuItem {
+                            text: i18nc("@action:button", "Size, ascending")
+                            onTriggered: {
+                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistFilterProxyModel.FileSizeAscending)
+                            }
+                        }
+                        MenuItem {
+                            text: i18nc("@action:button", "Size, descending")
+                            onTriggered: {
+                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistFilterProxyModel.FileSizeDescending)
+                            }
+                        }
+                        MenuItem {
+                            text: i18nc("@action:button", "Folder, ascending")
+                            onTriggered: {
+                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistFilterProxyModel.FolderAscending)
+                            }
+                        }
+                        MenuItem {
+                            text: i18nc("@action:button", "Folder, descending")
+                            onTriggered: {
+                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistFilterProxyModel.FolderDescending)
+                            }
+                        }
+                        MenuItem {
+                            text: i18nc("@action:button", "Track number, ascending")
+                            onTriggered: {
+                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistFilterProxyModel.TrackNumberAscending)
+                            }
+                        }
+                        MenuItem {
+                            text: i18nc("@action:button", "Track number, descending")
+                            onTriggered: {
+                                root.mpv.visibleFilterProxyModel.sortItems(PlaylistFilterProxyModel.TrackNumberDescending)
                             }
                         }
                     }
@@ -242,8 +303,8 @@ Item {
                     placeholderText: i18n("Search playlist...")
 
                     onTextChanged: {
-                        if (root.filterProxyModel) {
-                            root.filterProxyModel.searchText = text
+                        root.updateSearch()
+                        if (!root.searchAllPlaylists && root.filterProxyModel) {
                             playlistView.positionViewAtIndex(0, ListView.Beginning)
                         }
                     }
@@ -255,17 +316,66 @@ Item {
                     }
                 }
 
+                Button {
+                    Layout.fillHeight: true
+                    icon.name: "configure"
+                    onClicked: searchModeMenu.popup()
+
+                    ToolTip.text: i18nc("@info:tooltip", "Search mode")
+                    ToolTip.visible: hovered
+                    ToolTip.delay: Kirigami.Units.toolTipDelay
+
+                    Menu {
+                        id: searchModeMenu
+
+                        Repeater {
+                            model: [
+                                { mode: "Substring", text: i18nc("@action:button", "Match words") },
+                                { mode: "Subsequence", text: i18nc("@action:button", "Match letters in order") },
+                                { mode: "Fuzzy", text: i18nc("@action:button", "Allow typos") },
+                            ]
+
+                            delegate: MenuItem {
+                                required property var modelData
+
+                                text: modelData.text
+                                checkable: true
+                                checked: PlaylistSettings.searchMode === modelData.mode
+                                onTriggered: {
+                                    PlaylistSettings.searchMode = modelData.mode
+                                    PlaylistSettings.save()
+                                    root.updateSearch()
+                                }
+                            }
+                        }
+
+                        MenuSeparator {}
+
+                        MenuItem {
+                            text: i18nc("@action:button", "Search all playlists")
+                            checkable: true
+                            checked: root.searchAllPlaylists
+                            onTriggered: {
+                                root.searchAllPlaylists = checked
+                                if (checked && root.filterProxyModel) {
+                                    root.filterProxyModel.searchText = ""
+                                } else if (!checked) {
+                                    root.globalSearch.searchText = ""
+                                    root.globalResultsVisible = false
+                                }
+                                root.updateSearch()
+                            }
+                        }
+                    }
+                }
+
                 Button {
                     Layout.preferredWidth: 90
                     Layout.minimumWidth: 70
                     Layout.fillHeight: true
                     text: i18n("Search")
 
-                    onClicked: {
-                        if (root.filterProxyModel) {
-                            root.filterProxyModel.searchText = searchField.text
-                        }
-                    }
+                    onClicked: root.updateSearch()
                 }
             }
         }
@@ -276,6 +386,7 @@ Item {
             
             Layout.fillWidth: true
             Layout.fillHeight: true
+            visible: !root.globalResultsVisible
             
             model: root.filterProxyModel
             spacing: Kirigami.Units.smallSpacing
@@ -291,11 +402,79 @@ Item {
             delegate: PlaylistItem {
                 m_mpv: root.mpv
             }
+
+            // the items of the playlist are still being read
+            BusyIndicator {
+                anchors.centerIn: parent
+                running: root.filterProxyModel?.loading ?? false
+                visible: running
+            }
             
             function openContextMenu(item) {
                 root.openContextMenu(item)
             }
         }
+
+        // Matches of the search in all playlists
+        ListView {
+            id: globalSearchView
+
+            Layout.fillWidth: true
+            Layout.fillHeight: true
+            visible: root.globalResultsVisible
+
+            model: root.globalSearch
+            clip: true
+
+            ScrollBar.vertical: ScrollBar {
+                policy: ScrollBar.AsNeeded
+            }
+
+            delegate: ItemDelegate {
+                id: resultDelegate
+
+                required property int index
+                required property string title
+                required property string playlistName
+                required property int position
+
+                width: ListView.view.width
+                onClicked: root.globalSearch.openResult(index)
+
+                contentItem: ColumnLayout {
+                    spacing: 0
+
+                    Label {
+                        text: resultDelegate.title
+                        elide: Text.ElideRight
+                        Layout.fillWidth: true
+                    }
+                    Label {
+                        text: i18nc("@info; %1 playlist name, %2 position in the playlist", "%1, item %2",
+                                    resultDelegate.playlistName, resultDelegate.position + 1)
+                        font: Kirigami.Theme.smallFont
+                        opacity: 0.7
+                        elide: Text.ElideRight
+                        Layout.fillWidth: true
+                    }
+                }
+            }
+
+            BusyIndicator {
+                anchors.centerIn: parent
+                running: root.globalSearch?.searching ?? false
+                visible: running && globalSearchView.count === 0
+            }
+
+            Connections {
+                target: root.globalSearch
+                function onResultOpened(playlistIndex, viewRow) {
+                    root.globalResultsVisible = false
+                    // the view gets the playlist's model first
+                    Qt.callLater(playlistView.positionViewAtIndex, viewRow, ListView.Center)
+                }
+            }
+        }
     }
 
     // Popups
@@ -441,6 +441,19 @@ Page {
                 visible: contextMenuLoader.row != -1
             }
 
+            MenuItem {
+                text: i18nc("@action:inmenu", "Undo")
+                enabled: root.m_mpv.visibleFilterProxyModel.canUndo
+                onClicked: root.m_mpv.visibleFilterProxyModel.undo()
+            }
+            MenuItem {
+                text: i18nc("@action:inmenu", "Redo")
+                enabled: root.m_mpv.visibleFilterProxyModel.canRedo
+                onClicked: root.m_mpv.visibleFilterProxyModel.redo()
+            }
+            MenuSeparator {
+            }
+
             MenuItem {
                 text: i18nc("@action:inmenu", "Select All")
                 onClicked: root.m_mpv.visibleFilterProxyModel.selectItem(0, PlaylistFilterProxyModel.All)
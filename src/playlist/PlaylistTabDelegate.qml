@@ -18,6 +18,7 @@ TabButton {
     required property string name
     required property bool isVisible
     required property bool isActive
+    required property int itemCount
     required property MpvVideo m_mpv
 
     property bool aboutToBeRemoved: false
@@ -105,8 +106,8 @@ TabButton {
             Layout.fillWidth: true
 
             ToolTip {
-                text: root.name
-                visible: tabText.truncated && root.hovered
+                text: i18ncp("@info:tooltip %1 number of items, %2 playlist name", "%2 (%1 item)", "%2 (%1 items)", root.itemCount, tabText.text)
+                visible: root.hovered
             }
         }
 
@@ -0,0 +1,184 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "m3ureader.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+#include <cstring>
+#include <string_view>
+
+#include "performancelog.h"
+
+namespace
+{
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// end of the line starting at p
+const char *lineEnd(const char *p, const char *end)
+{
+    auto newline = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    return newline ? newline : end;
+}
+
+constexpr std::string_view ExtinfTag{"#EXTINF:"};
+} // namespace
+
+bool M3uReader::open(const QString &path)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    const QFileInfo fileInfo(m_file);
+    m_folder = fileInfo.absolutePath();
+    m_lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+
+    m_size = m_file.size();
+    if (m_size == 0) {
+        return true;
+    }
+    m_data = reinterpret_cast<const char *>(m_file.map(0, m_size));
+    if (!m_data) {
+        m_buffer = m_file.readAll();
+        m_data = m_buffer.constData();
+        m_size = m_buffer.size();
+    }
+
+    const char *p = m_data;
+    const char *end = m_data + m_size;
+    if (m_size >= 3 && std::memcmp(p, "\xEF\xBB\xBF", 3) == 0) {
+        p += 3;
+    }
+    // other tags can come between an #EXTINF line and its entry
+    qint64 extinf{-1};
+    while (p < end) {
+        const char *last = lineEnd(p, end);
+        while (p < last && isSpace(*p)) {
+            ++p;
+        }
+        if (p < last && *p != '#') {
+            m_entries.push_back({p - m_data, extinf});
+            extinf = -1;
+        } else if (static_cast<std::size_t>(last - p) > ExtinfTag.size() && std::string_view(p, ExtinfTag.size()) == ExtinfTag) {
+            extinf = p - m_data;
+        }
+        p = last + 1;
+    }
+
+    qCDebug(HARUNA_PERFORMANCE) << "M3uReader:" << m_entries.size() << "entries in" << path << "indexed in" << timer.elapsed() << "ms";
+    return true;
+}
+
+qsizetype M3uReader::count() const
+{
+    return static_cast<qsizetype>(m_entries.size());
+}
+
+QByteArrayView M3uReader::line(qint64 offset) const
+{
+    const char *first = m_data + offset;
+    const char *last = lineEnd(first, m_data + m_size);
+    while (last > first && isSpace(*(last - 1))) {
+        --last;
+    }
+    return QByteArrayView(first, last - first);
+}
+
+QByteArrayView M3uReader::entry(qsizetype i) const
+{
+    return line(m_entries[i].offset);
+}
+
+QUrl M3uReader::url(qsizetype i) const
+{
+    const auto line = QByteArray::fromPercentEncoding(entry(i).toByteArray());
+    // the working directory doesn't affect absolute paths and it's required for relative paths
+    return QUrl::fromUserInput(QString::fromUtf8(line), m_folder);
+}
+
+qsizetype M3uReader::indexOf(const QUrl &url) const
+{
+    const auto fileName = url.fileName();
+    if (fileName.isEmpty()) {
+        return -1;
+    }
+
+    // resolving every entry is what reading lazily avoids,
+    // only the entries that contain the file name are looked at
+    const auto name = fileName.toUtf8();
+    const auto encodedName = QUrl::toPercentEncoding(fileName);
+    const std::string_view nameView(name.constData(), name.size());
+    const std::string_view encodedNameView(encodedName.constData(), encodedName.size());
+    for (qsizetype i = 0; i < count(); ++i) {
+        const auto line = entry(i);
+        const std::string_view lineView(line.data(), line.size());
+        if (lineView.find(nameView) == std::string_view::npos && lineView.find(encodedNameView) == std::string_view::npos) {
+            continue;
+        }
+        if (this->url(i).matches(url, QUrl::NormalizePathSegments)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool M3uReader::extinf(qsizetype i, double *duration, QString *title) const
+{
+    if (m_entries[i].extinf < 0) {
+        return false;
+    }
+
+    // #EXTINF:duration [key="value" ...],title
+    const auto info = line(m_entries[i].extinf).sliced(ExtinfTag.size());
+    qsizetype comma{-1};
+    bool quoted{false};
+    for (qsizetype j = 0; j < info.size(); ++j) {
+        if (info[j] == '"') {
+            quoted = !quoted;
+        } else if (info[j] == ',' && !quoted) {
+            comma = j;
+            break;
+        }
+    }
+
+    auto durationText = comma < 0 ? info : info.first(comma);
+    const auto space = durationText.indexOf(' ');
+    if (space >= 0) {
+        durationText = durationText.first(space);
+    }
+    bool ok{false};
+    const double value = durationText.toByteArray().toDouble(&ok);
+    // -1 means the duration is not known
+    *duration = ok && value > 0 ? value : 0.0;
+    *title = comma < 0 ? QString() : QString::fromUtf8(info.sliced(comma + 1)).trimmed();
+    return true;
+}
+
+qint64 M3uReader::lastModified() const
+{
+    return m_lastModified;
+}
+
+QByteArray M3uReader::header()
+{
+    return QByteArrayLiteral("#EXTM3U");
+}
+
+QByteArray M3uReader::extinfLine(double duration, const QString &title)
+{
+    // a line break in the title would end the line
+    auto text = title;
+    text.replace(u'\n', u' ').replace(u'\r', u' ');
+    const auto durationText = duration > 0 ? QByteArray::number(duration, 'f', 3) : QByteArrayLiteral("-1");
+    return QByteArray(ExtinfTag.data(), ExtinfTag.size()) + durationText + ',' + text.toUtf8();
+}
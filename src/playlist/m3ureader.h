@@ -0,0 +1,69 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef M3UREADER_H
+#define M3UREADER_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QFile>
+#include <QString>
+#include <QUrl>
+
+#include <vector>
+
+/**
+ * An m3u file read without creating its items.
+ *
+ * The file is mapped into memory (read into a buffer when it can't be mapped)
+ * and only the offsets where the entries start are kept. Lines are found with
+ * memchr, comments and empty lines are skipped. Entries are turned into urls
+ * when they are asked for, so a playlist with hundreds of thousands of entries
+ * costs a few megabytes until its items are created.
+ *
+ * Extended m3u files (#EXTM3U) give the duration and title of an entry in the
+ * #EXTINF line before it, see extinf().
+ */
+class M3uReader
+{
+public:
+    bool open(const QString &path);
+    qsizetype count() const;
+    // the text of entry i, without the line break and surrounding whitespace
+    QByteArrayView entry(qsizetype i) const;
+    // url of entry i, relative paths are resolved against the folder of the m3u file
+    QUrl url(qsizetype i) const;
+    // the first entry with url, -1 when there is none
+    qsizetype indexOf(const QUrl &url) const;
+    // reads the "#EXTINF:duration,title" line of entry i, returns false when it has none;
+    // duration is 0 when it's not known
+    bool extinf(qsizetype i, double *duration, QString *title) const;
+    // of the m3u file, msecs since epoch
+    qint64 lastModified() const;
+
+    static QByteArray header();
+    // the #EXTINF line for an entry, without the line break
+    static QByteArray extinfLine(double duration, const QString &title);
+
+private:
+    struct Entry {
+        // where the entry starts in m_data
+        qint64 offset;
+        // where its #EXTINF line starts, -1 when it has none
+        qint64 extinf;
+    };
+
+    QByteArrayView line(qint64 offset) const;
+
+    QFile m_file;
+    // holds the file when it can't be mapped
+    QByteArray m_buffer;
+    const char *m_data{nullptr};
+    qsizetype m_size{0};
+    std::vector<Entry> m_entries;
+    QString m_folder;
+    qint64 m_lastModified{0};
+};
+
+#endif // M3UREADER_H
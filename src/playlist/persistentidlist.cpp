@@ -0,0 +1,159 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "persistentidlist.h"
+
+#include <QRandomGenerator>
+
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+
+PersistentIdList::PersistentIdList(NodePtr root)
+    : m_root{std::move(root)}
+{
+}
+
+PersistentIdList PersistentIdList::fromIds(const std::vector<quint32> &ids)
+{
+    return PersistentIdList(build(ids.data(), ids.data() + ids.size()));
+}
+
+qsizetype PersistentIdList::size() const
+{
+    return size(m_root);
+}
+
+bool PersistentIdList::isEmpty() const
+{
+    return !m_root;
+}
+
+std::vector<quint32> PersistentIdList::toIds() const
+{
+    std::vector<quint32> ids;
+    ids.reserve(size());
+    // in order, without recursion
+    std::vector<const Node *> stack;
+    const Node *node = m_root.get();
+    while (node || !stack.empty()) {
+        while (node) {
+            stack.push_back(node);
+            node = node->left.get();
+        }
+        node = stack.back();
+        stack.pop_back();
+        ids.push_back(node->id);
+        node = node->right.get();
+    }
+    return ids;
+}
+
+PersistentIdList PersistentIdList::inserted(qsizetype position, const PersistentIdList &other) const
+{
+    if (other.isEmpty()) {
+        return *this;
+    }
+    auto [left, right] = split(m_root, std::clamp<qsizetype>(position, 0, size()));
+    return PersistentIdList(merge(merge(left, other.m_root), right));
+}
+
+PersistentIdList PersistentIdList::appended(const PersistentIdList &other) const
+{
+    return PersistentIdList(merge(m_root, other.m_root));
+}
+
+PersistentIdList PersistentIdList::removed(std::vector<qsizetype> positions) const
+{
+    std::sort(positions.begin(), positions.end(), std::greater<>());
+    positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+
+    // from the back, so the positions still to remove don't move
+    NodePtr root = m_root;
+    for (const qsizetype position : positions) {
+        if (position < 0 || position >= size(root)) {
+            continue;
+        }
+        auto [left, rest] = split(root, position);
+        root = merge(left, split(rest, 1).second);
+    }
+    return PersistentIdList(std::move(root));
+}
+
+QSet<quint32> PersistentIdList::collectIds(const std::vector<PersistentIdList> &lists)
+{
+    QSet<quint32> ids;
+    std::unordered_set<const Node *> visited;
+    std::vector<const Node *> stack;
+    for (const auto &list : lists) {
+        if (list.m_root) {
+            stack.push_back(list.m_root.get());
+        }
+        while (!stack.empty()) {
+            const Node *node = stack.back();
+            stack.pop_back();
+            if (!visited.insert(node).second) {
+                // so is everything below it
+                continue;
+            }
+            ids.insert(node->id);
+            if (node->left) {
+                stack.push_back(node->left.get());
+            }
+            if (node->right) {
+                stack.push_back(node->right.get());
+            }
+        }
+    }
+    return ids;
+}
+
+qsizetype PersistentIdList::size(const NodePtr &node)
+{
+    return node ? node->size : 0;
+}
+
+PersistentIdList::NodePtr PersistentIdList::makeNode(quint32 id, NodePtr left, NodePtr right)
+{
+    const auto nodeSize = size(left) + size(right) + 1;
+    return std::make_shared<const Node>(Node{id, nodeSize, std::move(left), std::move(right)});
+}
+
+PersistentIdList::NodePtr PersistentIdList::build(const quint32 *first, const quint32 *last)
+{
+    if (first == last) {
+        return nullptr;
+    }
+    const quint32 *middle = first + (last - first) / 2;
+    return makeNode(*middle, build(first, middle), build(middle + 1, last));
+}
+
+PersistentIdList::NodePtr PersistentIdList::merge(const NodePtr &left, const NodePtr &right)
+{
+    if (!left) {
+        return right;
+    }
+    if (!right) {
+        return left;
+    }
+    // the root of the bigger tree is more likely to stay the root, that keeps the depth logarithmic
+    const auto total = static_cast<quint64>(left->size + right->size);
+    if (QRandomGenerator::global()->bounded(total) < static_cast<quint64>(left->size)) {
+        return makeNode(left->id, left->left, merge(left->right, right));
+    }
+    return makeNode(right->id, merge(left, right->left), right->right);
+}
+
+std::pair<PersistentIdList::NodePtr, PersistentIdList::NodePtr> PersistentIdList::split(const NodePtr &node, qsizetype count)
+{
+    if (!node) {
+        return {nullptr, nullptr};
+    }
+    if (count <= size(node->left)) {
+        auto [left, right] = split(node->left, count);
+        return {std::move(left), makeNode(node->id, std::move(right), node->right)};
+    }
+    auto [left, right] = split(node->right, count - size(node->left) - 1);
+    return {makeNode(node->id, node->left, std::move(left)), std::move(right)};
+}
@@ -0,0 +1,67 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef PERSISTENTIDLIST_H
+#define PERSISTENTIDLIST_H
+
+#include <QSet>
+#include <QtGlobal>
+
+#include <memory>
+#include <vector>
+
+/**
+ * An immutable sequence of item ids, used for the undo history of a playlist.
+ *
+ * The ids are the nodes of a tree ordered by position. Changing the list returns
+ * a new list that shares all the nodes the change didn't touch with the old one,
+ * so removing, inserting or moving k items of n costs O(k log n) new nodes and
+ * keeping the old list around is almost free. Copies share everything.
+ *
+ * The tree is balanced by merging randomly, weighted by the sizes of the merged
+ * trees, so no balancing data is stored in the nodes.
+ */
+class PersistentIdList
+{
+public:
+    PersistentIdList() = default;
+    static PersistentIdList fromIds(const std::vector<quint32> &ids);
+
+    qsizetype size() const;
+    bool isEmpty() const;
+    std::vector<quint32> toIds() const;
+
+    // list with the ids of other inserted before position
+    PersistentIdList inserted(qsizetype position, const PersistentIdList &other) const;
+    PersistentIdList appended(const PersistentIdList &other) const;
+    // list without the ids at positions, which don't have to be sorted
+    PersistentIdList removed(std::vector<qsizetype> positions) const;
+
+    // ids of all the lists, nodes shared between the lists are visited once
+    static QSet<quint32> collectIds(const std::vector<PersistentIdList> &lists);
+
+private:
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+
+    struct Node {
+        quint32 id;
+        qsizetype size;
+        NodePtr left;
+        NodePtr right;
+    };
+
+    explicit PersistentIdList(NodePtr root);
+
+    static qsizetype size(const NodePtr &node);
+    static NodePtr makeNode(quint32 id, NodePtr left, NodePtr right);
+    static NodePtr build(const quint32 *first, const quint32 *last);
+    static NodePtr merge(const NodePtr &left, const NodePtr &right);
+    // the first count ids and the rest
+    static std::pair<NodePtr, NodePtr> split(const NodePtr &node, qsizetype count);
+
+    NodePtr m_root;
+};
+
+#endif // PERSISTENTIDLIST_H
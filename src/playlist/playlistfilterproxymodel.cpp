@@ -14,36 +14,69 @@
 #include <QFile>
 #include <QGuiApplication>
 #include <QMap>
-#include <QTimer>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <numeric>
 
 #include <KFileItem>
 #include <KIO/DeleteOrTrashJob>
 #include <KIO/RenameFileDialog>
 
+#include "m3ureader.h"
 #include "miscutils.h"
 #include "pathutils.h"
+#include "playlistfolderwatcher.h"
 #include "playlistsettings.h"
+#include "playliststore.h"
 #include "playlisttypes.h"
 
 using namespace Qt::StringLiterals;
+
+namespace
+{
+// above this many rows to check, searching is done off the gui thread
+constexpr std::size_t AsyncSearchThreshold = 20000;
+// when the search shows or hides rows in more ranges than this,
+// the view gets a single layout change instead of a signal per range
+constexpr int MaxFilterRanges = 64;
+// same for moving the selected items, each range moved costs a pass over the rows it jumps
+constexpr std::size_t MaxMoveRanges = 64;
+// undoable edits kept
+constexpr std::size_t MaxUndoSteps = 100;
+// removed items kept before looking for the ones no snapshot refers to
+constexpr qsizetype MinPruneThreshold = 1024;
+// additions this close to the previous one are undone with it, in ms
+constexpr qint64 AdditionStepWindow = 2000;
+} // namespace
+
 PlaylistFilterProxyModel::PlaylistFilterProxyModel(QObject *parent)
-    : QSortFilterProxyModel{parent}
+    : QAbstractListModel{parent}
     , m_playlistModel{std::make_unique<PlaylistModel>()}
-    , m_playlistSortProxyModel{std::make_unique<PlaylistSortProxyModel>()}
-    , m_playlistProxyModel{std::make_unique<PlaylistProxyModel>()}
-    , m_selectionModel(this)
+    , m_searchIndex{m_playlistModel.get()}
 {
-    m_playlistSortProxyModel->setSourceModel(m_playlistModel.get());
-    m_playlistProxyModel->setSourceModel(m_playlistSortProxyModel.get());
-    setSourceModel(m_playlistProxyModel.get());
-
-    setDynamicSortFilter(true);
-    setFilterCaseSensitivity(Qt::CaseInsensitive);
-    invalidate();
+    m_collator.setNumericMode(true);
+    m_collator.setCaseSensitivity(Qt::CaseInsensitive);
+    // metadata arrives in batches, re-sort once the batch is in
+    m_sortTimer.setInterval(0);
+    m_sortTimer.setSingleShot(true);
+    connect(&m_sortTimer, &QTimer::timeout, this, &PlaylistFilterProxyModel::sortOrder);
+
+    auto model = m_playlistModel.get();
+    connect(model, &QAbstractItemModel::rowsInserted, this, &PlaylistFilterProxyModel::onPlaylistRowsInserted);
+    connect(model, &PlaylistModel::itemsAboutToBeRemoved, this, &PlaylistFilterProxyModel::onPlaylistItemsAboutToBeRemoved);
+    connect(model, &PlaylistModel::itemsRemoved, this, &PlaylistFilterProxyModel::onPlaylistItemsRemoved);
+    connect(model, &QAbstractItemModel::dataChanged, this, &PlaylistFilterProxyModel::onPlaylistDataChanged);
+    connect(model, &QAbstractItemModel::modelAboutToBeReset, this, &PlaylistFilterProxyModel::onPlaylistModelAboutToBeReset);
+    connect(model, &QAbstractItemModel::modelReset, this, &PlaylistFilterProxyModel::onPlaylistModelReset);
+    connect(model, &PlaylistModel::folderLoaded, this, &PlaylistFilterProxyModel::watchFolder);
+}
 
-    connect(&m_selectionModel, &QItemSelectionModel::selectionChanged, this, &PlaylistFilterProxyModel::onSelectionChanged);
-    connect(this, &QSortFilterProxyModel::rowsInserted, this, &PlaylistFilterProxyModel::shufflePlaylistModel);
-    connect(this, &QSortFilterProxyModel::rowsRemoved, this, &PlaylistFilterProxyModel::shufflePlaylistModel);
+PlaylistFilterProxyModel::~PlaylistFilterProxyModel()
+{
+    m_searchTasks.cancelAndWait();
 }
 
 void PlaylistFilterProxyModel::setPlaylistType(Playlist::PlaylistType type)
@@ -56,18 +89,57 @@ Playlist::PlaylistType PlaylistFilterProxyModel::playlistType() const
     return m_playlistType;
 }
 
+int PlaylistFilterProxyModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return static_cast<int>(m_rows.size()) - (m_gapEnd - m_gapFirst);
+}
 
 QVariant PlaylistFilterProxyModel::data(const QModelIndex &index, int role) const
 {
+    if (!index.isValid() || index.row() >= rowCount()) {
+        return QVariant();
+    }
+    const int row = modelRowAt(index.row());
     if (role == PlaylistModel::IsSelectedRole) {
-        return QVariant(m_selectionModel.isSelected(index));
+        return QVariant(isRowSelected(row));
+    }
+    const auto model = playlistModel();
+    return model->data(model->index(row, 0), role);
+}
+
+QHash<int, QByteArray> PlaylistFilterProxyModel::roleNames() const
+{
+    return playlistModel()->roleNames();
+}
+
+bool PlaylistFilterProxyModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && playlistModel()->canFetchMore(QModelIndex());
+}
+
+void PlaylistFilterProxyModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid()) {
+        return;
+    }
+    playlistModel()->fetchMore(QModelIndex());
+    Q_EMIT itemCountChanged();
+}
+
+void PlaylistFilterProxyModel::fetchAll()
+{
+    if (canFetchMore(QModelIndex())) {
+        playlistModel()->fetchAll();
+        Q_EMIT itemCountChanged();
     }
-    return playlistModel()->data(mapToPlaylistModel(index.row()), role);
 }
 
 uint PlaylistFilterProxyModel::selectionCount()
 {
-    return m_selectionModel.selectedRows().count();
+    return m_selectionCount;
 }
 
 uint PlaylistFilterProxyModel::itemCount()
@@ -77,49 +149,733 @@ uint PlaylistFilterProxyModel::itemCount()
 
 QString PlaylistFilterProxyModel::searchText()
 {
-    return filterRegularExpression().pattern();
+    return m_searchText;
 }
 
 void PlaylistFilterProxyModel::setSearchText(QString text)
 {
-    Filter filter = PlaylistSettings::showMediaTitle() ? Filter::Title : Filter::Name;
-    setFilterRole(filter);
-    setFilterRegularExpression(text);
-    invalidateFilter();
+    using Field = PlaylistSearchIndex::Field;
+    const auto field = PlaylistSettings::showMediaTitle() ? Field::Title : Field::Name;
+    const auto mode = PlaylistSearchIndex::modeFromString(PlaylistSettings::searchMode());
+    if (text == m_searchText && field == m_searchField && mode == m_searchMode) {
+        return;
+    }
+
+    const auto tokens = PlaylistSearchIndex::tokenize(PlaylistSearchIndex::fold(text));
+    if (!tokens.isEmpty()) {
+        // the search covers the whole playlist, not only the items fetched so far
+        fetchAll();
+    }
+    // when the query only got longer, the new matches are a subset of the current ones
+    // so only those have to be checked again, unless the current ones are still being computed
+    const bool narrowing = !m_searchPending && field == m_searchField && mode == m_searchMode
+        && PlaylistSearchIndex::narrows(m_searchTokens, tokens, mode);
+
+    m_searchText = text;
+    m_searchTokens = tokens;
+    m_searchField = field;
+    m_searchMode = mode;
+    ++m_searchGeneration;
+    m_searchPending = false;
+
+    if (m_searchTokens.isEmpty()) {
+        m_matchStates.clear();
+        refilter();
+    } else {
+        runSearch(narrowing);
+    }
     Q_EMIT searchTextChanged();
 }
 
+bool PlaylistFilterProxyModel::acceptsRow(int row) const
+{
+    if (m_searchTokens.isEmpty()) {
+        return true;
+    }
+
+    if (row >= static_cast<int>(m_matchStates.size())) {
+        m_matchStates.resize(row + 1, MatchState::Unknown);
+    }
+    auto &state = m_matchStates[row];
+    if (state == MatchState::Unknown) {
+        bool matches = PlaylistSearchIndex::matches(m_searchIndex.key(row, m_searchField), m_searchTokens, m_searchMode);
+        state = matches ? MatchState::Match : MatchState::NoMatch;
+    }
+    return state == MatchState::Match;
+}
+
+void PlaylistFilterProxyModel::refilter()
+{
+    // both the current and the new visible rows follow m_order,
+    // walking it gives the ranges that have to be hidden and shown
+    std::vector<char> accepted(m_order.size(), 0);
+    int ranges{0};
+    bool previousChanged{false};
+    for (const int row : m_order) {
+        accepted[row] = acceptsRow(row);
+        const bool changed = static_cast<bool>(accepted[row]) != (m_viewRows[row] >= 0);
+        if (changed && !previousChanged) {
+            ++ranges;
+        }
+        previousChanged = changed;
+    }
+
+    if (ranges == 0) {
+        return;
+    }
+
+    // hidden items stay selected, but only the visible ones are counted
+    const int previousCount = m_selectionCount;
+    if (ranges > MaxFilterRanges) {
+        relayout();
+    } else {
+        refilterRanges(accepted);
+    }
+    if (m_selectionCount != previousCount) {
+        Q_EMIT selectionCountChanged();
+    }
+}
+
+void PlaylistFilterProxyModel::refilterRanges(const std::vector<char> &accepted)
+{
+    // hide, from the bottom up so the view rows above stay valid
+    int last = static_cast<int>(m_rows.size()) - 1;
+    while (last >= 0) {
+        if (accepted[m_rows[last]]) {
+            --last;
+            continue;
+        }
+        int first = last;
+        while (first > 0 && !accepted[m_rows[first - 1]]) {
+            --first;
+        }
+        beginRemoveRows(QModelIndex(), first, last);
+        for (int i = first; i <= last; ++i) {
+            m_viewRows[m_rows[i]] = -1;
+            m_selectionCount -= isRowSelected(m_rows[i]) ? 1 : 0;
+        }
+        m_rows.erase(m_rows.begin() + first, m_rows.begin() + last + 1);
+        endRemoveRows();
+        last = first - 1;
+    }
+
+    // show, hidden rows between the newly accepted ones don't split a range
+    int viewRow{0};
+    std::size_t i{0};
+    while (i < m_order.size()) {
+        const int row = m_order[i];
+        if (m_viewRows[row] >= 0) {
+            m_viewRows[row] = viewRow++;
+            ++i;
+            continue;
+        }
+        if (!accepted[row]) {
+            ++i;
+            continue;
+        }
+
+        std::vector<int> shown;
+        for (; i < m_order.size() && m_viewRows[m_order[i]] < 0; ++i) {
+            if (accepted[m_order[i]]) {
+                shown.push_back(m_order[i]);
+            }
+        }
+        beginInsertRows(QModelIndex(), viewRow, viewRow + static_cast<int>(shown.size()) - 1);
+        m_rows.insert(m_rows.begin() + viewRow, shown.cbegin(), shown.cend());
+        for (const int shownRow : shown) {
+            m_viewRows[shownRow] = viewRow++;
+            m_selectionCount += isRowSelected(shownRow) ? 1 : 0;
+        }
+        endInsertRows();
+    }
+}
+
+void PlaylistFilterProxyModel::rebuildMappings()
+{
+    m_positions.assign(m_order.size(), -1);
+    m_viewRows.assign(m_order.size(), -1);
+    m_rows.clear();
+    m_selectionCount = 0;
+    for (std::size_t i = 0; i < m_order.size(); ++i) {
+        const int row = m_order[i];
+        m_positions[row] = static_cast<int>(i);
+        if (acceptsRow(row)) {
+            m_viewRows[row] = static_cast<int>(m_rows.size());
+            m_rows.push_back(row);
+            m_selectionCount += isRowSelected(row) ? 1 : 0;
+        }
+    }
+}
+
+void PlaylistFilterProxyModel::relayout()
+{
+    Q_EMIT layoutAboutToBeChanged();
+
+    const auto persistentIndexes = persistentIndexList();
+    std::vector<int> persistentRows;
+    persistentRows.reserve(persistentIndexes.size());
+    for (const auto &index : persistentIndexes) {
+        persistentRows.push_back(mapToPlaylistModel(index.row()));
+    }
+
+    rebuildMappings();
+
+    QModelIndexList updatedIndexes;
+    updatedIndexes.reserve(persistentIndexes.size());
+    for (const int row : persistentRows) {
+        const int viewRow = mapFromPlaylistModel(row);
+        updatedIndexes.append(viewRow >= 0 ? index(viewRow, 0) : QModelIndex());
+    }
+    changePersistentIndexList(persistentIndexes, updatedIndexes);
+
+    Q_EMIT layoutChanged();
+}
+
+bool PlaylistFilterProxyModel::sortOrder()
+{
+    m_sortTimer.stop();
+
+    auto order = m_order;
+    std::stable_sort(order.begin(), order.end(), [this](int left, int right) {
+        return sortsBefore(left, right);
+    });
+    if (order == m_order) {
+        return false;
+    }
+
+    m_order = std::move(order);
+    // every item can move, nothing is shared with the previous order
+    m_orderIds = currentOrderIds();
+    relayout();
+    Q_EMIT orderChanged();
+    return true;
+}
+
+bool PlaylistFilterProxyModel::sortsBefore(int leftRow, int rightRow) const
+{
+    return m_sortOrder == Qt::AscendingOrder ? lessThan(leftRow, rightRow) : lessThan(rightRow, leftRow);
+}
+
+bool PlaylistFilterProxyModel::lessThan(int leftRow, int rightRow) const
+{
+    const auto model = playlistModel();
+    const auto &left = model->m_playlist[leftRow];
+    const auto &right = model->m_playlist[rightRow];
+
+    switch (m_sortKey) {
+    case SortKey::Name:
+    case SortKey::Folder:
+        return collationKey(leftRow).compare(collationKey(rightRow)) < 0;
+    case SortKey::Duration:
+        if (left.duration != right.duration) {
+            return left.duration < right.duration;
+        }
+        break;
+    case SortKey::LastModified:
+        if (left.lastModified != right.lastModified) {
+            return left.lastModified < right.lastModified;
+        }
+        break;
+    case SortKey::FileSize:
+        if (left.fileSize != right.fileSize) {
+            return left.fileSize < right.fileSize;
+        }
+        break;
+    case SortKey::TrackNumber: {
+        // items without a track number go after the numbered ones
+        const uint leftTrack = left.trackNumber > 0 ? left.trackNumber : std::numeric_limits<uint>::max();
+        const uint rightTrack = right.trackNumber > 0 ? right.trackNumber : std::numeric_limits<uint>::max();
+        if (leftTrack != rightTrack) {
+            return leftTrack < rightTrack;
+        }
+        break;
+    }
+    }
+
+    // equal keys, fall back to the natural name order
+    return collationKey(leftRow).compare(collationKey(rightRow)) < 0;
+}
+
+int PlaylistFilterProxyModel::sortRole() const
+{
+    switch (m_sortKey) {
+    case SortKey::Name:
+        return PlaylistModel::NameRole;
+    case SortKey::Duration:
+        return PlaylistModel::DurationValueRole;
+    case SortKey::LastModified:
+        return PlaylistModel::LastModifiedRole;
+    case SortKey::FileSize:
+        return PlaylistModel::FileSizeRole;
+    case SortKey::Folder:
+        return PlaylistModel::FolderPathRole;
+    case SortKey::TrackNumber:
+        return PlaylistModel::TrackNumberRole;
+    }
+    return PlaylistModel::NameRole;
+}
+
+QCollatorSortKey PlaylistFilterProxyModel::makeCollationKey(int row) const
+{
+    const auto &item = playlistModel()->m_playlist[row];
+    if (m_sortKey == SortKey::Folder) {
+        return m_collator.sortKey(item.folderPath + u'/' + item.filename);
+    }
+    return m_collator.sortKey(item.filename);
+}
+
+const QCollatorSortKey &PlaylistFilterProxyModel::collationKey(int row) const
+{
+    // the keys are kept for a prefix of the PlaylistModel rows, missing ones are added at the end
+    const auto rowCount = static_cast<int>(playlistModel()->m_playlist.size());
+    if (static_cast<int>(m_collationKeys.size()) < rowCount) {
+        m_collationKeys.reserve(rowCount);
+        for (int i = m_collationKeys.size(); i < rowCount; ++i) {
+            m_collationKeys.push_back(makeCollationKey(i));
+        }
+    }
+    return m_collationKeys[row];
+}
+
+void PlaylistFilterProxyModel::runSearch(bool narrowing)
+{
+    const int rows = playlistModel()->rowCount();
+    m_matchStates.resize(rows, MatchState::Unknown);
+
+    std::vector<int> candidates;
+    candidates.reserve(rows);
+    for (int row = 0; row < rows; ++row) {
+        if (!narrowing || m_matchStates[row] != MatchState::NoMatch) {
+            candidates.push_back(row);
+        }
+    }
+
+    if (candidates.size() < AsyncSearchThreshold) {
+        for (int row : candidates) {
+            bool matches = PlaylistSearchIndex::matches(m_searchIndex.key(row, m_searchField), m_searchTokens, m_searchMode);
+            m_matchStates[row] = matches ? MatchState::Match : MatchState::NoMatch;
+        }
+        refilter();
+        return;
+    }
+    // the worker only gets copies, the index is not touched outside the gui thread;
+    // keys that were not folded yet are folded by the worker and stored when publishing
+    std::vector<SearchCandidate> snapshot;
+    snapshot.reserve(candidates.size());
+    for (int row : candidates) {
+        if (m_searchIndex.hasKey(row, m_searchField)) {
+            snapshot.push_back({row, m_searchIndex.key(row, m_searchField), true});
+        } else {
+            snapshot.push_back({row, m_searchIndex.rawText(row, m_searchField), false});
+        }
+    }
+
+    m_searchPending = true;
+    // the results of a search that didn't start yet would be dropped anyway
+    m_searchTasks.cancel();
+    auto search = [this,
+                   generation = m_searchGeneration,
+                   revision = m_searchIndex.revision(),
+                   structureRevision = m_searchIndex.structureRevision(),
+                   tokens = m_searchTokens,
+                   mode = m_searchMode,
+                   snapshot = std::move(snapshot)]() mutable {
+        std::vector<int> matchedRows;
+        for (auto &candidate : snapshot) {
+            if (!candidate.folded) {
+                candidate.text = PlaylistSearchIndex::fold(candidate.text);
+            }
+            if (PlaylistSearchIndex::matches(candidate.text, tokens, mode)) {
+                matchedRows.push_back(candidate.row);
+            }
+        }
+
+        QMetaObject::invokeMethod(
+            this,
+            [this, generation, revision, structureRevision, snapshot = std::move(snapshot), matchedRows = std::move(matchedRows)]() {
+                publishSearchResults(generation, revision, structureRevision, snapshot, matchedRows);
+            },
+            Qt::QueuedConnection);
+    };
+    TaskScheduler::instance()->submit(TaskScheduler::Lane::Interactive, TaskScheduler::Resource::Cpu, QString(), m_searchTasks, std::move(search));
+}
+
+void PlaylistFilterProxyModel::publishSearchResults(quint64 generation,
+                                                    quint64 revision,
+                                                    quint64 structureRevision,
+                                                    const std::vector<SearchCandidate> &candidates,
+                                                    const std::vector<int> &matchedRows)
+{
+    if (generation != m_searchGeneration) {
+        // a newer search was started
+        return;
+    }
+    m_searchPending = false;
+
+    if (structureRevision != m_searchIndex.structureRevision()) {
+        // rows were removed or inserted in between, the row numbers are meaningless now
+        runSearch(false);
+        return;
+    }
+
+    auto matched = matchedRows.cbegin();
+    for (const auto &candidate : candidates) {
+        bool isMatch = matched != matchedRows.cend() && *matched == candidate.row;
+        if (isMatch) {
+            ++matched;
+        }
+        // rows whose name or title changed in between were already checked again by onPlaylistDataChanged
+        if (m_searchIndex.changedSince(candidate.row, revision)) {
+            continue;
+        }
+        if (!candidate.folded) {
+            m_searchIndex.setKey(candidate.row, m_searchField, candidate.text);
+        }
+        m_matchStates[candidate.row] = isMatch ? MatchState::Match : MatchState::NoMatch;
+    }
+
+    refilter();
+}
+
+void PlaylistFilterProxyModel::onPlaylistRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent)
+
+    const int count = last - first + 1;
+    const int oldRowCount = static_cast<int>(m_order.size());
+
+    // m_orderIds is still the order without the new items
+    if (!playlistModel()->m_insertingExisting) {
+        if (!m_additionStep || m_lastAddition.elapsed() > AdditionStepWindow) {
+            recordEdit(m_orderIds);
+            m_additionStep = true;
+        }
+        m_lastAddition.start();
+    }
+
+    m_searchIndex.insertRows(first, last);
+    if (first < static_cast<int>(m_matchStates.size())) {
+        m_matchStates.insert(m_matchStates.begin() + first, count, MatchState::Unknown);
+    }
+    if (first < static_cast<int>(m_collationKeys.size())) {
+        m_collationKeys.erase(m_collationKeys.begin() + first, m_collationKeys.end());
+    }
+
+    // where the new items go in the playlist order
+    int position = oldRowCount;
+    if (m_insertPosition >= 0 && m_insertPosition <= oldRowCount) {
+        position = m_insertPosition;
+        m_sorted = false;
+    } else if (m_sorted && count == 1) {
+        const auto it = std::upper_bound(m_order.cbegin(), m_order.cend(), first, [this, first, count](int row, int other) {
+            // other is still an old row number
+            return sortsBefore(row, other >= first ? other + count : other);
+        });
+        position = static_cast<int>(std::distance(m_order.cbegin(), it));
+    }
+    m_insertPosition = -1;
+
+    std::vector<int> inserted(count);
+    std::iota(inserted.begin(), inserted.end(), first);
+    std::vector<quint32> insertedIds;
+    insertedIds.reserve(count);
+    for (const int row : inserted) {
+        insertedIds.push_back(itemId(row));
+    }
+    m_orderIds = m_orderIds.inserted(position, PersistentIdList::fromIds(insertedIds));
+    int visibleCount{0};
+    for (const int row : inserted) {
+        visibleCount += acceptsRow(row) ? 1 : 0;
+    }
+
+    if (position == oldRowCount && first == oldRowCount) {
+        // appended, nothing moves
+        if (visibleCount > 0) {
+            beginInsertRows(QModelIndex(), rowCount(), rowCount() + visibleCount - 1);
+        }
+        for (const int row : inserted) {
+            m_order.push_back(row);
+            m_positions.push_back(static_cast<int>(m_order.size()) - 1);
+            m_viewRows.push_back(-1);
+            if (acceptsRow(row)) {
+                m_viewRows[row] = static_cast<int>(m_rows.size());
+                m_rows.push_back(row);
+                m_selectionCount += isRowSelected(row) ? 1 : 0;
+            }
+        }
+        if (visibleCount > 0) {
+            endInsertRows();
+        }
+    } else {
+        // the new rows come before the first visible item at or after position
+        int viewRow = rowCount();
+        for (int i = position; i < oldRowCount; ++i) {
+            if (m_viewRows[m_order[i]] >= 0) {
+                viewRow = m_viewRows[m_order[i]];
+                break;
+            }
+        }
+
+        if (visibleCount > 0) {
+            beginInsertRows(QModelIndex(), viewRow, viewRow + visibleCount - 1);
+        }
+        if (first < oldRowCount) {
+            for (auto &row : m_order) {
+                if (row >= first) {
+                    row += count;
+                }
+            }
+        }
+        m_order.insert(m_order.begin() + position, inserted.cbegin(), inserted.cend());
+        rebuildMappings();
+        if (visibleCount > 0) {
+            endInsertRows();
+        }
+    }
+
+    if (position != oldRowCount) {
+        Q_EMIT orderChanged();
+    } else if (m_sorted && count > 1) {
+        sortOrder();
+    }
+}
+
+void PlaylistFilterProxyModel::onPlaylistItemsAboutToBeRemoved(const std::vector<int> &rows)
+{
+    if (!m_undoStack.empty() || !m_redoStack.empty()) {
+        const auto model = playlistModel();
+        for (const int row : rows) {
+            m_removedItems.insert(model->m_playlist[row].id, model->m_playlist[row]);
+        }
+    }
+
+    const int previousCount = m_selectionCount;
+    std::vector<int> viewRows;
+    for (const int row : rows) {
+        setRowSelected(row, false);
+        if (m_viewRows[row] >= 0) {
+            viewRows.push_back(m_viewRows[row]);
+        }
+    }
+    std::sort(viewRows.begin(), viewRows.end());
+
+    // top down, the removed rows collect in a gap that grows down the vector,
+    // the rows between two ranges are moved up over the gap once
+    if (!viewRows.empty()) {
+        m_gapFirst = m_gapEnd = viewRows.front();
+    }
+    std::size_t i{0};
+    while (i < viewRows.size()) {
+        const int rangeFirst = viewRows[i];
+        int rangeLast = rangeFirst;
+        while (++i < viewRows.size() && viewRows[i] == rangeLast + 1) {
+            ++rangeLast;
+        }
+        std::move(m_rows.begin() + m_gapEnd, m_rows.begin() + rangeFirst, m_rows.begin() + m_gapFirst);
+        m_gapFirst += rangeFirst - m_gapEnd;
+        m_gapEnd = rangeFirst;
+
+        beginRemoveRows(QModelIndex(), m_gapFirst, m_gapFirst + rangeLast - rangeFirst);
+        m_gapEnd = rangeLast + 1;
+        endRemoveRows();
+    }
+    m_rows.erase(m_rows.begin() + m_gapFirst, m_rows.begin() + m_gapEnd);
+    m_gapFirst = m_gapEnd = 0;
+
+    if (m_selectionCount != previousCount) {
+        Q_EMIT selectionCountChanged();
+    }
+}
+
+void PlaylistFilterProxyModel::onPlaylistItemsRemoved(const std::vector<int> &rows)
+{
+    // m_positions still has the old rows
+    std::vector<qsizetype> positions;
+    positions.reserve(rows.size());
+    for (const int row : rows) {
+        positions.push_back(m_positions[row]);
+    }
+
+    m_searchIndex.removeRows(rows);
+    eraseRows(m_matchStates, rows);
+    eraseRows(m_collationKeys, rows);
+
+    // old PlaylistModel row -> new row, -1 for the removed ones
+    std::vector<int> newRows(m_order.size());
+    auto removed = rows.cbegin();
+    for (int row = 0; row < static_cast<int>(newRows.size()); ++row) {
+        if (removed != rows.cend() && *removed == row) {
+            newRows[row] = -1;
+            ++removed;
+            continue;
+        }
+        newRows[row] = row - static_cast<int>(std::distance(rows.cbegin(), removed));
+    }
+
+    std::vector<int> order;
+    order.reserve(newRows.size() - rows.size());
+    for (const int row : m_order) {
+        if (newRows[row] >= 0) {
+            order.push_back(newRows[row]);
+        }
+    }
+    m_order = std::move(order);
+    // removing most of the playlist is cheaper as a new list
+    m_orderIds = positions.size() * 8 > newRows.size() ? currentOrderIds() : m_orderIds.removed(std::move(positions));
+    rebuildMappings();
+}
+
+void PlaylistFilterProxyModel::onPlaylistDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QList<int> &roles)
+{
+    const int first = topLeft.row();
+    const int last = bottomRight.row();
+    auto changed = [&roles](std::initializer_list<int> watched) {
+        return roles.isEmpty() || std::any_of(watched.begin(), watched.end(), [&roles](int role) {
+                   return roles.contains(role);
+               });
+    };
+
+    bool visibilityChanged{false};
+    if (changed({PlaylistModel::NameRole, PlaylistModel::TitleRole})) {
+        m_searchIndex.invalidateRows(first, last);
+        const int end = std::min(last + 1, static_cast<int>(m_matchStates.size()));
+        for (int row = first; row < end; ++row) {
+            m_matchStates[row] = MatchState::Unknown;
+        }
+        for (int row = first; row <= last && !visibilityChanged && !m_searchTokens.isEmpty(); ++row) {
+            visibilityChanged = acceptsRow(row) != (m_viewRows[row] >= 0);
+        }
+    }
+
+    if (changed({PlaylistModel::NameRole, PlaylistModel::FolderPathRole})) {
+        const int end = std::min(last, static_cast<int>(m_collationKeys.size()) - 1);
+        for (int row = first; row <= end; ++row) {
+            m_collationKeys[row] = makeCollationKey(row);
+        }
+    }
+
+    // a continuous range of PlaylistModel rows is not necessarily continuous in the view
+    std::vector<int> viewRows;
+    for (int row = first; row <= last; ++row) {
+        if (m_viewRows[row] >= 0) {
+            viewRows.push_back(m_viewRows[row]);
+        }
+    }
+    std::sort(viewRows.begin(), viewRows.end());
+    std::size_t i{0};
+    while (i < viewRows.size()) {
+        const int rangeFirst = viewRows[i];
+        int rangeLast = rangeFirst;
+        while (++i < viewRows.size() && viewRows[i] == rangeLast + 1) {
+            ++rangeLast;
+        }
+        Q_EMIT dataChanged(index(rangeFirst, 0), index(rangeLast, 0), roles);
+    }
+
+    if (visibilityChanged) {
+        refilter();
+    }
+    if (m_sorted && changed({sortRole(), PlaylistModel::NameRole})) {
+        m_sortTimer.start();
+    }
+}
+
+void PlaylistFilterProxyModel::onPlaylistModelAboutToBeReset()
+{
+    if (m_clearing) {
+        for (const auto &item : playlistModel()->m_playlist) {
+            m_removedItems.insert(item.id, item);
+        }
+    } else {
+        // another playlist is loaded
+        clearHistory();
+    }
+    beginResetModel();
+}
+
+void PlaylistFilterProxyModel::onPlaylistModelReset()
+{
+    const int previousCount = m_selectionCount;
+    m_selected.clear();
+    m_anchorId = 0;
+    m_searchIndex.clear();
+    m_matchStates.clear();
+    m_collationKeys.clear();
+    m_insertPosition = -1;
+    m_sortTimer.stop();
+
+    m_order.resize(playlistModel()->rowCount());
+    std::iota(m_order.begin(), m_order.end(), 0);
+    m_orderIds = currentOrderIds();
+    rebuildMappings();
+
+    endResetModel();
+
+    if (m_selectionCount != previousCount) {
+        Q_EMIT selectionCountChanged();
+    }
+}
+
 QString PlaylistFilterProxyModel::playlistName() const
 {
     return playlistModel()->m_playlistName;
 }
 
+bool PlaylistFilterProxyModel::loading() const
+{
+    return m_loading;
+}
+
+void PlaylistFilterProxyModel::setLoading(bool loading)
+{
+    if (m_loading == loading) {
+        return;
+    }
+    m_loading = loading;
+    Q_EMIT loadingChanged();
+}
+
+void PlaylistFilterProxyModel::ensureLoaded()
+{
+    if (!m_load) {
+        return;
+    }
+    // finishLoading clears it too, move it out first
+    auto load = std::move(m_load);
+    m_load = nullptr;
+    load();
+}
+
 uint PlaylistFilterProxyModel::getPlayingItem()
 {
     auto model = playlistModel();
-    return mapFromPlaylistModel(model->m_playingItem).row();
+    return mapFromPlaylistModel(model->m_playingItem);
 }
 
 void PlaylistFilterProxyModel::setPlayingItem(uint i)
 {
     auto model = playlistModel();
-    model->setPlayingItem(mapToPlaylistModel(i).row());
+    model->setPlayingItem(mapToPlaylistModel(i));
 }
 
 void PlaylistFilterProxyModel::playNext()
 {
     auto model = playlistModel();
     if (PlaylistSettings::randomPlayback()) {
-        auto nextIndex = model->currentShuffledIndex() + 1;
-        if (nextIndex >= static_cast<int>(model->shuffledIndexes().size())) {
-            nextIndex = 0;
+        // the items not fetched yet have to be in the shuffle queue
+        fetchAll();
+        auto id = model->m_shuffleQueue.step(1, [this](quint32 id) {
+            return isShuffleCandidate(id);
+        });
+        if (id != ShuffleQueue::NoId) {
+            model->setPlayingItem(model->rowOfId(id));
         }
-        auto shuffledIndex = model->shuffledIndexes().at(nextIndex);
-        model->setCurrentShuffledIndex(nextIndex);
-        model->setPlayingItem(shuffledIndex);
     } else {
-        auto currentIndex = mapFromPlaylistModel(model->m_playingItem).row();
+        auto currentIndex = mapFromPlaylistModel(model->m_playingItem);
         auto nextIndex = currentIndex + 1;
+        if (nextIndex >= rowCount() && canFetchMore(QModelIndex())) {
+            fetchMore(QModelIndex());
+        }
         if (nextIndex < rowCount()) {
             setPlayingItem(nextIndex);
         } else {
@@ -128,41 +884,72 @@ void PlaylistFilterProxyModel::playNext()
     }
 }
 
+int PlaylistFilterProxyModel::nextPlaylistModelRow() const
+{
+    const auto model = playlistModel();
+    if (model->canFetchMore(QModelIndex())) {
+        const bool atEnd = mapFromPlaylistModel(model->m_playingItem) + 1 >= rowCount();
+        if (PlaylistSettings::randomPlayback() || atEnd) {
+            // known once playNext() has fetched the rest
+            return -1;
+        }
+    }
+    if (PlaylistSettings::randomPlayback()) {
+        const auto id = model->m_shuffleQueue.peek(1, [this](quint32 id) {
+            return isShuffleCandidate(id);
+        });
+        return id == ShuffleQueue::NoId ? -1 : model->rowOfId(id);
+    }
+    const int nextIndex = mapFromPlaylistModel(model->m_playingItem) + 1;
+    return mapToPlaylistModel(nextIndex < rowCount() ? nextIndex : 0);
+}
+
 void PlaylistFilterProxyModel::playPrevious()
 {
     auto model = playlistModel();
     if (PlaylistSettings::randomPlayback()) {
-        auto previousIndex = model->currentShuffledIndex() - 1;
-        if (previousIndex < 0) {
-            previousIndex = model->shuffledIndexes().size() - 1;
+        fetchAll();
+        auto id = model->m_shuffleQueue.step(-1, [this](quint32 id) {
+            return isShuffleCandidate(id);
+        });
+        if (id != ShuffleQueue::NoId) {
+            model->setPlayingItem(model->rowOfId(id));
         }
-        auto shuffledIndex = model->shuffledIndexes().at(previousIndex);
-        model->setCurrentShuffledIndex(previousIndex);
-        model->setPlayingItem(shuffledIndex);
     } else {
-        auto currentIndex = mapFromPlaylistModel(model->m_playingItem).row();
+        auto currentIndex = mapFromPlaylistModel(model->m_playingItem);
         auto previousIndex = currentIndex - 1;
 
         if (previousIndex >= 0) {
-            setPlayingItem(index(previousIndex, 0).row());
+            setPlayingItem(previousIndex);
         } else {
-            setPlayingItem(index(rowCount() - 1, 0).row());
+            // wraps around to the last item of the whole playlist
+            fetchAll();
+            setPlayingItem(rowCount() - 1);
         }
     }
 }
 
 void PlaylistFilterProxyModel::saveM3uFile(const QString &path)
 {
+    // the playlist may be read lazily from the file being replaced, it's fetched before it's
+    // written; the new file replaces it with a rename, the mapping of the old one stays valid
+    fetchAll();
+
     QUrl url(path);
-    QFile m3uFile(url.toString(QUrl::PreferLocalFile));
+    QSaveFile m3uFile(url.toString(QUrl::PreferLocalFile));
     if (!m3uFile.open(QFile::WriteOnly)) {
         return;
     }
-    for (int i{0}; i < playlistProxyModel()->rowCount(); ++i) {
-        QString itemPath = playlistProxyModel()->data(playlistProxyModel()->index(i, 0), PlaylistModel::PathRole).toString();
-        m3uFile.write(itemPath.toUtf8().append("\n"));
+    // all the items in playlist order, including the ones hidden by the search
+    // extended m3u, so loading the file doesn't have to read the metadata of every item again
+    const auto model = playlistModel();
+    m3uFile.write(M3uReader::header().append('\n'));
+    for (const int row : m_order) {
+        const auto &item = model->m_playlist[row];
+        m3uFile.write(M3uReader::extinfLine(item.duration, item.mediaTitle).append('\n'));
+        m3uFile.write(item.location.toUtf8().append('\n'));
     }
-    m3uFile.close();
+    m3uFile.commit();
 }
 
 void PlaylistFilterProxyModel::highlightInFileManager(uint row)
@@ -173,32 +960,42 @@ void PlaylistFilterProxyModel::highlightInFileManager(uint row)
 
 void PlaylistFilterProxyModel::removeItem(uint row)
 {
-    auto model = playlistModel();
-    model->removeItem(mapToPlaylistModel(row).row());
+    const int sourceRow = mapToPlaylistModel(row);
+    if (sourceRow < 0) {
+        return;
+    }
+    fetchAll();
+    recordEdit(m_orderIds);
+    playlistModel()->removeItems({sourceRow});
     Q_EMIT itemsRemoved();
     Q_EMIT itemCountChanged();
 }
 
 void PlaylistFilterProxyModel::removeItems()
 {
-    QList<int> rows;
-    QModelIndexList selected = selectedRows();
-    for (auto it = selected.begin(); it != selected.end(); ++it) {
-        auto sourceRow = mapToPlaylistModel(it->row()).row();
-        rows.append(sourceRow);
+    std::vector<int> rows;
+    for (const int row : selectedRows()) {
+        rows.push_back(mapToPlaylistModel(row));
     }
-    // Need to remove items from bottom to top, in order not to mess with the indices
-    std::sort(rows.begin(), rows.end(), std::greater<>());
-    auto model = playlistModel();
-    for (auto row : std::as_const(rows)) {
-        model->removeItem(row);
+    if (rows.empty()) {
+        return;
     }
+    fetchAll();
+    recordEdit(m_orderIds);
+    playlistModel()->removeItems(std::move(rows));
     Q_EMIT itemsRemoved();
     Q_EMIT itemCountChanged();
 }
 
 void PlaylistFilterProxyModel::renameFile(uint row)
 {
+    const int sourceRow = mapToPlaylistModel(row);
+    if (sourceRow < 0) {
+        return;
+    }
+    // rows can move while the dialog is open, the item is found again by its id
+    const quint32 id = playlistModel()->m_playlist.at(sourceRow).id;
+
     QString path = data(index(row, 0), PlaylistModel::PathRole).toString();
     QUrl url(path);
     if (url.scheme().isEmpty()) {
@@ -210,12 +1007,14 @@ void PlaylistFilterProxyModel::renameFile(uint row)
 
     connect(renameDialog, &KIO::RenameFileDialog::renamingFinished, this, [=](const QList<QUrl> &urls) {
         auto model = playlistModel();
-        auto sourceRow = mapToPlaylistModel(row).row();
-        auto &item = model->m_playlist.at(sourceRow);
-        item.url = QUrl::fromUserInput(urls.first().path());
-        item.filename = urls.first().fileName();
-
-        Q_EMIT dataChanged(index(row, 0), index(row, 0));
+        const int renamedRow = model->rowOfId(id);
+        if (renamedRow < 0 || urls.isEmpty()) {
+            return;
+        }
+        model->setItemUrl(renamedRow, QUrl::fromUserInput(urls.first().path()));
+        model->m_playlist.at(renamedRow).filename = urls.first().fileName();
+        // through the model, so the store, the search index and the sort keys see the rename
+        model->markItemChanged(renamedRow, {PlaylistModel::NameRole, PlaylistModel::PathRole});
     });
 }
 
@@ -228,14 +1027,24 @@ void PlaylistFilterProxyModel::trashFile(uint row)
         url.setScheme(QStringLiteral("file"));
     }
     urls << url;
+    const int sourceRow = mapToPlaylistModel(row);
+    if (sourceRow < 0) {
+        return;
+    }
+    // the rows can change while the job runs, the item is found again by id
+    const quint32 id = itemId(sourceRow);
     auto *job = new KIO::DeleteOrTrashJob(urls, KIO::AskUserActionInterface::Trash, KIO::AskUserActionInterface::DefaultConfirmation, this);
     job->start();
 
     connect(job, &KJob::result, this, [=]() {
         if (job->error() == 0) {
             auto model = playlistModel();
-            auto sourceRow = mapToPlaylistModel(row).row();
-            model->removeItem(sourceRow);
+            const int itemRow = model->rowOfId(id);
+            if (itemRow >= 0) {
+                fetchAll();
+                recordEdit(m_orderIds);
+                model->removeItems({itemRow});
+            }
         }
     });
 }
@@ -243,31 +1052,37 @@ void PlaylistFilterProxyModel::trashFile(uint row)
 void PlaylistFilterProxyModel::trashFiles()
 {
     QList<QUrl> urls;
-    QList<int> rows;
+    // the rows can change while the job runs, the items are found again by id
+    QSet<quint32> ids;
 
-    QModelIndexList selected = selectedRows();
-    for (auto it = selected.cbegin(); it != selected.cend(); ++it) {
-        QString path = data(index(it->row(), 0), PlaylistModel::PathRole).toString();
+    for (const int row : selectedRows()) {
+        QString path = data(index(row, 0), PlaylistModel::PathRole).toString();
         QUrl url(path);
         if (url.scheme().isEmpty()) {
             url.setScheme(QStringLiteral("file"));
         }
-        auto sourceRow = mapToPlaylistModel(it->row()).row();
-        rows.append(sourceRow);
+        ids.insert(itemId(mapToPlaylistModel(row)));
         urls << url;
     }
-    // Need to remove items from bottom to top, in order not to mess with the indices
-    std::sort(rows.begin(), rows.end(), std::greater<>());
 
     auto *job = new KIO::DeleteOrTrashJob(urls, KIO::AskUserActionInterface::Trash, KIO::AskUserActionInterface::DefaultConfirmation, this);
     job->start();
 
     connect(job, &KJob::result, this, [=]() {
         if (job->error() == 0) {
+            fetchAll();
             auto model = playlistModel();
-            for (auto row : std::as_const(rows)) {
-                model->removeItem(row);
+            std::vector<int> rows;
+            for (int row = 0; row < static_cast<int>(model->m_playlist.size()); ++row) {
+                if (ids.contains(model->m_playlist[row].id)) {
+                    rows.push_back(row);
+                }
+            }
+            if (rows.empty()) {
+                return;
             }
+            recordEdit(m_orderIds);
+            model->removeItems(std::move(rows));
         }
     });
 }
@@ -275,31 +1090,38 @@ void PlaylistFilterProxyModel::trashFiles()
 void PlaylistFilterProxyModel::copyFileName(uint row)
 {
     auto model = playlistModel();
-    auto sourceRow = mapToPlaylistModel(row).row();
-    auto item = model->m_playlist.at(sourceRow);
+    auto sourceRow = mapToPlaylistModel(row);
+    const auto &item = model->m_playlist.at(sourceRow);
     QGuiApplication::clipboard()->setText(item.filename);
 }
 
 void PlaylistFilterProxyModel::copyFilePath(uint row)
 {
     auto model = playlistModel();
-    auto sourceRow = mapToPlaylistModel(row).row();
-    auto item = model->m_playlist.at(sourceRow);
-    QGuiApplication::clipboard()->setText(item.url.toString());
+    auto sourceRow = mapToPlaylistModel(row);
+    const auto &item = model->m_playlist.at(sourceRow);
+    QGuiApplication::clipboard()->setText(item.location);
 }
 
 QString PlaylistFilterProxyModel::getFilePath(uint row)
 {
     auto model = playlistModel();
-    auto sourceRow = mapToPlaylistModel(row).row();
-    auto item = model->m_playlist.at(sourceRow);
-    return item.url.toString();
+    auto sourceRow = mapToPlaylistModel(row);
+    const auto &item = model->m_playlist.at(sourceRow);
+    return item.location;
 }
 
 bool PlaylistFilterProxyModel::isLastItem(uint row)
 {
     if (PlaylistSettings::randomPlayback()) {
-        return static_cast<int>(row) == playlistModel()->shuffledIndexes().back();
+        auto model = playlistModel();
+        auto sourceRow = mapToPlaylistModel(row);
+        if (sourceRow < 0 || model->m_playlist[sourceRow].id != model->m_shuffleQueue.current()) {
+            return false;
+        }
+        return !model->m_shuffleQueue.hasNext([this](quint32 id) {
+            return isShuffleCandidate(id);
+        });
     }
     return static_cast<int>(row) == rowCount() - 1;
 }
@@ -315,118 +1137,140 @@ void PlaylistFilterProxyModel::moveItems(uint row, uint destinationRow)
         return;
     }
 
-    QModelIndexList selection = selectedRows();
+    // the undo history needs every item, they are appended after the rows being moved
+    fetchAll();
 
-    // Check whether the drag move is top-down or bottom-up. Qt::beginMoveRows always put the items on top of
-    // the destination row, but this is not what we always want so we need to take it into account
-    bool topDownDrag = destinationRow > row;
-
-    // Split the selection ranges into Top and Bottom parts, with respect to the destination row.
-    // This makes managing the move operations easier for the PlaylistProxyModel layout.
-    QModelIndexList topSelection;
-    QModelIndexList bottomSelection;
-    splitItemSelection(selection, destinationRow, topDownDrag, topSelection, bottomSelection);
+    const auto selection = selectedRows();
+    if (selection.empty()) {
+        return;
+    }
 
-    /* Playlist: A, B, C, D, E
+    /* The selected items end up together, in their current order, next to the destination row:
+     * below it when dragging down, above it when dragging up.
+     *
+     * Playlist: A, B, C, D, E
      * Selected: A, C, E
      * Dragged item: C
      *
      * Drag Over:
-     *     B -> topDownDrag = true  -> topSelection = A,   bottomSelection = C, E
-     *     D -> topDownDrag = false -> topSelection = A, C bottomSelection = E
-     *
-     * A or E can be a chunk of selection, it doesn't matter
+     *     B -> A, C, E, B, D
+     *     D -> B, D, A, C, E
      */
+    const bool topDownDrag = destinationRow > row;
+    // the unselected row the selected items go in front of, rowCount() for the end
+    int target = std::min<int>(topDownDrag ? destinationRow + 1 : destinationRow, rowCount());
+    while (target < rowCount() && isRowSelected(m_rows[target])) {
+        ++target;
+    }
+
+    // the new playlist order, in one pass: the moved items go right after the closest
+    // unselected visible item above target, hidden items keep their place
+    std::vector<char> moved(m_order.size(), 0);
+    std::vector<int> block;
+    block.reserve(selection.size());
+    for (const int viewRow : selection) {
+        moved[m_rows[viewRow]] = 1;
+        block.push_back(m_rows[viewRow]);
+    }
+    int insertAfter{-1};
+    for (int viewRow = target - 1; viewRow >= 0; --viewRow) {
+        if (!moved[m_rows[viewRow]]) {
+            insertAfter = m_rows[viewRow];
+            break;
+        }
+    }
+    const int insertBefore = insertAfter < 0 && target < rowCount() ? m_rows[target] : -1;
+    if (insertAfter < 0 && insertBefore < 0) {
+        // everything visible is selected
+        return;
+    }
+
+    std::vector<int> order;
+    order.reserve(m_order.size());
+    for (const int modelRow : m_order) {
+        if (moved[modelRow]) {
+            continue;
+        }
+        if (modelRow == insertBefore) {
+            order.insert(order.end(), block.cbegin(), block.cend());
+        }
+        order.push_back(modelRow);
+        if (modelRow == insertAfter) {
+            order.insert(order.end(), block.cbegin(), block.cend());
+        }
+    }
+    if (order == m_order) {
+        return;
+    }
+
+    recordEdit(m_orderIds);
+    // the moved items are taken out and put back as a block
+    std::vector<qsizetype> movedPositions;
+    std::vector<quint32> blockIds;
+    movedPositions.reserve(block.size());
+    blockIds.reserve(block.size());
+    for (const int modelRow : block) {
+        movedPositions.push_back(m_positions[modelRow]);
+        blockIds.push_back(itemId(modelRow));
+    }
+    const auto blockPosition = std::distance(order.cbegin(), std::find(order.cbegin(), order.cend(), block.front()));
+    m_orderIds = m_orderIds.removed(std::move(movedPositions)).inserted(blockPosition, PersistentIdList::fromIds(blockIds));
+
+    // contiguous ranges of selected view rows
+    std::vector<std::pair<int, int>> ranges;
+    for (const int viewRow : selection) {
+        if (!ranges.empty() && ranges.back().second == viewRow - 1) {
+            ranges.back().second = viewRow;
+        } else {
+            ranges.emplace_back(viewRow, viewRow);
+        }
+    }
 
-    std::vector<uint> updatedSelectedRows;
-    int rowOffset = 0;
-    for (const auto &iTopSelection : std::as_const(topSelection)) {
-        // These indices are located above the destination. Each move will reduce index of the
-        // following rows by 1 until the destination row since they are sorted in ascending order.
-        // We take this into account by using rowOffset
-        int first = iTopSelection.row();
-        int destination = topDownDrag ? destinationRow : destinationRow - 1;
-
-        /* Playlist: A, B, C, D, E
-         * Selected: A, B, D
-         * Selected indices: 0, 1, 3
-         * Dragged on: E (topDownDrag true in this case)
-         * Destination index: 4 (not 3 since topDownDrag is true)
-         *  Order of operations will be as follows:
-         *
-         *  (1)     (2)     (3)     (4)
-         *  0. A    0. B    0. C    0. C
-         *  1. B    1. C    1. D    1. E
-         *  2. C -> 2. D -> 2. E -> 2. A
-         *  3. D    3. E    3. A    3. B
-         *  4. E    4. A    4. B    4. D
-         *
-         * Index movement: (1) 0->4, (2) 0->4, (3) 1->4
-         * Indices 0, 1, 3 are decreased by 1 after each item move operation
-         * so, do (index - offset) for each item to move them properly
-         *
-         * The final selection is: 2, 3, 4
-         * That is (destinationIndex - itemCount + N) for Nth item
-         */
-
-        // Qt expects the movement to be on top of the destination row, which is not the case for
-        // topSelection rows for THIS logic, since we set it by considering the Proxy's layout vector.
-        // Therefore, we need to increase the index of the destination by 1 here. See:
-        // https://doc.qt.io/qt-6/qabstractitemmodel.html#beginMoveRows
-        if (beginMoveRows(QModelIndex(), first - rowOffset, first - rowOffset, QModelIndex(), destination + 1)) {
-            int sourceFirst = mapToSource(index(first, 0)).row();
-            int sourceDestination = mapToSource(index(destination, 0)).row();
-            playlistProxyModel()->moveRows(QModelIndex(), sourceFirst - rowOffset, 1, QModelIndex(), sourceDestination);
-            endMoveRows();
-        }
-        updatedSelectedRows.push_back(destination - topSelection.size() + rowOffset + 1);
-        rowOffset++;
-    }
-    rowOffset = 0;
-    for (const auto &iBottomSelection : std::as_const(bottomSelection)) {
-        // Indices here will be located below the destination. Moving the items to the top will not change
-        // their indices, but it will change the target index. We take this into account in the same way.
-        int first = iBottomSelection.row();
-        int destination = topDownDrag ? destinationRow + 1 : destinationRow;
-
-        /* Playlist: A, B, C, D, E
-         * Selected: B, D, E
-         * Selected indices: 1, 3, 4
-         * Dragged on: A (topDownDrag false in this case)
-         * Destination index: 0 (not 1 since topDownDrag is false)
-         *  Order of operations will be as follows:
-         *
-         *  (1)     (2)     (3)     (4)
-         *  0. A    0. B    0. B    0. B
-         *  1. B    1. A    1. D    1. D
-         *  2. C -> 2. C -> 2. A -> 2. E
-         *  3. D    3. D    3. C    3. A
-         *  4. E    4. E    4. E    4. C
-         *
-         * Index movements (1) 1->0, (2) 3->1, (3) 4->2
-         * Indices 1, 3, 4 are the same but destination is increased by 1 after each item move operation
-         * so, do (destination + offset) for each item
-         *
-         * The final selection is: 0, 1, 2
-         * That is (destinationIndex + offset) for each item
-         */
-
-        if (beginMoveRows(QModelIndex(), first, first, QModelIndex(), destination + rowOffset)) {
-            int sourceFirst = mapToSource(index(first, 0)).row();
-            int sourceDestination = mapToSource(index(destination, 0)).row();
-            playlistProxyModel()->moveRows(QModelIndex(), sourceFirst, 1, QModelIndex(), sourceDestination + rowOffset);
-            endMoveRows();
-        }
-        updatedSelectedRows.push_back(destination + rowOffset);
-        rowOffset++;
-    }
-
-    invalidateRowsFilter();
-    QItemSelection updatedSelection;
-    for (const auto &row : std::as_const(updatedSelectedRows)) {
-        updatedSelection.select(index(row, 0), index(row, 0));
-    }
-    m_selectionModel.select(updatedSelection, QItemSelectionModel::SelectionFlag::Select | QItemSelectionModel::SelectionFlag::Clear);
+    if (ranges.size() > MaxMoveRanges) {
+        m_order = std::move(order);
+        relayout();
+    } else {
+        auto updateViewRows = [this](int first, int last) {
+            for (int i = first; i <= last; ++i) {
+                m_viewRows[m_rows[i]] = i;
+            }
+        };
+        // the ranges above target are moved down in front of it, the closest one first,
+        // then the ones below are moved up behind them, so the selection is assembled in order
+        const auto firstBelow = std::lower_bound(ranges.cbegin(), ranges.cend(), target, [](const auto &range, int viewRow) {
+            return range.first < viewRow;
+        });
+        int blockFirst = target;
+        for (auto it = std::make_reverse_iterator(firstBelow); it != ranges.crend(); ++it) {
+            const auto [first, last] = *it;
+            if (last + 1 != blockFirst) {
+                beginMoveRows(QModelIndex(), first, last, QModelIndex(), blockFirst);
+                std::rotate(m_rows.begin() + first, m_rows.begin() + last + 1, m_rows.begin() + blockFirst);
+                updateViewRows(first, blockFirst - 1);
+                endMoveRows();
+            }
+            blockFirst -= last - first + 1;
+        }
+        int blockEnd = target;
+        for (auto it = firstBelow; it != ranges.cend(); ++it) {
+            const auto [first, last] = *it;
+            if (first != blockEnd) {
+                beginMoveRows(QModelIndex(), first, last, QModelIndex(), blockEnd);
+                std::rotate(m_rows.begin() + blockEnd, m_rows.begin() + first, m_rows.begin() + last + 1);
+                updateViewRows(blockEnd, last);
+                endMoveRows();
+            }
+            blockEnd += last - first + 1;
+        }
+
+        m_order = std::move(order);
+        for (std::size_t i = 0; i < m_order.size(); ++i) {
+            m_positions[m_order[i]] = static_cast<int>(i);
+        }
+    }
+
+    m_sorted = false;
+    Q_EMIT orderChanged();
 
     Q_EMIT itemsMoved();
 }
@@ -437,46 +1281,66 @@ void PlaylistFilterProxyModel::selectItem(uint row, Selection selectionMode)
         return;
     }
 
+    const int previousCount = m_selectionCount;
     switch (selectionMode) {
     case Selection::Clear:
-        m_selectionModel.clearSelection();
+        clearSelection();
         break;
     case Selection::ClearSingle:
-        m_selectionModel.select(index(row, 0), QItemSelectionModel::SelectionFlag::Select | QItemSelectionModel::SelectionFlag::Clear);
-        m_selectionModel.setCurrentIndex(index(row, 0), QItemSelectionModel::SelectionFlag::NoUpdate);
+        clearSelection();
+        setRowSelected(m_rows[row], true);
+        m_anchorId = itemId(m_rows[row]);
         break;
     case Selection::Single:
-        if (m_selectionModel.isSelected(index(row, 0))) {
+        if (isRowSelected(m_rows[row])) {
             return;
         }
-        m_selectionModel.select(index(row, 0), QItemSelectionModel::SelectionFlag::Select | QItemSelectionModel::SelectionFlag::Clear);
-        m_selectionModel.setCurrentIndex(index(row, 0), QItemSelectionModel::SelectionFlag::NoUpdate);
+        clearSelection();
+        setRowSelected(m_rows[row], true);
+        m_anchorId = itemId(m_rows[row]);
         break;
     case Selection::Toggle:
-        m_selectionModel.select(index(row, 0), QItemSelectionModel::SelectionFlag::Toggle);
-        m_selectionModel.setCurrentIndex(index(row, 0), QItemSelectionModel::SelectionFlag::NoUpdate);
+        setRowSelected(m_rows[row], !isRowSelected(m_rows[row]));
+        m_anchorId = itemId(m_rows[row]);
         break;
     case Selection::Range: {
-        QItemSelection range;
-        range.select(m_selectionModel.currentIndex(), index(row, 0));
-        m_selectionModel.select(range, QItemSelectionModel::SelectionFlag::Select | QItemSelectionModel::SelectionFlag::Clear);
+        // from the row of the last clicked item, or just this row when that one is gone or hidden
+        const int anchorModelRow = playlistModel()->rowOfId(m_anchorId);
+        int anchor = mapFromPlaylistModel(anchorModelRow);
+        if (anchor < 0) {
+            anchor = row;
+        }
+        clearSelection();
+        const int first = std::min<int>(anchor, row);
+        const int last = std::max<int>(anchor, row);
+        for (int i = first; i <= last; ++i) {
+            setRowSelected(m_rows[i], true);
+        }
+        notifySelectionChanged(first, last);
         break;
     }
     case Selection::RangeStart:
-        m_selectionModel.setCurrentIndex(index(row, 0), QItemSelectionModel::SelectionFlag::NoUpdate);
+        m_anchorId = itemId(m_rows[row]);
         break;
-    case Selection::Invert: {
-        QItemSelection selectAll;
-        selectAll.select(index(0, 0), index(rowCount() - 1, 0));
-        m_selectionModel.select(selectAll, QItemSelectionModel::SelectionFlag::Toggle);
+    case Selection::Invert:
+        for (const int modelRow : m_rows) {
+            setRowSelected(modelRow, !isRowSelected(modelRow));
+        }
+        notifySelectionChanged(0, rowCount() - 1);
         break;
-    }
-    case Selection::All: {
-        QItemSelection selectAll;
-        selectAll.select(index(0, 0), index(rowCount() - 1, 0));
-        m_selectionModel.select(selectAll, QItemSelectionModel::SelectionFlag::Select);
+    case Selection::All:
+        for (const int modelRow : m_rows) {
+            setRowSelected(modelRow, true);
+        }
+        notifySelectionChanged(0, rowCount() - 1);
         break;
     }
+
+    if (selectionMode == Selection::ClearSingle || selectionMode == Selection::Single || selectionMode == Selection::Toggle) {
+        notifySelectionChanged(row, row);
+    }
+    if (m_selectionCount != previousCount) {
+        Q_EMIT selectionCountChanged();
     }
 }
 
@@ -489,6 +1353,7 @@ void PlaylistFilterProxyModel::refreshData()
 
 void PlaylistFilterProxyModel::addFilesAndFolders(QList<QUrl> urls, PlaylistModel::Behavior behavior, uint insertOffset)
 {
+    ensureLoaded();
     auto getCanonicalOrAbsolutePath = [](const QFileInfo &fi) -> QString {
         const QString canonical = fi.canonicalFilePath();
         if (canonical.isEmpty()) {
@@ -567,13 +1432,18 @@ void PlaylistFilterProxyModel::addFilesAndFolders(QList<QUrl> urls, PlaylistMode
     int localOffset = 0;
     for (const auto &file : std::as_const(files)) {
         if (behavior == PlaylistModel::Insert) {
-            // Initialize proxy model to insert the items at the dropped index. After each insertion, the index should increase
-            playlistProxyModel()->setInsertOffset(insertOffset + localOffset++);
-            // When the addItem is called from the playlistModel, rowsAboutToBeInserted signal will reach playlistProxyModel
-            // for this item. If offset it set, instead of appending, the proxy will insert it to the given index
+            // Insert the items at the dropped index. After each insertion, the index should increase.
+            // The PlaylistModel appends the item, onPlaylistRowsInserted puts it at this place in the order
+            const auto row = static_cast<int>(insertOffset) + localOffset++;
+            m_insertPosition = row < rowCount() ? m_positions[m_rows[row]] : static_cast<int>(m_order.size());
         }
         // PlaylistModel can just append the items
         playlistModel()->addItem(QUrl::fromLocalFile(file), PlaylistModel::Append);
+        // in case the file was not added
+        m_insertPosition = -1;
+    }
+    for (const auto &dir : std::as_const(dirs)) {
+        watchFolder(dir.absoluteFilePath(), true);
     }
     Q_EMIT itemsInserted();
     Q_EMIT itemCountChanged();
@@ -585,21 +1455,84 @@ bool PlaylistFilterProxyModel::isDirectory(const QUrl &url)
     return fileInfo.exists() && fileInfo.isDir();
 }
 
-void PlaylistFilterProxyModel::sortItems(PlaylistSortProxyModel::Sort sortMode)
+void PlaylistFilterProxyModel::sortItems(Sort sortMode)
 {
-    playlistSortProxyModel()->sortItems(sortMode);
+    fetchAll();
+
+    auto sortBy = [this](SortKey key, Qt::SortOrder order) {
+        if (m_sortKey != key) {
+            m_collationKeys.clear();
+        }
+        if (key == SortKey::LastModified || key == SortKey::FileSize) {
+            playlistModel()->readFileInfo();
+        }
+        m_sortKey = key;
+        m_sortOrder = order;
+        m_sorted = true;
+        const auto ids = m_orderIds;
+        if (sortOrder()) {
+            recordEdit(ids);
+        }
+    };
+
+    switch (sortMode) {
+    case Sort::NameAscending:
+        sortBy(SortKey::Name, Qt::AscendingOrder);
+        break;
+    case Sort::NameDescending:
+        sortBy(SortKey::Name, Qt::DescendingOrder);
+        break;
+    case Sort::DurationAscending:
+        sortBy(SortKey::Duration, Qt::AscendingOrder);
+        break;
+    case Sort::DurationDescending:
+        sortBy(SortKey::Duration, Qt::DescendingOrder);
+        break;
+    case Sort::LastModifiedAscending:
+        sortBy(SortKey::LastModified, Qt::AscendingOrder);
+        break;
+    case Sort::LastModifiedDescending:
+        sortBy(SortKey::LastModified, Qt::DescendingOrder);
+        break;
+    case Sort::FileSizeAscending:
+        sortBy(SortKey::FileSize, Qt::AscendingOrder);
+        break;
+    case Sort::FileSizeDescending:
+        sortBy(SortKey::FileSize, Qt::DescendingOrder);
+        break;
+    case Sort::FolderAscending:
+        sortBy(SortKey::Folder, Qt::AscendingOrder);
+        break;
+    case Sort::FolderDescending:
+        sortBy(SortKey::Folder, Qt::DescendingOrder);
+        break;
+    case Sort::TrackNumberAscending:
+        sortBy(SortKey::TrackNumber, Qt::AscendingOrder);
+        break;
+    case Sort::TrackNumberDescending:
+        sortBy(SortKey::TrackNumber, Qt::DescendingOrder);
+        break;
+    }
     Q_EMIT itemsSorted();
 }
 
 void PlaylistFilterProxyModel::clear()
 {
+    ensureLoaded();
+    fetchAll();
+    if (!m_order.empty()) {
+        recordEdit(m_orderIds);
+    }
+    m_clearing = true;
     playlistModel()->clear();
+    m_clearing = false;
     Q_EMIT itemsRemoved();
     Q_EMIT itemCountChanged();
 }
 
 void PlaylistFilterProxyModel::addItem(const QString &path, PlaylistModel::Behavior behavior)
 {
+    ensureLoaded();
     auto url = QUrl::fromUserInput(path);
     playlistModel()->addItem(url, behavior);
     Q_EMIT itemsInserted();
@@ -608,6 +1541,7 @@ void PlaylistFilterProxyModel::addItem(const QString &path, PlaylistModel::Behav
 
 void PlaylistFilterProxyModel::addItem(const QUrl &url, PlaylistModel::Behavior behavior)
 {
+    ensureLoaded();
     playlistModel()->addItem(url, behavior);
     Q_EMIT itemsInserted();
     Q_EMIT itemCountChanged();
@@ -615,6 +1549,7 @@ void PlaylistFilterProxyModel::addItem(const QUrl &url, PlaylistModel::Behavior
 
 void PlaylistFilterProxyModel::addItems(const QList<QUrl> &urls, PlaylistModel::Behavior behavior)
 {
+    ensureLoaded();
     for (const auto &url : urls) {
         playlistModel()->addItem(url, behavior);
     }
@@ -622,127 +1557,272 @@ void PlaylistFilterProxyModel::addItems(const QList<QUrl> &urls, PlaylistModel::
     Q_EMIT itemCountChanged();
 }
 
-void PlaylistFilterProxyModel::onSelectionChanged(const QItemSelection &selected, const QItemSelection &deselected)
+quint32 PlaylistFilterProxyModel::itemId(int row) const
 {
-    for (const auto &index : selected.indexes()) {
-        Q_EMIT dataChanged(index, index);
+    return playlistModel()->m_playlist[row].id;
+}
+
+bool PlaylistFilterProxyModel::isRowSelected(int row) const
+{
+    const quint32 id = itemId(row);
+    return id < m_selected.size() && m_selected[id];
+}
+
+void PlaylistFilterProxyModel::setRowSelected(int row, bool selected)
+{
+    const quint32 id = itemId(row);
+    if (id >= m_selected.size()) {
+        if (!selected) {
+            return;
+        }
+        m_selected.resize(id + 1, false);
     }
-    for (const auto &index : deselected.indexes()) {
-        Q_EMIT dataChanged(index, index);
+    if (m_selected[id] == selected) {
+        return;
+    }
+    m_selected[id] = selected;
+    if (m_viewRows[row] >= 0) {
+        m_selectionCount += selected ? 1 : -1;
+    }
+}
+
+void PlaylistFilterProxyModel::clearSelection()
+{
+    // the rows that change are not tracked, the visible ones are all notified
+    if (m_selectionCount > 0) {
+        notifySelectionChanged(0, rowCount() - 1);
     }
-    Q_EMIT selectionCountChanged();
+    m_selected.assign(m_selected.size(), false);
+    m_selectionCount = 0;
 }
 
-void PlaylistFilterProxyModel::shufflePlaylistModel()
+void PlaylistFilterProxyModel::notifySelectionChanged(int first, int last)
 {
-    if (m_scheduledReshuffle) {
+    if (first > last) {
         return;
     }
-    m_scheduledReshuffle = true;
+    Q_EMIT dataChanged(index(first, 0), index(last, 0), {PlaylistModel::IsSelectedRole});
+}
 
-    // rowsInserted/rowsRemoved signals will be called for each filtered item
-    // this queues the shuffle event to be executed once at the end of the event loop
-    QTimer::singleShot(0, this, [this]() {
-        // Do the normal shuffle if filter is removed
-        if (searchText().isEmpty()) {
-            playlistModel()->shuffleIndexes();
-            m_scheduledReshuffle = false;
-            return;
-        }
+bool PlaylistFilterProxyModel::isShuffleCandidate(quint32 id) const
+{
+    // items hidden by the search are skipped instead of reshuffling when the search changes
+    int row = playlistModel()->rowOfId(id);
+    return row >= 0 && mapFromPlaylistModel(row) >= 0;
+}
 
-        std::vector<int> indices;
-        for (int i = 0; i < rowCount(); ++i) {
-            indices.push_back(mapToPlaylistModel(index(i, 0).row()).row());
-        }
-        playlistModel()->shuffleIndexes(indices);
-        m_scheduledReshuffle = false;
-    });
+void PlaylistFilterProxyModel::watchFolder(const QString &folder, bool recursive)
+{
+    if (!PlaylistSettings::watchFolders()) {
+        return;
+    }
+    if (!m_folderWatcher) {
+        m_folderWatcher = std::make_unique<PlaylistFolderWatcher>(this);
+    }
+    m_folderWatcher->watch(folder, recursive);
 }
 
-PlaylistProxyModel *PlaylistFilterProxyModel::playlistProxyModel() const
+bool PlaylistFilterProxyModel::canUndo() const
 {
-    return m_playlistProxyModel.get();
+    return !m_undoStack.empty();
 }
 
-PlaylistSortProxyModel *PlaylistFilterProxyModel::playlistSortProxyModel() const
+bool PlaylistFilterProxyModel::canRedo() const
 {
-    return m_playlistSortProxyModel.get();
+    return !m_redoStack.empty();
 }
 
-PlaylistModel *PlaylistFilterProxyModel::playlistModel() const
+void PlaylistFilterProxyModel::undo()
 {
-    return m_playlistModel.get();
+    if (m_undoStack.empty()) {
+        return;
+    }
+    auto ids = std::move(m_undoStack.back());
+    m_undoStack.pop_back();
+    m_redoStack.push_back(m_orderIds);
+    m_additionStep = false;
+    restoreIds(ids);
+    Q_EMIT historyChanged();
 }
 
-QModelIndex PlaylistFilterProxyModel::mapFromPlaylistModel(uint row) const
+void PlaylistFilterProxyModel::redo()
 {
-    QModelIndex playlistIndex = playlistModel()->index(row, 0);
-    QModelIndex sortProxyIndex = playlistSortProxyModel()->mapFromSource(playlistIndex);
-    QModelIndex playlistProxyIndex = playlistProxyModel()->mapFromSource(sortProxyIndex);
-    QModelIndex filterProxyIndex = mapFromSource(playlistProxyIndex);
-    return filterProxyIndex;
+    if (m_redoStack.empty()) {
+        return;
+    }
+    auto ids = std::move(m_redoStack.back());
+    m_redoStack.pop_back();
+    m_undoStack.push_back(m_orderIds);
+    m_additionStep = false;
+    restoreIds(ids);
+    Q_EMIT historyChanged();
 }
 
-QModelIndex PlaylistFilterProxyModel::mapToPlaylistModel(uint row) const
+void PlaylistFilterProxyModel::recordEdit(const PersistentIdList &ids)
 {
-    QModelIndex filterProxyIndex = index(row, 0);
-    QModelIndex playlistProxyIndex = mapToSource(filterProxyIndex);
-    QModelIndex sortProxyIndex = playlistProxyModel()->mapToSource(playlistProxyIndex);
-    QModelIndex playlistIndex = playlistSortProxyModel()->mapToSource(sortProxyIndex);
-    return playlistIndex;
+    m_undoStack.push_back(ids);
+    m_additionStep = false;
+    const bool dropped = m_undoStack.size() > MaxUndoSteps || !m_redoStack.empty();
+    if (m_undoStack.size() > MaxUndoSteps) {
+        m_undoStack.erase(m_undoStack.begin());
+    }
+    m_redoStack.clear();
+    if (dropped) {
+        pruneRemovedItems();
+    }
+    Q_EMIT historyChanged();
 }
 
-void PlaylistFilterProxyModel::splitItemSelection(const QModelIndexList &original,
-                                                  int splitRow,
-                                                  bool isTopDown,
-                                                  QModelIndexList &lowerPart,
-                                                  QModelIndexList &upperPart)
+void PlaylistFilterProxyModel::clearHistory()
 {
-    for (const QModelIndex &index : original) {
-        if (!index.isValid()) {
+    if (m_undoStack.empty() && m_redoStack.empty()) {
+        return;
+    }
+    m_undoStack.clear();
+    m_redoStack.clear();
+    m_removedItems.clear();
+    m_pruneThreshold = 0;
+    m_additionStep = false;
+    Q_EMIT historyChanged();
+}
+
+void PlaylistFilterProxyModel::restoreIds(const PersistentIdList &ids)
+{
+    // the items fetched here from the m3u file are in neither list, they are kept
+    const auto currentIds = m_orderIds.toIds();
+    const QSet<quint32> currentSet(currentIds.cbegin(), currentIds.cend());
+    fetchAll();
+
+    auto model = playlistModel();
+    const auto targetIds = ids.toIds();
+    const QSet<quint32> targetSet(targetIds.cbegin(), targetIds.cend());
+
+    // the items the snapshot doesn't have go in one bulk removal, into m_removedItems
+    std::vector<int> removedRows;
+    for (int row = 0; row < static_cast<int>(model->m_playlist.size()); ++row) {
+        const quint32 id = model->m_playlist[row].id;
+        if (!targetSet.contains(id) && currentSet.contains(id)) {
+            removedRows.push_back(row);
+        }
+    }
+    const bool removed = !removedRows.empty();
+    model->removeItems(std::move(removedRows));
+
+    // the ones it has that are gone come back in one insertion, at the end for now
+    std::vector<PlaylistItem> restoredItems;
+    for (const quint32 id : targetIds) {
+        if (model->rowOfId(id) >= 0) {
             continue;
         }
-        if (index.row() < splitRow) {
-            lowerPart.append(index);
-        } else if (index.row() > splitRow) {
-            upperPart.append(index);
+        auto it = m_removedItems.find(id);
+        if (it != m_removedItems.end()) {
+            restoredItems.push_back(std::move(it.value()));
+            m_removedItems.erase(it);
+        }
+    }
+    const bool inserted = !restoredItems.empty();
+    m_sorted = false;
+    model->restoreItems(std::move(restoredItems));
+
+    // then everything goes in its place with one layout change, the kept items after the snapshot's
+    std::vector<int> order;
+    order.reserve(m_order.size());
+    for (const quint32 id : targetIds) {
+        const int row = model->rowOfId(id);
+        if (row >= 0) {
+            order.push_back(row);
+        }
+    }
+    const bool exact = static_cast<qsizetype>(order.size()) == ids.size();
+    for (const int row : m_order) {
+        if (!targetSet.contains(itemId(row))) {
+            order.push_back(row);
+        }
+    }
+    if (order != m_order) {
+        m_order = std::move(order);
+        relayout();
+        Q_EMIT orderChanged();
+    }
+    // shares the nodes of the snapshot, unless an item could not be restored or was kept
+    m_orderIds = exact && static_cast<qsizetype>(m_order.size()) == ids.size() ? ids : currentOrderIds();
+
+    if (removed) {
+        Q_EMIT itemsRemoved();
+    }
+    if (inserted) {
+        Q_EMIT itemsInserted();
+    }
+    Q_EMIT itemCountChanged();
+}
+
+void PlaylistFilterProxyModel::pruneRemovedItems()
+{
+    if (m_removedItems.size() <= std::max(m_pruneThreshold, MinPruneThreshold)) {
+        return;
+    }
+
+    auto lists = m_undoStack;
+    lists.insert(lists.end(), m_redoStack.cbegin(), m_redoStack.cend());
+    const auto referenced = PersistentIdList::collectIds(lists);
+    for (auto it = m_removedItems.begin(); it != m_removedItems.end();) {
+        if (referenced.contains(it.key())) {
+            ++it;
         } else {
-            if (isTopDown) {
-                lowerPart.append(index);
-            } else {
-                upperPart.append(index);
-            }
+            it = m_removedItems.erase(it);
         }
     }
+    // the items that are still referenced are not looked at again until there are twice as many
+    m_pruneThreshold = m_removedItems.size() * 2;
 }
 
-QModelIndexList PlaylistFilterProxyModel::selectedRows() const
+PersistentIdList PlaylistFilterProxyModel::currentOrderIds() const
 {
-    // QItemSelectionModel::selectedRows() does not guarantee a sorted array, which we mostly need
-    QModelIndexList selection = m_selectionModel.selectedRows();
-    std::sort(selection.begin(), selection.end(), [](const QModelIndex &a, const QModelIndex &b) {
-        return a.row() < b.row();
-    });
-    return selection;
+    std::vector<quint32> ids;
+    ids.reserve(m_order.size());
+    for (const int row : m_order) {
+        ids.push_back(itemId(row));
+    }
+    return PersistentIdList::fromIds(ids);
 }
 
-void PlaylistFilterProxyModel::saveInternalPlaylist(const QString &path, const QString &playlistName)
+PlaylistModel *PlaylistFilterProxyModel::playlistModel() const
 {
-    // path must be the config folder
-    QUrl url(path);
+    return m_playlistModel.get();
+}
 
-    QFile configPath(url.toString(QUrl::PreferLocalFile));
-    QFileInfo fileInfo(configPath);
+int PlaylistFilterProxyModel::mapFromPlaylistModel(int row) const
+{
+    if (row < 0 || row >= static_cast<int>(m_viewRows.size())) {
+        return -1;
+    }
+    return m_viewRows[row];
+}
 
-    // Check if the directory exists and create it if it does not
-    QDir dir = fileInfo.dir();
-    if (!dir.exists()) {
-        if (!dir.mkpath(dir.absolutePath())) {
-            qWarning() << "Failed to create playlist directory:" << dir.path();
-            return;
+int PlaylistFilterProxyModel::mapToPlaylistModel(int row) const
+{
+    if (row < 0 || row >= rowCount()) {
+        return -1;
+    }
+    return modelRowAt(row);
+}
+
+int PlaylistFilterProxyModel::modelRowAt(int row) const
+{
+    return m_rows[row < m_gapFirst ? row : row + m_gapEnd - m_gapFirst];
+}
+
+std::vector<int> PlaylistFilterProxyModel::selectedRows() const
+{
+    // in view order, the callers rely on it
+    std::vector<int> rows;
+    rows.reserve(m_selectionCount);
+    for (int row = 0; row < rowCount() && static_cast<int>(rows.size()) < m_selectionCount; ++row) {
+        if (isRowSelected(m_rows[row])) {
+            rows.push_back(row);
         }
     }
-    saveM3uFile(url.toString(QUrl::PreferLocalFile) + playlistName + u".m3u");
+    return rows;
 }
 
 #include "moc_playlistfilterproxymodel.cpp"
@@ -6,33 +6,54 @@
 #ifndef PLAYLISTFILTERPROXYMODEL_H
 #define PLAYLISTFILTERPROXYMODEL_H
 
-#include <QSortFilterProxyModel>
-#include <QItemSelectionModel>
+#include <QAbstractListModel>
+#include <QCollator>
+#include <QElapsedTimer>
+#include <QTimer>
+#include "persistentidlist.h"
 #include "playlistmodel.h"
-#include "playlistproxymodel.h"
-#include "playlistsortproxymodel.h"
+#include "playlistsearchindex.h"
 #include "playlisttypes.h"
+#include "taskscheduler.h"
+
+#include <functional>
 
 // Forward declarations
+class PlaylistFolderWatcher;
 class PlaylistMultiProxiesModel;
 class PlaylistModel;
-class PlaylistSortProxyModel;
-class PlaylistProxyModel;
+class PlaylistStore;
 
-class PlaylistFilterProxyModel : public QSortFilterProxyModel
+/**
+ * The view of a PlaylistModel shown in QML.
+ *
+ * The order of the items (moved by the user, sorted or inserted at a position)
+ * is a single permutation of the PlaylistModel rows, the search hides rows of that
+ * permutation. The visible rows and the row of every item in the view are kept
+ * in vectors, so mapping between the view and the PlaylistModel is a lookup.
+ */
+class PlaylistFilterProxyModel : public QAbstractListModel
 {
     Q_OBJECT
     QML_NAMED_ELEMENT(PlaylistFilterProxyModel)
 
 public:
     explicit PlaylistFilterProxyModel(QObject *parent = nullptr);
+    ~PlaylistFilterProxyModel() override;
     friend class PlaylistMultiProxiesModel;
+    friend class PlaylistGlobalSearchModel;
     friend class MpvItem;
+    friend class PlaylistStore;
+    friend class PlaylistFolderWatcher;
 
     void setPlaylistType(Playlist::PlaylistType type);
     Playlist::PlaylistType playlistType() const;
 
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
 
     // clang-format off
     enum class Selection {
@@ -48,11 +69,21 @@ public:
     Q_ENUM(Selection)
     // clang-format on
 
-    enum Filter {
-        Name = Qt::UserRole,
-        Title,
+    enum class Sort {
+        NameAscending,
+        NameDescending,
+        DurationAscending,
+        DurationDescending,
+        LastModifiedAscending,
+        LastModifiedDescending,
+        FileSizeAscending,
+        FileSizeDescending,
+        FolderAscending,
+        FolderDescending,
+        TrackNumberAscending,
+        TrackNumberDescending,
     };
-    Q_ENUM(Filter)
+    Q_ENUM(Sort)
 
     Q_PROPERTY(uint selectionCount READ selectionCount NOTIFY selectionCountChanged)
     uint selectionCount();
@@ -68,10 +99,22 @@ public:
     Q_PROPERTY(QString playlistName READ playlistName NOTIFY playlistNameChanged)
     QString playlistName() const;
 
+    // true while the items of the playlist are read in the background, see PlaylistMultiProxiesModel
+    Q_PROPERTY(bool loading READ loading NOTIFY loadingChanged)
+    bool loading() const;
+
+    Q_PROPERTY(bool canUndo READ canUndo NOTIFY historyChanged)
+    bool canUndo() const;
+
+    Q_PROPERTY(bool canRedo READ canRedo NOTIFY historyChanged)
+    bool canRedo() const;
+
     Q_INVOKABLE uint getPlayingItem();
     Q_INVOKABLE void setPlayingItem(uint i);
     Q_INVOKABLE void playNext();
     Q_INVOKABLE void playPrevious();
+    // the PlaylistModel row playNext() would play, -1 when there is none; changes nothing
+    int nextPlaylistModelRow() const;
     Q_INVOKABLE void saveM3uFile(const QString &path);
     Q_INVOKABLE void highlightInFileManager(uint row);
     Q_INVOKABLE void removeItem(uint row);
@@ -89,11 +132,14 @@ public:
     Q_INVOKABLE void addFilesAndFolders(QList<QUrl> urls, PlaylistModel::Behavior behavior, uint insertOffset = 0);
     Q_INVOKABLE bool isDirectory(const QUrl &url);
 
-    Q_INVOKABLE void sortItems(PlaylistSortProxyModel::Sort sortMode);
+    Q_INVOKABLE void sortItems(PlaylistFilterProxyModel::Sort sortMode);
     Q_INVOKABLE void clear();
     Q_INVOKABLE void addItem(const QString &path, PlaylistModel::Behavior behavior);
     Q_INVOKABLE void addItem(const QUrl &url, PlaylistModel::Behavior behavior);
     Q_INVOKABLE void addItems(const QList<QUrl> &urls, PlaylistModel::Behavior behavior);
+    // undoes removing, trashing (only the playlist items, not the files), moving, sorting and clearing
+    Q_INVOKABLE void undo();
+    Q_INVOKABLE void redo();
 
 Q_SIGNALS:
     void selectionCountChanged();
@@ -104,29 +150,184 @@ Q_SIGNALS:
     void itemsInserted();
     void searchTextChanged();
     void playlistNameChanged();
+    void loadingChanged();
+    void historyChanged();
+    // the order of the items changed, other than items appended at the end
+    void orderChanged();
 
 private:
-    void onSelectionChanged(const QItemSelection &selected, const QItemSelection &deselected);
-    void shufflePlaylistModel();
+    enum MatchState : quint8 {
+        Unknown,
+        NoMatch,
+        Match,
+    };
+
+    struct SearchCandidate {
+        int row;
+        QString text;
+        bool folded;
+    };
+
+    enum class SortKey {
+        Name,
+        Duration,
+        LastModified,
+        FileSize,
+        Folder,
+        TrackNumber,
+    };
+
+    void onPlaylistRowsInserted(const QModelIndex &parent, int first, int last);
+    void onPlaylistItemsAboutToBeRemoved(const std::vector<int> &rows);
+    void onPlaylistItemsRemoved(const std::vector<int> &rows);
+    void onPlaylistDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QList<int> &roles);
+    void onPlaylistModelAboutToBeReset();
+    void onPlaylistModelReset();
+
+    // whether the search accepts the PlaylistModel row, the result is cached in m_matchStates
+    bool acceptsRow(int row) const;
+    // brings the visible rows in line with the search, emitting the removed and inserted ranges
+    void refilter();
+    // accepted is indexed by PlaylistModel row
+    void refilterRanges(const std::vector<char> &accepted);
+    // rebuilds m_positions, m_rows and m_viewRows from m_order
+    void rebuildMappings();
+    // rebuilds the mappings inside a layout change, for changes that don't fit in a few ranges
+    void relayout();
+
+    // sorts m_order by the current sort key, returns whether the order changed
+    bool sortOrder();
+    bool lessThan(int leftRow, int rightRow) const;
+    bool sortsBefore(int leftRow, int rightRow) const;
+    // the role whose changes require sorting again
+    int sortRole() const;
+    QCollatorSortKey makeCollationKey(int row) const;
+    const QCollatorSortKey &collationKey(int row) const;
+
+    void runSearch(bool narrowing);
+    void publishSearchResults(quint64 generation,
+                              quint64 revision,
+                              quint64 structureRevision,
+                              const std::vector<SearchCandidate> &candidates,
+                              const std::vector<int> &matchedRows);
+    bool isShuffleCandidate(quint32 id) const;
+    // fetches the items of the playlist model not fetched yet
+    void fetchAll();
+    // keeps the items of folder in sync with it, when enabled in the settings
+    void watchFolder(const QString &folder, bool recursive);
+    void setLoading(bool loading);
+    // reads the items of a lazy playlist right away, before they are edited,
+    // so new items get ids after the stored ones and the store is attached
+    void ensureLoaded();
+
+    // undo
+    // before an undoable edit, with the ids of the playlist before it;
+    // additions are recorded by onPlaylistRowsInserted()
+    void recordEdit(const PersistentIdList &ids);
+    void clearHistory();
+    // makes the playlist hold ids in their order, with bulk removal, insertion and a layout change;
+    // only the items of m_orderIds that ids doesn't have are removed, the m3u entries
+    // fetched meanwhile are kept after the others
+    void restoreIds(const PersistentIdList &ids);
+    // drops the removed items no snapshot refers to anymore
+    void pruneRemovedItems();
+    PersistentIdList currentOrderIds() const;
 
-    PlaylistProxyModel *playlistProxyModel() const;
-    PlaylistSortProxyModel *playlistSortProxyModel() const;
     PlaylistModel *playlistModel() const;
 
     Playlist::PlaylistType m_playlistType{Playlist::PlaylistType::Regular};
+    bool m_loading{false};
+    // set while the playlist is lazy, see ensureLoaded()
+    std::function<void()> m_load;
 
-    QModelIndex mapFromPlaylistModel(uint row) const;
-    QModelIndex mapToPlaylistModel(uint row) const;
+    // -1 when the row is out of range or hidden
+    int mapFromPlaylistModel(int row) const;
+    int mapToPlaylistModel(int row) const;
+    // m_rows[row], skipping the gap left by a bulk removal in progress
+    int modelRowAt(int row) const;
 
-    void splitItemSelection(const QModelIndexList &original, int splitRow, bool isTopDown, QModelIndexList &lowerPart, QModelIndexList &upperPart);
-    QModelIndexList selectedRows() const;
-    void saveInternalPlaylist(const QString &path, const QString &playlistName);
+    // selection
+    // stored per item id, so it follows the items through moves, sorting and searching;
+    // items hidden by the search stay selected, but only the visible ones are counted and acted on
+    quint32 itemId(int row) const;
+    bool isRowSelected(int row) const;
+    // row is a PlaylistModel row, the caller notifies the view
+    void setRowSelected(int row, bool selected);
+    void clearSelection();
+    void notifySelectionChanged(int first, int last);
+    // visible selected rows, ascending
+    std::vector<int> selectedRows() const;
 
     std::unique_ptr<PlaylistModel> m_playlistModel;
-    std::unique_ptr<PlaylistSortProxyModel> m_playlistSortProxyModel;
-    std::unique_ptr<PlaylistProxyModel> m_playlistProxyModel;
-    QItemSelectionModel m_selectionModel;
-    bool m_scheduledReshuffle{false};
+
+    // indexed by item id
+    std::vector<bool> m_selected;
+    // visible selected items
+    int m_selectionCount{0};
+    // item the next range selection starts from, 0 when there is none
+    quint32 m_anchorId{0};
+
+    // PlaylistModel rows in playlist order, hidden rows included
+    std::vector<int> m_order;
+    // PlaylistModel row -> index in m_order
+    std::vector<int> m_positions;
+    // view row -> PlaylistModel row, the rows of m_order accepted by the search
+    std::vector<int> m_rows;
+    // PlaylistModel row -> view row, -1 when hidden
+    std::vector<int> m_viewRows;
+    // while rows are removed in bulk, [m_gapFirst, m_gapEnd) of m_rows holds rows that are
+    // already removed from the view, so the rows after them only move once, when the gap is closed
+    int m_gapFirst{0};
+    int m_gapEnd{0};
+    // index in m_order where the next inserted item goes, -1 appends
+    int m_insertPosition{-1};
+
+    // sorting
+    // after sortItems the order is kept sorted, new items are inserted at their place
+    // and changed items are re-sorted, until the user moves or inserts items
+    bool m_sorted{false};
+    SortKey m_sortKey{SortKey::Name};
+    Qt::SortOrder m_sortOrder{Qt::AscendingOrder};
+    QCollator m_collator;
+    // collation keys of the name (or folder + name) of each PlaylistModel row,
+    // built on first use, so sorting compares precomputed keys instead of strings
+    mutable std::vector<QCollatorSortKey> m_collationKeys;
+    QTimer m_sortTimer;
+
+    PlaylistSearchIndex m_searchIndex;
+    QString m_searchText;
+    QStringList m_searchTokens;
+    PlaylistSearchIndex::Mode m_searchMode{PlaylistSearchIndex::Mode::Substring};
+    PlaylistSearchIndex::Field m_searchField{PlaylistSearchIndex::Field::Name};
+    // indexed by PlaylistModel row, filled lazily by acceptsRow
+    mutable std::vector<MatchState> m_matchStates;
+    // bumped by every search, results of older searches are dropped
+    quint64 m_searchGeneration{0};
+    bool m_searchPending{false};
+    TaskToken m_searchTasks;
+
+    // undo
+    // the snapshots are persistent lists sharing their nodes, so an edit of k items
+    // costs O(k log n) memory in the history instead of a copy of the playlist
+    // ids in playlist order, kept in line with m_order
+    PersistentIdList m_orderIds;
+    std::vector<PersistentIdList> m_undoStack;
+    std::vector<PersistentIdList> m_redoStack;
+    // the items removed while there is history, so they can be brought back
+    QHash<quint32, PlaylistItem> m_removedItems;
+    qsizetype m_pruneThreshold{0};
+    // the model is reset by clear(), which can be undone
+    bool m_clearing{false};
+    // additions are undone as a step of their own, the ones coming within
+    // AdditionStepWindow of each other (e.g. the batches of a folder) share it
+    bool m_additionStep{false};
+    QElapsedTimer m_lastAddition;
+
+    std::unique_ptr<PlaylistFolderWatcher> m_folderWatcher;
+
+    // only internal playlists are stored, declared last so it's destroyed
+    // (and writes its pending changes) while the models still exist
+    std::unique_ptr<PlaylistStore> m_store;
 };
 
 #endif // PLAYLISTFILTERPROXYMODEL_H
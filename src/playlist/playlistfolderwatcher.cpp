@@ -0,0 +1,285 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "playlistfolderwatcher.h"
+
+#include <QCollator>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QUrl>
+
+#include <algorithm>
+#include <queue>
+#include <utility>
+
+#include "miscutils.h"
+#include "performancelog.h"
+#include "playlistfilterproxymodel.h"
+#include "playlistsettings.h"
+
+namespace
+{
+// changes usually come in bursts (a copy, an extracted archive), wait for them to settle
+constexpr int ChangesDelay = 1000;
+} // namespace
+
+PlaylistFolderWatcher::PlaylistFolderWatcher(PlaylistFilterProxyModel *proxyModel, QObject *parent)
+    : QObject{parent}
+    , m_proxyModel{proxyModel}
+{
+    m_changesTimer.setInterval(ChangesDelay);
+    m_changesTimer.setSingleShot(true);
+    connect(&m_changesTimer, &QTimer::timeout, this, &PlaylistFolderWatcher::applyChanges);
+    connect(&m_watcher, &QFileSystemWatcher::directoryChanged, this, &PlaylistFolderWatcher::onDirectoryChanged);
+
+    // the items of the folders are gone
+    connect(proxyModel->playlistModel(), &QAbstractItemModel::modelReset, this, &PlaylistFolderWatcher::clear);
+}
+
+void PlaylistFolderWatcher::watch(const QString &folder, bool recursive)
+{
+    addFolder(QDir::cleanPath(folder), recursive, nullptr);
+}
+
+void PlaylistFolderWatcher::clear()
+{
+    const auto directories = m_watcher.directories();
+    if (!directories.isEmpty()) {
+        m_watcher.removePaths(directories);
+    }
+    m_folders.clear();
+    m_changedFolders.clear();
+    m_changesTimer.stop();
+    m_limitReported = false;
+}
+
+void PlaylistFolderWatcher::onDirectoryChanged(const QString &path)
+{
+    m_changedFolders.insert(path);
+    m_changesTimer.start();
+}
+
+void PlaylistFolderWatcher::applyChanges()
+{
+    if (!PlaylistSettings::watchFolders()) {
+        clear();
+        return;
+    }
+
+    QStringList addedFiles;
+    QStringList removedFiles;
+    const auto changedFolders = std::exchange(m_changedFolders, {});
+    for (const auto &path : changedFolders) {
+        const auto it = m_folders.constFind(path);
+        if (it == m_folders.cend()) {
+            // removed together with a parent folder
+            continue;
+        }
+
+        // only the folders that changed are listed again
+        Folder folder;
+        folder.recursive = it->recursive;
+        if (!list(path, folder)) {
+            removeFolder(path, removedFiles);
+            continue;
+        }
+
+        const Folder previous = std::move(m_folders[path]);
+        for (const auto &name : std::as_const(folder.files)) {
+            if (!previous.files.contains(name)) {
+                addedFiles.append(path + u'/' + name);
+            }
+        }
+        for (const auto &name : previous.files) {
+            if (!folder.files.contains(name)) {
+                removedFiles.append(path + u'/' + name);
+            }
+        }
+        const bool recursive = folder.recursive;
+        const auto subfolders = folder.subfolders;
+        m_folders[path] = std::move(folder);
+
+        if (!recursive) {
+            continue;
+        }
+        for (const auto &name : previous.subfolders) {
+            if (!subfolders.contains(name)) {
+                removeFolder(path + u'/' + name, removedFiles);
+            }
+        }
+        for (const auto &name : subfolders) {
+            if (!previous.subfolders.contains(name)) {
+                addFolder(path + u'/' + name, true, &addedFiles);
+            }
+        }
+    }
+
+    if (!addedFiles.isEmpty() || !removedFiles.isEmpty()) {
+        updatePlaylist(addedFiles, removedFiles);
+    }
+}
+
+bool PlaylistFolderWatcher::list(const QString &path, Folder &folder)
+{
+    QDir dir(path);
+    if (!dir.exists() || !dir.isReadable()) {
+        return false;
+    }
+    // same filters as the code that loaded the folder, see PlaylistModel::getSiblingItems
+    // and PlaylistFilterProxyModel::addFilesAndFolders
+    const auto filters = folder.recursive ? QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot : QDir::Files | QDir::Hidden;
+    const auto entries = dir.entryInfoList(filters, QDir::NoSort);
+    for (const auto &entry : entries) {
+        if (entry.isDir()) {
+            folder.subfolders.insert(entry.fileName());
+        } else {
+            folder.files.insert(entry.fileName());
+        }
+    }
+    return true;
+}
+
+void PlaylistFolderWatcher::addFolder(const QString &path, bool recursive, QStringList *addedFiles)
+{
+    // breadth first, so when the limit is hit the folders closest to the top are the ones watched
+    std::queue<QString> pending;
+    pending.push(path);
+    while (!pending.empty()) {
+        const QString current = pending.front();
+        pending.pop();
+
+        auto it = m_folders.find(current);
+        if (it != m_folders.end()) {
+            if (!recursive || it->recursive) {
+                continue;
+            }
+            // watched on its own before, now its subfolders are wanted too
+            it->recursive = true;
+            for (const auto &name : std::as_const(it->subfolders)) {
+                pending.push(current + u'/' + name);
+            }
+            continue;
+        }
+
+        if (m_folders.size() >= PlaylistSettings::maxWatchedFolders()) {
+            if (!m_limitReported) {
+                qDebug() << "PlaylistFolderWatcher: watching" << m_folders.size() << "folders, not watching" << current << "and the rest";
+                m_limitReported = true;
+            }
+            return;
+        }
+
+        Folder folder;
+        folder.recursive = recursive;
+        if (!list(current, folder)) {
+            continue;
+        }
+        if (!m_watcher.addPath(current)) {
+            qDebug() << "PlaylistFolderWatcher: could not watch" << current;
+            continue;
+        }
+        if (addedFiles) {
+            for (const auto &name : std::as_const(folder.files)) {
+                addedFiles->append(current + u'/' + name);
+            }
+        }
+        if (recursive) {
+            for (const auto &name : std::as_const(folder.subfolders)) {
+                pending.push(current + u'/' + name);
+            }
+        }
+        m_folders.insert(current, std::move(folder));
+    }
+}
+
+void PlaylistFolderWatcher::removeFolder(const QString &path, QStringList &removedFiles)
+{
+    const QString prefix = path + u'/';
+    QStringList removedFolders;
+    for (auto it = m_folders.cbegin(); it != m_folders.cend(); ++it) {
+        if (it.key() == path || it.key().startsWith(prefix)) {
+            removedFolders.append(it.key());
+        }
+    }
+    for (const auto &folder : std::as_const(removedFolders)) {
+        for (const auto &name : std::as_const(m_folders[folder].files)) {
+            removedFiles.append(folder + u'/' + name);
+        }
+        // fails when the folder was deleted, the watch is gone already
+        m_watcher.removePath(folder);
+        m_folders.remove(folder);
+        m_changedFolders.remove(folder);
+    }
+}
+
+void PlaylistFolderWatcher::updatePlaylist(const QStringList &addedFiles, const QStringList &removedFiles)
+{
+    auto model = m_proxyModel->playlistModel();
+
+    // a moved file shows up as a removed file and an added one with the same name,
+    // size and modification time; a file only renamed can't be told from another
+    // one with the same size and time, it's removed and added again
+    QMultiHash<std::pair<qint64, qint64>, QString> addedByStat;
+    for (const auto &file : addedFiles) {
+        const QFileInfo fileInfo(file);
+        addedByStat.insert({fileInfo.size(), fileInfo.lastModified().toMSecsSinceEpoch()}, file);
+    }
+
+    QSet<QString> movedFiles;
+    std::vector<int> removedRows;
+    for (const auto &file : removedFiles) {
+        const QString fileName = QFileInfo(file).fileName();
+        for (const int row : model->rowsOfLocation(QUrl::fromLocalFile(file))) {
+            auto &item = model->m_playlist[row];
+            const std::pair stat{item.fileSize, item.lastModified};
+            auto it = addedByStat.find(stat);
+            while (it != addedByStat.end() && it.key() == stat && QFileInfo(it.value()).fileName() != fileName) {
+                ++it;
+            }
+            if (item.lastModified > 0 && it != addedByStat.end() && it.key() == stat) {
+                const QFileInfo fileInfo(it.value());
+                model->setItemUrl(row, QUrl::fromLocalFile(it.value()));
+                item.filename = fileInfo.fileName();
+                item.folderPath = model->internFolder(fileInfo.absolutePath());
+                model->markItemChanged(row, {PlaylistModel::NameRole, PlaylistModel::PathRole, PlaylistModel::FolderPathRole});
+                movedFiles.insert(it.value());
+                addedByStat.erase(it);
+                continue;
+            }
+            removedRows.push_back(row);
+        }
+    }
+
+    QStringList files;
+    for (const auto &file : addedFiles) {
+        if (!movedFiles.contains(file) && model->isVideoOrAudioMimeType(MiscUtils::mimeType(QUrl::fromLocalFile(file)))) {
+            files.append(file);
+        }
+    }
+    QCollator collator;
+    collator.setNumericMode(true);
+    std::sort(files.begin(), files.end(), collator);
+
+    qCDebug(HARUNA_PERFORMANCE) << "PlaylistFolderWatcher:" << files.size() << "added," << removedRows.size() << "removed," << movedFiles.size() << "moved";
+
+    const bool removed = !removedRows.empty();
+    model->removeItems(std::move(removedRows));
+    for (const auto &file : std::as_const(files)) {
+        model->appendItem(QUrl::fromLocalFile(file));
+    }
+
+    if (removed) {
+        Q_EMIT m_proxyModel->itemsRemoved();
+    }
+    if (!files.isEmpty()) {
+        Q_EMIT m_proxyModel->itemsInserted();
+    }
+    if (removed || !files.isEmpty()) {
+        Q_EMIT m_proxyModel->itemCountChanged();
+    }
+}
+
+#include "moc_playlistfolderwatcher.cpp"
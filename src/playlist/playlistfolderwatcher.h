@@ -0,0 +1,64 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef PLAYLISTFOLDERWATCHER_H
+#define PLAYLISTFOLDERWATCHER_H
+
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+
+class PlaylistFilterProxyModel;
+
+/**
+ * Keeps the items that were loaded from folders in sync with the folders.
+ *
+ * The folders are watched with QFileSystemWatcher (inotify on Linux). Changes are
+ * collected for a short while, then only the folders that changed are listed again
+ * and compared with their previous listing. New media files are appended, deleted
+ * ones are removed and moved ones (a file that disappeared and one that appeared
+ * in another folder with the same name, size and modification time) are updated
+ * in place, so they keep their position and metadata. Recursive folders watch their subfolders too,
+ * up to PlaylistSettings::maxWatchedFolders folders.
+ */
+class PlaylistFolderWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PlaylistFolderWatcher(PlaylistFilterProxyModel *proxyModel, QObject *parent = nullptr);
+
+    // the files already in folder are assumed to be in the playlist
+    void watch(const QString &folder, bool recursive);
+    void clear();
+
+private:
+    struct Folder {
+        // names of the files and subfolders
+        QSet<QString> files;
+        QSet<QString> subfolders;
+        bool recursive{false};
+    };
+
+    void onDirectoryChanged(const QString &path);
+    void applyChanges();
+    // returns false if the folder can't be read
+    static bool list(const QString &path, Folder &folder);
+    // addedFiles gets the files of the folders that were not watched yet, when given
+    void addFolder(const QString &path, bool recursive, QStringList *addedFiles);
+    // removes path and the folders below it, their files go to removedFiles
+    void removeFolder(const QString &path, QStringList &removedFiles);
+    void updatePlaylist(const QStringList &addedFiles, const QStringList &removedFiles);
+
+    PlaylistFilterProxyModel *m_proxyModel{nullptr};
+    QFileSystemWatcher m_watcher;
+    QHash<QString, Folder> m_folders;
+    QSet<QString> m_changedFolders;
+    QTimer m_changesTimer;
+    bool m_limitReported{false};
+};
+
+#endif // PLAYLISTFOLDERWATCHER_H
@@ -0,0 +1,663 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "playlistglobalsearchmodel.h"
+
+#include <QFileInfo>
+
+#include <algorithm>
+
+#include "m3ureader.h"
+#include "performancelog.h"
+#include "playlistfilterproxymodel.h"
+#include "playlistmultiproxiesmodel.h"
+#include "playlistsettings.h"
+#include "playliststore.h"
+
+namespace
+{
+// items matched by one task
+constexpr int ChunkSize = 16384;
+// results kept in the model, the best ones
+constexpr int MaxResults = 500;
+} // namespace
+
+PlaylistGlobalSearchModel::PlaylistGlobalSearchModel(PlaylistMultiProxiesModel *playlists)
+    : QAbstractListModel{playlists}
+    , m_playlists{playlists}
+{
+    connect(m_playlists, &QAbstractItemModel::rowsAboutToBeRemoved, this, [this](const QModelIndex &, int first, int last) {
+        QSet<PlaylistFilterProxyModel *> removed;
+        for (int i = first; i <= last; ++i) {
+            removed.insert(m_playlists->m_playlistFilterProxyModels[i].get());
+        }
+        removeResults(removed);
+    });
+}
+
+PlaylistGlobalSearchModel::~PlaylistGlobalSearchModel()
+{
+    m_tasks.cancelAndWait();
+    m_readTasks.cancelAndWait();
+}
+
+QString PlaylistGlobalSearchModel::searchText() const
+{
+    return m_searchText;
+}
+
+void PlaylistGlobalSearchModel::setSearchText(const QString &text)
+{
+    using Field = PlaylistSearchIndex::Field;
+    const auto field = PlaylistSettings::showMediaTitle() ? Field::Title : Field::Name;
+    const auto mode = PlaylistSearchIndex::modeFromString(PlaylistSettings::searchMode());
+    if (text == m_searchText && field == m_searchField && mode == m_searchMode) {
+        return;
+    }
+
+    m_searchText = text;
+    m_searchTokens = PlaylistSearchIndex::tokenize(PlaylistSearchIndex::fold(text));
+    m_searchField = field;
+    m_searchMode = mode;
+    search();
+    Q_EMIT searchTextChanged();
+}
+
+bool PlaylistGlobalSearchModel::searching() const
+{
+    return m_searching;
+}
+
+int PlaylistGlobalSearchModel::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent)
+    return m_results.size();
+}
+
+QVariant PlaylistGlobalSearchModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rowCount()) {
+        return QVariant();
+    }
+
+    const auto &result = m_results[index.row()];
+    if (role == ScoreRole) {
+        return QVariant(result.score);
+    }
+    const auto proxy = result.proxy.data();
+    if (!proxy) {
+        return QVariant();
+    }
+    switch (role) {
+    case PlaylistNameRole:
+        return QVariant(proxy->playlistModel()->m_playlistName);
+    case PlaylistIndexRole:
+        return QVariant(m_playlists->rowOf(proxy));
+    }
+
+    const int row = modelRow(result);
+    if (row < 0) {
+        const auto item = detachedItem(result);
+        if (!item) {
+            return QVariant();
+        }
+        switch (role) {
+        case NameRole:
+            return QVariant(item->name);
+        case TitleRole:
+            return item->title.isEmpty() ? QVariant(item->name) : QVariant(item->title);
+        case PathRole:
+            return QVariant(item->path);
+        case PositionRole:
+            return QVariant(item->row);
+        }
+        return QVariant();
+    }
+
+    const auto &item = proxy->playlistModel()->m_playlist[row];
+    switch (role) {
+    case NameRole:
+        return QVariant(item.filename);
+    case TitleRole:
+        return item.mediaTitle.isEmpty() ? QVariant(item.filename) : QVariant(item.mediaTitle);
+    case PathRole:
+        return QVariant(item.location);
+    case PositionRole:
+        return QVariant(proxy->mapFromPlaylistModel(row));
+    }
+
+    return QVariant();
+}
+
+QHash<int, QByteArray> PlaylistGlobalSearchModel::roleNames() const
+{
+    // clang-format off
+    QHash<int, QByteArray> roles = {
+        {NameRole,          QByteArrayLiteral("name")},
+        {TitleRole,         QByteArrayLiteral("title")},
+        {PathRole,          QByteArrayLiteral("path")},
+        {PlaylistNameRole,  QByteArrayLiteral("playlistName")},
+        {PlaylistIndexRole, QByteArrayLiteral("playlistIndex")},
+        {PositionRole,      QByteArrayLiteral("position")},
+        {ScoreRole,         QByteArrayLiteral("score")},
+    };
+    // clang-format on
+
+    return roles;
+}
+
+void PlaylistGlobalSearchModel::openResult(int row)
+{
+    if (row < 0 || row >= rowCount()) {
+        return;
+    }
+    const auto &result = m_results[row];
+    auto proxy = result.proxy.data();
+    const int playlistIndex = m_playlists->rowOf(proxy);
+    if (playlistIndex < 0) {
+        return;
+    }
+    int itemRow = modelRow(result);
+    const auto detached = itemRow < 0 ? detachedItem(result) : nullptr;
+    if (detached) {
+        // the item has to be in the PlaylistModel to be shown
+        auto model = proxy->playlistModel();
+        if (m_playlists->m_unloaded.contains(proxy)) {
+            m_playlists->loadPlaylist(playlistIndex, true);
+        } else if (detached->m3uEntry >= 0 && model->m_m3u && model->m_m3u == result.chunk->m3u && model->m_m3uNext <= detached->m3uEntry) {
+            model->fetchM3uItems(detached->m3uEntry + 1 - model->m_m3uNext);
+        }
+        itemRow = modelRow(result);
+    }
+    if (itemRow < 0) {
+        return;
+    }
+
+    // the search of the playlist's tab may hide the item
+    if (proxy->mapFromPlaylistModel(itemRow) < 0 && !proxy->searchText().isEmpty()) {
+        proxy->setSearchText(QString());
+    }
+    const int viewRow = proxy->mapFromPlaylistModel(itemRow);
+    if (viewRow < 0) {
+        return;
+    }
+
+    m_playlists->setVisibleIndex(playlistIndex);
+    proxy->selectItem(viewRow, PlaylistFilterProxyModel::Selection::ClearSingle);
+    Q_EMIT resultOpened(playlistIndex, viewRow);
+}
+
+void PlaylistGlobalSearchModel::playlistLoaded(PlaylistFilterProxyModel *proxy)
+{
+    // the results found in it stay valid, the items keep their ids
+    const auto it = m_corpora.constFind(proxy);
+    if (it != m_corpora.cend() && it->unloaded) {
+        m_corpora.erase(it);
+    }
+}
+
+void PlaylistGlobalSearchModel::search()
+{
+    ++m_generation;
+    // the results of chunks that didn't start yet would be dropped anyway
+    m_tasks.cancel();
+    m_pendingChunks = 0;
+    m_pendingReads.clear();
+    clearResults();
+
+    if (m_searchTokens.isEmpty()) {
+        setSearching(false);
+        return;
+    }
+
+    m_searchTimer.start();
+    m_searchedItems = 0;
+    setSearching(true);
+    const auto &proxies = m_playlists->m_playlistFilterProxyModels;
+    for (std::size_t i = 0; i < proxies.size(); ++i) {
+        searchPlaylist(proxies[i].get(), i);
+    }
+    finishIfDone();
+}
+
+void PlaylistGlobalSearchModel::searchPlaylist(PlaylistFilterProxyModel *proxy, int playlistOrder)
+{
+    if (m_playlists->m_unloaded.contains(proxy)) {
+        // its items are matched without loading it
+        const auto it = m_corpora.constFind(proxy);
+        if (it != m_corpora.cend() && it->unloaded && it->field == m_searchField) {
+            matchChunks(proxy, playlistOrder, 0, 0, it->chunks);
+            return;
+        }
+        m_pendingReads.insert(proxy);
+        if (!m_reads.contains(proxy)) {
+            readPlaylist(proxy);
+        }
+        return;
+    }
+
+    const auto &chunks = chunksOf(proxy);
+    matchChunks(proxy, playlistOrder, proxy->m_searchIndex.revision(), proxy->m_searchIndex.structureRevision(), chunks);
+}
+
+void PlaylistGlobalSearchModel::matchChunks(PlaylistFilterProxyModel *proxy,
+                                            int playlistOrder,
+                                            quint64 revision,
+                                            quint64 structureRevision,
+                                            const Chunks &chunks)
+{
+    const QPointer<PlaylistFilterProxyModel> guardedProxy(proxy);
+    const auto scheduler = TaskScheduler::instance();
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+        ++m_pendingChunks;
+        m_searchedItems += chunks[i]->entries.size();
+        auto task = [this,
+                     generation = m_generation,
+                     proxy = guardedProxy,
+                     playlistOrder,
+                     revision,
+                     structureRevision,
+                     chunkIndex = i,
+                     chunk = chunks[i],
+                     tokens = m_searchTokens,
+                     mode = m_searchMode,
+                     field = m_searchField]() {
+            // the keys the search index didn't have yet
+            std::shared_ptr<Chunk> foldedChunk;
+            if (!chunk->folded) {
+                foldedChunk = std::make_shared<Chunk>(*chunk);
+                prepareChunk(*foldedChunk, field);
+            }
+
+            std::vector<Match> matches;
+            const Chunk &searched = foldedChunk ? *foldedChunk : *chunk;
+            for (std::size_t entry = 0; entry < searched.entries.size(); ++entry) {
+                const int entryScore = score(searched.entries[entry].key, tokens, mode);
+                if (entryScore >= 0) {
+                    matches.push_back({searched.entries[entry].id, entryScore, static_cast<int>(entry)});
+                }
+            }
+            auto better = [](const Match &a, const Match &b) {
+                if (a.score != b.score) {
+                    return a.score > b.score;
+                }
+                return a.id != b.id ? a.id < b.id : a.entry < b.entry;
+            };
+            if (static_cast<int>(matches.size()) > MaxResults) {
+                std::nth_element(matches.begin(), matches.begin() + MaxResults, matches.end(), better);
+                matches.resize(MaxResults);
+            }
+            std::sort(matches.begin(), matches.end(), better);
+
+            QMetaObject::invokeMethod(
+                this,
+                [this,
+                 generation,
+                 proxy,
+                 playlistOrder,
+                 revision,
+                 structureRevision,
+                 chunkIndex,
+                 chunk,
+                 foldedChunk = std::shared_ptr<const Chunk>(std::move(foldedChunk)),
+                 matches = std::move(matches)]() {
+                    const auto searchedChunk = foldedChunk ? foldedChunk : chunk;
+                    publishChunk(generation, proxy, playlistOrder, revision, structureRevision, chunkIndex, searchedChunk, foldedChunk, matches);
+                },
+                Qt::QueuedConnection);
+        };
+        scheduler->submit(TaskScheduler::Lane::Interactive, TaskScheduler::Resource::Cpu, QString(), m_tasks, std::move(task));
+    }
+}
+
+const PlaylistGlobalSearchModel::Chunks &PlaylistGlobalSearchModel::chunksOf(PlaylistFilterProxyModel *proxy)
+{
+    const auto &index = proxy->m_searchIndex;
+    const auto model = proxy->playlistModel();
+    auto &corpus = m_corpora[proxy];
+    if (corpus.proxy == proxy && !corpus.unloaded && corpus.field == m_searchField && corpus.revision == index.revision()
+        && corpus.m3uNext == model->m_m3uNext) {
+        return corpus.chunks;
+    }
+
+    corpus.proxy = proxy;
+    corpus.field = m_searchField;
+    corpus.revision = index.revision();
+    corpus.m3uNext = model->m_m3uNext;
+    corpus.unloaded = false;
+    corpus.chunks.clear();
+
+    // only copies go to the tasks, the index is not touched outside the gui thread;
+    // copying a QString only shares its data, the keys folded already are reused
+    const int rows = proxy->playlistModel()->rowCount();
+    for (int first = 0; first < rows; first += ChunkSize) {
+        const int last = std::min(first + ChunkSize, rows);
+        auto chunk = std::make_shared<Chunk>();
+        chunk->entries.reserve(last - first);
+        chunk->folded = true;
+        for (int row = first; row < last; ++row) {
+            const quint32 id = proxy->itemId(row);
+            if (index.hasKey(row, m_searchField)) {
+                chunk->entries.push_back({row, id, index.key(row, m_searchField), true});
+            } else {
+                chunk->entries.push_back({row, id, index.rawText(row, m_searchField), false});
+                chunk->folded = false;
+            }
+        }
+        corpus.chunks.push_back(std::move(chunk));
+    }
+
+    // the m3u entries not fetched yet are read by the tasks, not turned into items
+    if (model->m_m3u) {
+        const qsizetype count = model->m_m3u->count();
+        for (qsizetype first = model->m_m3uNext; first < count; first += ChunkSize) {
+            auto chunk = std::make_shared<Chunk>();
+            chunk->m3u = model->m_m3u;
+            chunk->m3uFirst = first;
+            chunk->m3uLast = std::min<qsizetype>(first + ChunkSize, count);
+            chunk->firstRow = rows + static_cast<int>(first - model->m_m3uNext);
+            corpus.chunks.push_back(std::move(chunk));
+        }
+    }
+    return corpus.chunks;
+}
+
+void PlaylistGlobalSearchModel::readPlaylist(PlaylistFilterProxyModel *proxy)
+{
+    const QString path = m_playlists->m_unloaded.value(proxy).path;
+    m_reads.insert(proxy);
+    auto task = [this, proxy = QPointer<PlaylistFilterProxyModel>(proxy), path, field = m_searchField]() {
+        std::vector<PlaylistItem> items;
+        PlaylistStore::load(path, items);
+
+        Chunks chunks;
+        for (std::size_t first = 0; first < items.size(); first += ChunkSize) {
+            const std::size_t last = std::min<std::size_t>(first + ChunkSize, items.size());
+            auto chunk = std::make_shared<Chunk>();
+            chunk->entries.reserve(last - first);
+            chunk->detached.reserve(last - first);
+            for (std::size_t i = first; i < last; ++i) {
+                auto &item = items[i];
+                const auto &text = field == PlaylistSearchIndex::Field::Title && !item.mediaTitle.isEmpty() ? item.mediaTitle : item.filename;
+                chunk->entries.push_back({-1, item.id, PlaylistSearchIndex::fold(text), true});
+                chunk->detached.push_back({std::move(item.filename), std::move(item.mediaTitle), std::move(item.location), static_cast<int>(i)});
+            }
+            chunk->folded = true;
+            chunks.push_back(std::move(chunk));
+        }
+
+        QMetaObject::invokeMethod(
+            this,
+            [this, proxy, field, chunks = std::move(chunks)]() {
+                publishCorpus(proxy, field, chunks);
+            },
+            Qt::QueuedConnection);
+    };
+    // proxy is only compared on the task
+    const auto scheduler = TaskScheduler::instance();
+    scheduler->submit(TaskScheduler::Lane::Interactive, TaskScheduler::Resource::Disk, TaskScheduler::diskKey(path), m_readTasks, std::move(task));
+}
+
+void PlaylistGlobalSearchModel::publishCorpus(const QPointer<PlaylistFilterProxyModel> &proxy, PlaylistSearchIndex::Field field, const Chunks &chunks)
+{
+    if (!proxy) {
+        // the playlist was removed
+        return;
+    }
+    m_reads.remove(proxy.data());
+
+    // kept for the next searches while the playlist isn't loaded
+    if (m_playlists->m_unloaded.contains(proxy.data())) {
+        auto &corpus = m_corpora[proxy.data()];
+        corpus.proxy = proxy;
+        corpus.field = field;
+        corpus.revision = 0;
+        corpus.m3uNext = 0;
+        corpus.unloaded = true;
+        corpus.chunks = chunks;
+    }
+
+    if (!m_pendingReads.remove(proxy.data())) {
+        return;
+    }
+    if (field != m_searchField) {
+        // the field changed while it was read
+        m_pendingReads.insert(proxy.data());
+        readPlaylist(proxy.data());
+        return;
+    }
+    const int playlistOrder = m_playlists->rowOf(proxy.data());
+    if (playlistOrder >= 0) {
+        matchChunks(proxy.data(), playlistOrder, 0, 0, chunks);
+    }
+    finishIfDone();
+}
+
+void PlaylistGlobalSearchModel::prepareChunk(Chunk &chunk, PlaylistSearchIndex::Field field)
+{
+    if (chunk.m3u && chunk.entries.empty()) {
+        // same as PlaylistModel::fetchM3uItems()
+        chunk.entries.reserve(chunk.m3uLast - chunk.m3uFirst);
+        chunk.detached.reserve(chunk.m3uLast - chunk.m3uFirst);
+        for (qsizetype i = chunk.m3uFirst; i < chunk.m3uLast; ++i) {
+            const auto url = chunk.m3u->url(i);
+            if (!url.isValid() || url.isEmpty()) {
+                continue;
+            }
+            DetachedItem item;
+            item.path = url.toString();
+            item.name = url.isLocalFile() ? QFileInfo(url.toLocalFile()).fileName() : item.path;
+            double duration{0.0};
+            if (chunk.m3u->extinf(i, &duration, &item.title) && !url.isLocalFile() && !item.title.isEmpty()) {
+                item.name = item.title;
+            }
+            item.row = chunk.firstRow + static_cast<int>(i - chunk.m3uFirst);
+            item.m3uEntry = i;
+            const auto &text = field == PlaylistSearchIndex::Field::Title && !item.title.isEmpty() ? item.title : item.name;
+            chunk.entries.push_back({-1, 0, PlaylistSearchIndex::fold(text), true});
+            chunk.detached.push_back(std::move(item));
+        }
+    }
+
+    for (auto &entry : chunk.entries) {
+        if (!entry.folded) {
+            entry.key = PlaylistSearchIndex::fold(entry.key);
+            entry.folded = true;
+        }
+    }
+    chunk.folded = true;
+}
+
+void PlaylistGlobalSearchModel::publishChunk(quint64 generation,
+                                             const QPointer<PlaylistFilterProxyModel> &proxy,
+                                             int playlistOrder,
+                                             quint64 revision,
+                                             quint64 structureRevision,
+                                             std::size_t chunkIndex,
+                                             const std::shared_ptr<const Chunk> &searchedChunk,
+                                             const std::shared_ptr<const Chunk> &foldedChunk,
+                                             const std::vector<Match> &matches)
+{
+    if (generation != m_generation) {
+        // a newer search was started
+        return;
+    }
+    --m_pendingChunks;
+
+    if (!proxy) {
+        // the playlist was removed
+        finishIfDone();
+        return;
+    }
+
+    if (foldedChunk) {
+        // the tab's search and the next global search don't have to fold them again
+        auto &index = proxy->m_searchIndex;
+        if (structureRevision == index.structureRevision()) {
+            for (const auto &entry : foldedChunk->entries) {
+                if (entry.row >= 0 && !index.changedSince(entry.row, revision)) {
+                    index.setKey(entry.row, m_searchField, entry.key);
+                }
+            }
+        }
+        auto it = m_corpora.find(proxy.data());
+        if (it != m_corpora.end() && it->proxy == proxy && !it->unloaded && it->field == m_searchField && it->revision == revision
+            && chunkIndex < it->chunks.size()) {
+            it->chunks[chunkIndex] = foldedChunk;
+        }
+    }
+
+    // the detached items are shown from the chunk
+    const auto chunk = searchedChunk->detached.empty() ? nullptr : searchedChunk;
+    std::vector<Result> results;
+    results.reserve(matches.size());
+    for (const auto &match : matches) {
+        results.push_back({proxy, playlistOrder, match.id, match.score, chunk, match.entry});
+    }
+    mergeResults(results);
+    finishIfDone();
+}
+
+void PlaylistGlobalSearchModel::removeResults(const QSet<PlaylistFilterProxyModel *> &proxies)
+{
+    for (auto proxy : proxies) {
+        m_pendingReads.remove(proxy);
+        m_reads.remove(proxy);
+        m_corpora.remove(proxy);
+    }
+
+    // from the bottom up, so the rows above stay valid
+    int last = static_cast<int>(m_results.size()) - 1;
+    while (last >= 0) {
+        if (!proxies.contains(m_results[last].proxy.data())) {
+            --last;
+            continue;
+        }
+        int first = last;
+        while (first > 0 && proxies.contains(m_results[first - 1].proxy.data())) {
+            --first;
+        }
+        beginRemoveRows(QModelIndex(), first, last);
+        m_results.erase(m_results.begin() + first, m_results.begin() + last + 1);
+        endRemoveRows();
+        last = first - 1;
+    }
+    finishIfDone();
+}
+
+void PlaylistGlobalSearchModel::mergeResults(const std::vector<Result> &results)
+{
+    // the existing rows keep their order, the new ones are inserted in runs between them
+    auto next = results.cbegin();
+    int position{0};
+    while (next != results.cend()) {
+        while (position < static_cast<int>(m_results.size()) && !ranksBefore(*next, m_results[position])) {
+            ++position;
+        }
+        if (position >= MaxResults) {
+            break;
+        }
+        auto runEnd = next;
+        while (runEnd != results.cend() && (position == static_cast<int>(m_results.size()) || ranksBefore(*runEnd, m_results[position]))) {
+            ++runEnd;
+        }
+        const int count = std::min(static_cast<int>(runEnd - next), MaxResults - position);
+        beginInsertRows(QModelIndex(), position, position + count - 1);
+        m_results.insert(m_results.begin() + position, next, next + count);
+        endInsertRows();
+        position += count;
+        next = runEnd;
+    }
+
+    if (static_cast<int>(m_results.size()) > MaxResults) {
+        beginRemoveRows(QModelIndex(), MaxResults, m_results.size() - 1);
+        m_results.erase(m_results.begin() + MaxResults, m_results.end());
+        endRemoveRows();
+    }
+}
+
+void PlaylistGlobalSearchModel::clearResults()
+{
+    if (m_results.empty()) {
+        return;
+    }
+    beginResetModel();
+    m_results.clear();
+    endResetModel();
+}
+
+void PlaylistGlobalSearchModel::finishIfDone()
+{
+    if (!m_searching || m_pendingChunks > 0 || !m_pendingReads.isEmpty()) {
+        return;
+    }
+    qCDebug(HARUNA_PERFORMANCE) << "PlaylistGlobalSearchModel:" << m_results.size() << "results from" << m_searchedItems << "items in"
+                                << m_searchTimer.elapsed() << "ms";
+    setSearching(false);
+}
+
+void PlaylistGlobalSearchModel::setSearching(bool searching)
+{
+    if (m_searching == searching) {
+        return;
+    }
+    m_searching = searching;
+    Q_EMIT searchingChanged();
+}
+
+int PlaylistGlobalSearchModel::modelRow(const Result &result) const
+{
+    if (!result.proxy) {
+        return -1;
+    }
+    const auto model = result.proxy->playlistModel();
+    if (result.id != 0) {
+        return model->rowOfId(result.id);
+    }
+    // an m3u entry, found by its url once it's fetched
+    const auto item = detachedItem(result);
+    return item ? model->rowOfLocation(QUrl(item->path)) : -1;
+}
+
+const PlaylistGlobalSearchModel::DetachedItem *PlaylistGlobalSearchModel::detachedItem(const Result &result) const
+{
+    if (!result.chunk || result.entry < 0 || result.entry >= static_cast<int>(result.chunk->detached.size())) {
+        return nullptr;
+    }
+    return &result.chunk->detached[result.entry];
+}
+
+int PlaylistGlobalSearchModel::score(const QString &key, const QStringList &tokens, PlaylistSearchIndex::Mode mode)
+{
+    if (!PlaylistSearchIndex::matches(key, tokens, mode)) {
+        return -1;
+    }
+    // tokens found at the start of the key or of a word count more,
+    // then shorter keys, where the tokens are a bigger part of the name
+    int wordMatches{0};
+    for (const auto &token : tokens) {
+        const auto position = key.indexOf(token);
+        if (position == 0) {
+            wordMatches += 3;
+        } else if (position > 0 && !key.at(position - 1).isLetterOrNumber()) {
+            wordMatches += 2;
+        } else if (position > 0) {
+            wordMatches += 1;
+        }
+    }
+    return wordMatches * 1024 + (1023 - std::min<int>(key.size(), 1023));
+}
+
+bool PlaylistGlobalSearchModel::ranksBefore(const Result &a, const Result &b)
+{
+    if (a.score != b.score) {
+        return a.score > b.score;
+    }
+    if (a.playlistOrder != b.playlistOrder) {
+        return a.playlistOrder < b.playlistOrder;
+    }
+    return a.id != b.id ? a.id < b.id : a.entry < b.entry;
+}
+
+#include "moc_playlistglobalsearchmodel.cpp"
@@ -0,0 +1,212 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef PLAYLISTGLOBALSEARCHMODEL_H
+#define PLAYLISTGLOBALSEARCHMODEL_H
+
+#include <QAbstractListModel>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPointer>
+#include <QSet>
+#include <qqml.h>
+
+#include <memory>
+#include <vector>
+
+#include "playlistsearchindex.h"
+#include "taskscheduler.h"
+
+class M3uReader;
+class PlaylistFilterProxyModel;
+class PlaylistMultiProxiesModel;
+
+/**
+ * Searches the items of all playlists at once, the matches are ranked.
+ *
+ * The items of each playlist are split in chunks of folded search keys, every chunk
+ * is matched by its own Interactive task on the TaskScheduler, so the playlists are
+ * searched in parallel. The best matches of each chunk are merged into the model
+ * as soon as the chunk is done. The chunks are kept per playlist until it changes,
+ * so typing only matches keys, without reading or folding the items again.
+ *
+ * Items that are not in their PlaylistModel yet are searched without creating them:
+ * the store file of a playlist that was not read is read by a task and kept as its
+ * chunks until the playlist is loaded, the m3u entries not fetched yet are read by
+ * the tasks matching them, see M3uReader. These results are shown from the chunk,
+ * the playlist is loaded or the entry fetched when the result is opened.
+ */
+class PlaylistGlobalSearchModel : public QAbstractListModel
+{
+    Q_OBJECT
+    QML_NAMED_ELEMENT(PlaylistGlobalSearchModel)
+    QML_UNCREATABLE("Owned by PlaylistMultiProxiesModel")
+
+public:
+    explicit PlaylistGlobalSearchModel(PlaylistMultiProxiesModel *playlists);
+    ~PlaylistGlobalSearchModel() override;
+
+    enum Roles {
+        NameRole = Qt::UserRole,
+        TitleRole,
+        PathRole,
+        PlaylistNameRole,
+        PlaylistIndexRole,
+        // position of the item in its playlist
+        PositionRole,
+        ScoreRole,
+    };
+    Q_ENUM(Roles)
+
+    Q_PROPERTY(QString searchText READ searchText WRITE setSearchText NOTIFY searchTextChanged)
+    QString searchText() const;
+    void setSearchText(const QString &text);
+
+    // chunks or playlists are still being searched
+    Q_PROPERTY(bool searching READ searching NOTIFY searchingChanged)
+    bool searching() const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    // shows the playlist of the match and selects the item, see resultOpened()
+    Q_INVOKABLE void openResult(int row);
+
+Q_SIGNALS:
+    void searchTextChanged();
+    void searchingChanged();
+    // the item is at viewRow of the visible playlist
+    void resultOpened(int playlistIndex, int viewRow);
+
+private:
+    friend class PlaylistMultiProxiesModel;
+
+    struct Entry {
+        // -1 when the item is not in the PlaylistModel, see Chunk::detached
+        int row;
+        // 0 for m3u entries
+        quint32 id;
+        QString key;
+        bool folded;
+    };
+
+    // an item that is not in its PlaylistModel yet
+    struct DetachedItem {
+        QString name;
+        QString title;
+        QString path;
+        // the row it has, or will have, in the PlaylistModel
+        int row;
+        // -1 for the items of a playlist that was not read
+        qsizetype m3uEntry{-1};
+    };
+
+    // consecutive PlaylistModel rows; the keys that were not folded yet are folded
+    // by the task matching the chunk, it publishes a folded copy that replaces it
+    struct Chunk {
+        std::vector<Entry> entries;
+        bool folded{false};
+        // parallel to entries when they are not in the PlaylistModel
+        std::vector<DetachedItem> detached;
+        // m3u entries m3uFirst to m3uLast, they are read into entries by the task
+        // and the chunk is not folded until then; firstRow is the row of m3uFirst
+        std::shared_ptr<const M3uReader> m3u;
+        qsizetype m3uFirst{0};
+        qsizetype m3uLast{0};
+        int firstRow{0};
+    };
+    using Chunks = std::vector<std::shared_ptr<const Chunk>>;
+
+    // the chunks of a playlist, valid while its search index has the same revision,
+    // or while it's not loaded when they were read from its store file
+    struct Corpus {
+        QPointer<PlaylistFilterProxyModel> proxy;
+        PlaylistSearchIndex::Field field{PlaylistSearchIndex::Field::Name};
+        quint64 revision{0};
+        qsizetype m3uNext{0};
+        bool unloaded{false};
+        Chunks chunks;
+    };
+
+    struct Match {
+        quint32 id;
+        int score;
+        // index in the chunk
+        int entry;
+    };
+
+    struct Result {
+        QPointer<PlaylistFilterProxyModel> proxy;
+        // index of the playlist when it was searched, orders equal scores
+        int playlistOrder;
+        quint32 id;
+        int score;
+        // set when the item was not in the PlaylistModel, it's shown from chunk->detached[entry]
+        std::shared_ptr<const Chunk> chunk;
+        int entry;
+    };
+
+    // drops the chunks read from the store file of proxy
+    void playlistLoaded(PlaylistFilterProxyModel *proxy);
+    void search();
+    void searchPlaylist(PlaylistFilterProxyModel *proxy, int playlistOrder);
+    // submits the tasks matching chunks
+    void matchChunks(PlaylistFilterProxyModel *proxy, int playlistOrder, quint64 revision, quint64 structureRevision, const Chunks &chunks);
+    // the chunks of proxy, from the cache when it didn't change
+    const Chunks &chunksOf(PlaylistFilterProxyModel *proxy);
+    // reads the store file of a playlist that was not loaded on a task, see publishCorpus()
+    void readPlaylist(PlaylistFilterProxyModel *proxy);
+    void publishCorpus(const QPointer<PlaylistFilterProxyModel> &proxy, PlaylistSearchIndex::Field field, const Chunks &chunks);
+    // searchedChunk is the one matches refer to, foldedChunk is set when the task folded the keys of the chunk
+    void publishChunk(quint64 generation,
+                      const QPointer<PlaylistFilterProxyModel> &proxy,
+                      int playlistOrder,
+                      quint64 revision,
+                      quint64 structureRevision,
+                      std::size_t chunkIndex,
+                      const std::shared_ptr<const Chunk> &searchedChunk,
+                      const std::shared_ptr<const Chunk> &foldedChunk,
+                      const std::vector<Match> &matches);
+    void removeResults(const QSet<PlaylistFilterProxyModel *> &proxies);
+    // merges results sorted by rank into m_results, keeping the best MaxResults
+    void mergeResults(const std::vector<Result> &results);
+    void clearResults();
+    void finishIfDone();
+    void setSearching(bool searching);
+    // the PlaylistModel row of the result, -1 when the item or playlist is gone,
+    // or the item is not in the PlaylistModel yet
+    int modelRow(const Result &result) const;
+    const DetachedItem *detachedItem(const Result &result) const;
+
+    // reads the m3u entries of chunk into its entries, folds the keys not folded yet
+    static void prepareChunk(Chunk &chunk, PlaylistSearchIndex::Field field);
+    static int score(const QString &key, const QStringList &tokens, PlaylistSearchIndex::Mode mode);
+    static bool ranksBefore(const Result &a, const Result &b);
+
+    PlaylistMultiProxiesModel *m_playlists{nullptr};
+
+    QString m_searchText;
+    QStringList m_searchTokens;
+    PlaylistSearchIndex::Mode m_searchMode{PlaylistSearchIndex::Mode::Substring};
+    PlaylistSearchIndex::Field m_searchField{PlaylistSearchIndex::Field::Name};
+    // bumped by every search, results of older searches are dropped
+    quint64 m_generation{0};
+    TaskToken m_tasks;
+    int m_pendingChunks{0};
+    // playlists that were not loaded, searched when their store file is read
+    QSet<PlaylistFilterProxyModel *> m_pendingReads;
+    // store files being read, not cancelled by a new search
+    QSet<PlaylistFilterProxyModel *> m_reads;
+    TaskToken m_readTasks;
+    bool m_searching{false};
+    QElapsedTimer m_searchTimer;
+    qsizetype m_searchedItems{0};
+
+    QHash<PlaylistFilterProxyModel *, Corpus> m_corpora;
+    // best first
+    std::vector<Result> m_results;
+};
+
+#endif // PLAYLISTGLOBALSEARCHMODEL_H
@@ -7,17 +7,22 @@
 #include "playlistmodel.h"
 
 #include <QCollator>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
 #include <QDirIterator>
 #include <QFile>
 #include <QFileInfo>
 #include <QJsonArray>
+#include <QScopedValueRollback>
 
 #include <KFileMetaData/ExtractorCollection>
 #include <KFileMetaData/SimpleExtractionResult>
 
-#include <random>
+#include <algorithm>
 
 #include "generalsettings.h"
+#include "m3ureader.h"
 #include "miscutils.h"
 #include "playlistsettings.h"
 #include "playlisttypes.h"
@@ -25,18 +30,56 @@
 
 using namespace Qt::StringLiterals;
 
-PlaylistModel::PlaylistModel(QObject *parent)
-    : QAbstractListModel(parent)
+namespace
+{
+// m3u entries turned into items per fetchMore()
+constexpr qsizetype M3uFetchSize = 1000;
+// the last played file is written this long after the playing item changed
+constexpr int SettingsSaveDelay = 2000;
+} // namespace
+
+void PlaylistItem::setUrl(const QUrl &url)
 {
-    if (PlaylistSettings::randomPlayback()) {
-        shuffleIndexes();
+    location = url.toString();
+    flags = 0;
+    if (url.isLocalFile()) {
+        flags |= LocalFile;
+    } else if (url.scheme().startsWith(QStringLiteral("http"))) {
+        flags |= Http;
+        const auto host = url.host();
+        if (host.endsWith(QStringLiteral("youtube.com")) || host.endsWith(QStringLiteral("youtu.be"))) {
+            flags |= YouTube;
+        }
     }
+}
 
+PlaylistModel::PlaylistModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
     connect(PlaylistSettings::self(), &PlaylistSettings::RandomPlaybackChanged, this, [this]() {
         if (PlaylistSettings::randomPlayback()) {
             shuffleIndexes();
         }
     });
+    // roughly one frame, changed items are sent to the views at most this often
+    m_changesTimer.setInterval(16);
+    m_changesTimer.setSingleShot(true);
+    connect(&m_changesTimer, &QTimer::timeout, this, &PlaylistModel::flushChanges);
+
+    // saving the settings writes the config file on the gui thread,
+    // it's kept out of the switch to the next item
+    m_settingsSaveTimer.setInterval(SettingsSaveDelay);
+    m_settingsSaveTimer.setSingleShot(true);
+    connect(&m_settingsSaveTimer, &QTimer::timeout, this, []() {
+        GeneralSettings::self()->save();
+    });
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, [this]() {
+        if (m_settingsSaveTimer.isActive()) {
+            m_settingsSaveTimer.stop();
+            GeneralSettings::self()->save();
+        }
+    });
+
     connect(this, &PlaylistModel::itemAdded, this, &PlaylistModel::getMetaData, Qt::QueuedConnection);
     connect(this, &PlaylistModel::metaDataReady, this, &PlaylistModel::onMetaDataReady, Qt::QueuedConnection);
     connect(&youtube, &YouTube::playlistRetrieved, this, &PlaylistModel::addYouTubePlaylist);
@@ -46,14 +89,16 @@ PlaylistModel::PlaylistModel(QObject *parent)
 
 PlaylistModel::~PlaylistModel()
 {
-    m_threadPool.clear();
-    m_threadPool.waitForDone();
+    m_metaDataTasks.cancelAndWait();
+    if (m_settingsSaveTimer.isActive()) {
+        GeneralSettings::self()->save();
+    }
 }
 
 int PlaylistModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent)
-    return m_playlist.size();
+    return m_playlist.size() - m_removalGapSize;
 }
 
 QVariant PlaylistModel::data(const QModelIndex &index, int role) const
@@ -62,22 +107,32 @@ QVariant PlaylistModel::data(const QModelIndex &index, int role) const
         return QVariant();
     }
 
-    auto item = m_playlist.at(index.row());
+    // rows after the gap of a removal in progress are stored after it, see removeItems()
+    const int row = index.row() < m_removalGapBegin ? index.row() : index.row() + m_removalGapSize;
+    const auto &item = m_playlist[row];
     switch (role) {
     case NameRole:
         return QVariant(item.filename);
     case TitleRole:
         return item.mediaTitle.isEmpty() ? QVariant(item.filename) : QVariant(item.mediaTitle);
     case PathRole:
-        return QVariant(item.url.toString());
+        return QVariant(item.location);
     case DurationRole:
-        return QVariant(item.formattedDuration);
+        return item.duration > 0 ? QVariant(MiscUtils::formatTime(item.duration)) : QVariant(QString());
     case PlayingRole:
         return QVariant(static_cast<int>(m_playingItem) == index.row() && m_isPlaying);
     case FolderPathRole:
         return QVariant(item.folderPath);
     case IsLocalRole:
-        return QVariant(!item.url.scheme().startsWith(QStringLiteral("http")));
+        return QVariant(!(item.flags & PlaylistItem::Http));
+    case DurationValueRole:
+        return QVariant(item.duration);
+    case LastModifiedRole:
+        return QVariant(item.lastModified);
+    case FileSizeRole:
+        return QVariant(item.fileSize);
+    case TrackNumberRole:
+        return QVariant(item.trackNumber);
     }
 
     return QVariant();
@@ -95,20 +150,53 @@ QHash<int, QByteArray> PlaylistModel::roleNames() const
         {PlayingRole,    QByteArrayLiteral("isPlaying")},
         {IsLocalRole,    QByteArrayLiteral("isLocal")},
         {IsSelectedRole, QByteArrayLiteral("isSelected")},
+        {DurationValueRole, QByteArrayLiteral("durationValue")},
+        {LastModifiedRole,  QByteArrayLiteral("lastModified")},
+        {FileSizeRole,      QByteArrayLiteral("fileSize")},
+        {TrackNumberRole,   QByteArrayLiteral("trackNumber")},
     };
     // clang-format on
 
     return roles;
 }
 
+bool PlaylistModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && m_m3u != nullptr;
+}
+
+void PlaylistModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid()) {
+        return;
+    }
+    QScopedValueRollback existing(m_insertingExisting, true);
+    fetchM3uItems(M3uFetchSize);
+}
+
+void PlaylistModel::fetchAll()
+{
+    if (m_m3u) {
+        QScopedValueRollback existing(m_insertingExisting, true);
+        fetchM3uItems(m_m3u->count() - m_m3uNext);
+    }
+}
+
 void PlaylistModel::clear()
 {
-    m_threadPool.clear();
+    m_metaDataTasks.cancel();
+    discardChanges();
 
     m_playlistPath = QString();
     m_playingItem = -1;
+    m_m3u.reset();
+    m_m3uNext = 0;
     beginResetModel();
     m_playlist.clear();
+    m_shuffleQueue.clear();
+    m_folders.clear();
+    m_idsByLocation.clear();
+    m_rowsById.clear();
     endResetModel();
 }
 
@@ -143,8 +231,7 @@ void PlaylistModel::addItem(const QUrl &url, Behavior behavior)
                 appendItem(url);
             }
             if (behavior == Behavior::AppendAndPlay) {
-                appendItem(url);
-                setPlayingItem(m_playlist.size() - 1);
+                setPlayingItem(appendItem(url));
             }
 
             return;
@@ -163,8 +250,7 @@ void PlaylistModel::addItem(const QUrl &url, Behavior behavior)
                 appendItem(url);
             }
             if (behavior == Behavior::AppendAndPlay) {
-                appendItem(url);
-                setPlayingItem(m_playlist.size() - 1);
+                setPlayingItem(appendItem(url));
             }
         }
     }
@@ -173,52 +259,123 @@ void PlaylistModel::addItem(const QUrl &url, Behavior behavior)
 void PlaylistModel::stop()
 {
     m_isPlaying = false;
-    Q_EMIT dataChanged(index(m_playingItem, 0), index(m_playingItem, 0));
+    Q_EMIT dataChanged(index(m_playingItem, 0), index(m_playingItem, 0), {PlayingRole});
 }
 
-void PlaylistModel::appendItem(const QUrl &url)
+int PlaylistModel::appendItem(const QUrl &url)
 {
+    if (PlaylistSettings::skipDuplicates()) {
+        const int row = rowOfLocation(url);
+        if (row >= 0) {
+            return row;
+        }
+    }
+
     PlaylistItem item;
     QFileInfo itemInfo(url.toLocalFile());
-    auto row{m_playlist.size()};
     if (itemInfo.exists() && itemInfo.isFile()) {
-        item.url = url;
+        item.setUrl(url);
         item.filename = itemInfo.fileName();
-        item.folderPath = itemInfo.absolutePath();
+        item.folderPath = internFolder(itemInfo.absolutePath());
+        item.fileSize = itemInfo.size();
+        item.lastModified = itemInfo.lastModified().toMSecsSinceEpoch();
     } else {
         if (url.scheme().startsWith(QStringLiteral("http"))) {
-            item.url = url;
-            item.filename = url.toString();
-            // causes issues with lots of links
-            if (m_httpItemCounter < 20) {
-                QVariantMap data{{QStringLiteral("row"), QVariant::fromValue(row)}};
-                youtube.getVideoInfo(url, data);
-                ++m_httpItemCounter;
-            }
+            item.setUrl(url);
+            item.filename = item.location;
         }
     }
 
-    if (item.url.isEmpty()) {
-        return;
+    if (item.location.isEmpty()) {
+        return -1;
     }
 
-    beginInsertRows(QModelIndex(), m_playlist.size(), m_playlist.size());
+    item.id = m_nextId++;
+
+    if (item.flags & PlaylistItem::Http) {
+        QVariantMap data{{QStringLiteral("id"), QVariant::fromValue(item.id)}};
+        youtube.getVideoInfo(url, data);
+    }
+
+    const int row = m_playlist.size();
+    beginInsertRows(QModelIndex(), row, row);
 
     m_playlist.push_back(item);
-    Q_EMIT itemAdded(row, item.url.toString(), m_playlistName);
+    m_shuffleQueue.insert(item.id);
+    indexItem(row);
+    Q_EMIT itemAdded(item.id, item.location, m_playlistName);
 
     endInsertRows();
 
-    if (PlaylistSettings::randomPlayback()) {
-        shuffleIndexes();
-    }
+    return row;
 }
 
-void PlaylistModel::removeItem(const uint row)
+void PlaylistModel::removeItems(std::vector<int> rows)
 {
-    beginRemoveRows(QModelIndex(), row, row);
-    m_playlist.erase(m_playlist.begin() + row);
-    endRemoveRows();
+    const int size = rowCount();
+    rows.erase(std::remove_if(rows.begin(),
+                              rows.end(),
+                              [size](int row) {
+                                  return row < 0 || row >= size;
+                              }),
+               rows.end());
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    if (rows.empty()) {
+        return;
+    }
+
+    // pending changes are stored by row, send them before the rows shift
+    flushChanges();
+
+    Q_EMIT itemsAboutToBeRemoved(rows);
+    int removedAbovePlaying{0};
+    for (const int row : rows) {
+        const auto &item = m_playlist[row];
+        m_shuffleQueue.remove(item.id);
+        m_idsByLocation.remove(locationKey(QUrl(item.location)), item.id);
+        m_rowsById.remove(item.id);
+        if (row < static_cast<int>(m_playingItem)) {
+            ++removedAbovePlaying;
+        }
+    }
+
+    // the standard signals, one contiguous range at a time, the last range first;
+    // the removed items are collected in a gap that moves down, so rows keep their
+    // data between the signals and every kept item is moved at most twice
+    std::size_t gapEnd = m_playlist.size();
+    std::size_t gapBegin = gapEnd;
+    std::size_t next = rows.size();
+    while (next > 0) {
+        const int last = rows[--next];
+        int first = last;
+        while (next > 0 && rows[next - 1] == first - 1) {
+            first = rows[--next];
+        }
+
+        beginRemoveRows(QModelIndex(), first, last);
+        if (gapBegin == gapEnd) {
+            gapEnd = last + 1;
+        } else {
+            // the items between this range and the gap go right before the gap's end
+            std::move_backward(m_playlist.begin() + last + 1, m_playlist.begin() + gapBegin, m_playlist.begin() + gapEnd);
+            gapEnd -= gapBegin - (last + 1);
+        }
+        gapBegin = first;
+        m_removalGapBegin = first;
+        m_removalGapSize = static_cast<int>(gapEnd - gapBegin);
+        endRemoveRows();
+    }
+    m_playlist.erase(m_playlist.begin() + gapBegin, m_playlist.begin() + gapEnd);
+    m_removalGapBegin = std::numeric_limits<int>::max();
+    m_removalGapSize = 0;
+
+    // only the items after the first removed row moved
+    for (int row = rows.front(); row < static_cast<int>(m_playlist.size()); ++row) {
+        m_rowsById[m_playlist[row].id] = row;
+    }
+    m_playingItem -= removedAbovePlaying;
+    Q_EMIT itemsRemoved(rows);
 }
 
 void PlaylistModel::getSiblingItems(const QUrl &url)
@@ -247,30 +404,26 @@ void PlaylistModel::getSiblingItems(const QUrl &url)
     collator.setNumericMode(true);
     std::sort(siblingFiles.begin(), siblingFiles.end(), collator);
 
-    uint playingItem{0};
     beginInsertRows(QModelIndex(), 0, siblingFiles.count() - 1);
     for (const auto &file : siblingFiles) {
         QFileInfo fileInfo(file);
         auto fileUrl = QUrl::fromLocalFile(file);
         PlaylistItem item;
-        item.url = fileUrl;
+        item.setUrl(fileUrl);
         item.filename = fileInfo.fileName();
-        item.folderPath = fileInfo.absolutePath();
+        item.folderPath = internFolder(fileInfo.absolutePath());
+        item.fileSize = fileInfo.size();
+        item.lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+        item.id = m_nextId++;
         m_playlist.push_back(item);
-        // in flatpak the file dialog gives a percent encoded path
-        // use toLocalFile to normalize the urls
-        if (url.toLocalFile() == fileUrl.toLocalFile()) {
-            playingItem = m_playlist.size() - 1;
-        }
-        Q_EMIT itemAdded(m_playlist.size() - 1, item.url.toString(), m_playlistName);
+        m_shuffleQueue.insert(item.id);
+        indexItem(m_playlist.size() - 1);
+        Q_EMIT itemAdded(item.id, item.location, m_playlistName);
     }
     endInsertRows();
+    Q_EMIT folderLoaded(openedFileInfo.absolutePath(), false);
 
-    setPlayingItem(playingItem);
-
-    if (PlaylistSettings::randomPlayback()) {
-        shuffleIndexes();
-    }
+    setPlayingItem(std::max(rowOfLocation(url), 0));
 }
 
 void PlaylistModel::addM3uItems(const QUrl &url, Behavior behavior)
@@ -279,102 +432,242 @@ void PlaylistModel::addM3uItems(const QUrl &url, Behavior behavior)
         return;
     }
 
-    QFile m3uFile(url.toString(QUrl::PreferLocalFile));
-    if (!m3uFile.open(QFile::ReadOnly)) {
+    // only one file is read lazily at a time
+    fetchAll();
+
+    auto m3u = std::make_unique<M3uReader>();
+    if (!m3u->open(url.toString(QUrl::PreferLocalFile))) {
         qDebug() << "can't open playlist file";
         return;
     }
 
-    uint playingItem{0};
-    int i{0};
-    bool matchFound{false};
-    while (!m3uFile.atEnd()) {
-        QByteArray line = QByteArray::fromPercentEncoding(m3uFile.readLine().simplified());
-        // ignore comments
-        if (line.startsWith("#")) {
+    const auto lastPlayedUrl = QUrl::fromUserInput(GeneralSettings::lastPlayedFile());
+    qsizetype playingEntry{-1};
+    if (behavior == Behavior::Clear) {
+        playingEntry = m3u->indexOf(lastPlayedUrl);
+    }
+    m_m3u = std::move(m3u);
+    m_m3uNext = 0;
+
+    if (behavior == Behavior::Insert) {
+        // rows are inserted at the requested position only once,
+        // the items of the file are kept together
+        fetchM3uItems(m_m3u->count());
+    } else {
+        // the first batch, plus the entries up to the one that was playing
+        fetchM3uItems(std::max(M3uFetchSize, playingEntry + 1));
+    }
+
+    if (behavior == Behavior::Clear) {
+        setPlayingItem(std::max(rowOfLocation(lastPlayedUrl), 0));
+    }
+}
+
+void PlaylistModel::fetchM3uItems(qsizetype count)
+{
+    if (!m_m3u) {
+        return;
+    }
+    const auto m3uLastModified = m_m3u->lastModified();
+    auto items = readM3uItems(count);
+    if (items.empty()) {
+        return;
+    }
+
+    const auto first = m_playlist.size();
+    beginInsertRows(QModelIndex(), first, first + items.size() - 1);
+    m_playlist.reserve(first + items.size());
+    for (auto &item : items) {
+        m_shuffleQueue.insert(item.id);
+        m_playlist.push_back(std::move(item));
+        indexItem(m_playlist.size() - 1);
+    }
+    endInsertRows();
+
+    for (auto row = first; row < m_playlist.size(); ++row) {
+        const auto &item = m_playlist[row];
+        if (item.flags & PlaylistItem::LocalFile) {
+            if (item.duration > 0) {
+                // the #EXTINF line has the metadata, unless the file changed after the m3u file was written
+                getChangedMetaData(item.id, item.location, m3uLastModified);
+            } else {
+                Q_EMIT itemAdded(item.id, item.location, m_playlistName);
+            }
+        } else if ((item.flags & PlaylistItem::Http) && item.duration <= 0) {
+            QVariantMap data{{QStringLiteral("id"), QVariant::fromValue(item.id)}};
+            youtube.getVideoInfo(item.url(), data);
+        }
+    }
+}
+
+std::vector<PlaylistItem> PlaylistModel::takeUnfetchedM3uItems()
+{
+    if (!m_m3u) {
+        return {};
+    }
+    return readM3uItems(m_m3u->count() - m_m3uNext);
+}
+
+void PlaylistModel::readFileInfo()
+{
+    for (int row = 0; row < static_cast<int>(m_playlist.size()); ++row) {
+        auto &item = m_playlist[row];
+        if (!(item.flags & PlaylistItem::LocalFile) || item.lastModified > 0 || item.fileSize > 0) {
             continue;
         }
+        const QFileInfo fileInfo(item.url().toLocalFile());
+        if (!fileInfo.isFile()) {
+            continue;
+        }
+        item.fileSize = fileInfo.size();
+        item.lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+        markItemChanged(row, {FileSizeRole, LastModifiedRole});
+    }
+}
 
-        // always set the working directory
-        // it doesn't affect absolute paths and it's required for relative paths
-        auto url = QUrl::fromUserInput(QString::fromUtf8(line), QFileInfo(m3uFile).absolutePath());
-        addItem(url, Behavior::Append);
+std::vector<PlaylistItem> PlaylistModel::readM3uItems(qsizetype count)
+{
+    const auto last = std::min(m_m3uNext + count, m_m3u->count());
+    const bool skipDuplicates = PlaylistSettings::skipDuplicates();
+    std::vector<PlaylistItem> items;
+    items.reserve(last - m_m3uNext);
+    QSet<QString> batchLocations;
+    for (; m_m3uNext < last; ++m_m3uNext) {
+        const auto url = m_m3u->url(m_m3uNext);
+        if (!url.isValid() || url.isEmpty()) {
+            continue;
+        }
 
-        if (!matchFound && url == QUrl::fromUserInput(GeneralSettings::lastPlayedFile())) {
-            playingItem = i;
-            matchFound = true;
+        PlaylistItem item;
+        item.setUrl(url);
+        if (skipDuplicates) {
+            const auto key = locationKey(url);
+            if (rowOfLocation(url) >= 0 || batchLocations.contains(key)) {
+                continue;
+            }
+            batchLocations.insert(key);
         }
-        ++i;
+        if (item.flags & PlaylistItem::LocalFile) {
+            // QFileInfo only splits the path here, the file isn't looked at
+            const QFileInfo fileInfo(url.toLocalFile());
+            item.filename = fileInfo.fileName();
+            item.folderPath = internFolder(fileInfo.absolutePath());
+        } else {
+            item.filename = item.location;
+        }
+        double duration{0.0};
+        QString title;
+        if (m_m3u->extinf(m_m3uNext, &duration, &title)) {
+            item.duration = duration;
+            item.mediaTitle = title;
+            if ((item.flags & PlaylistItem::Http) && !title.isEmpty()) {
+                // same as the info from yt-dlp, see updateFileInfo()
+                item.filename = title;
+            }
+        }
+        items.push_back(std::move(item));
+    }
+    if (m_m3uNext >= m_m3u->count()) {
+        m_m3u.reset();
+        m_m3uNext = 0;
     }
-    m3uFile.close();
+    for (auto &item : items) {
+        item.id = m_nextId++;
+    }
+    return items;
+}
 
-    if (behavior == Behavior::Clear) {
-        setPlayingItem(playingItem);
+void PlaylistModel::restoreItems(std::vector<PlaylistItem> items)
+{
+    if (items.empty()) {
+        return;
     }
 
-    if (PlaylistSettings::randomPlayback()) {
-        shuffleIndexes();
+    // the stored items already have their metadata, no need to look at the files
+    const auto first = m_playlist.size();
+    QScopedValueRollback existing(m_insertingExisting, true);
+    beginInsertRows(QModelIndex(), first, first + items.size() - 1);
+    m_playlist.reserve(first + items.size());
+    for (auto &item : items) {
+        m_nextId = std::max(m_nextId, item.id + 1);
+        m_shuffleQueue.insert(item.id);
+        item.folderPath = internFolder(item.folderPath);
+        m_playlist.push_back(std::move(item));
+        indexItem(m_playlist.size() - 1);
+    }
+    endInsertRows();
+
+    // except for items that were saved before their metadata was read
+    for (auto row = first; row < m_playlist.size(); ++row) {
+        const auto &item = m_playlist[row];
+        if (item.duration <= 0 && (item.flags & PlaylistItem::LocalFile)) {
+            Q_EMIT itemAdded(item.id, item.location, m_playlistName);
+        }
     }
 }
 
 void PlaylistModel::addYouTubePlaylist(QJsonArray playlist, const QString &videoId, const QString &playlistId)
 {
-    bool matchFound{false};
+    int playingRow{-1};
     for (int i = 0; i < playlist.size(); ++i) {
         auto id = playlist[i][QStringLiteral("id")].toString();
         auto url = QStringLiteral("https://www.youtube.com/watch?v=%1&list=%2").arg(id, playlistId);
         auto title = playlist[i][QStringLiteral("title")].toString();
         auto duration = playlist[i][QStringLiteral("duration")].toDouble();
 
-        PlaylistItem item;
-        item.url = QUrl::fromUserInput(url);
-        item.filename = !title.isEmpty() ? title : url;
-        item.mediaTitle = !title.isEmpty() ? title : url;
-        item.formattedDuration = MiscUtils::formatTime(duration);
-        item.duration = duration;
-
-        beginInsertRows(QModelIndex(), m_playlist.size(), m_playlist.size());
-        m_playlist.push_back(item);
-        Q_EMIT itemAdded(i, item.url.toString(), m_playlistName);
-        endInsertRows();
+        const auto itemUrl = QUrl::fromUserInput(url);
+        int row = PlaylistSettings::skipDuplicates() ? rowOfLocation(itemUrl) : -1;
+        if (row < 0) {
+            PlaylistItem item;
+            item.setUrl(itemUrl);
+            item.filename = !title.isEmpty() ? title : url;
+            item.mediaTitle = !title.isEmpty() ? title : url;
+            item.duration = duration;
+            item.id = m_nextId++;
+
+            row = m_playlist.size();
+            beginInsertRows(QModelIndex(), row, row);
+            m_playlist.push_back(item);
+            m_shuffleQueue.insert(item.id);
+            indexItem(row);
+            Q_EMIT itemAdded(item.id, item.location, m_playlistName);
+            endInsertRows();
+        }
 
+        if (playingRow >= 0) {
+            continue;
+        }
         if (videoId.isEmpty()) {
             // when videoId is not available check if GeneralSettings::lastPlayedFile()
             // is part of the playlist and set the matching item as playing
-            if (GeneralSettings::lastPlayedFile().contains(id) && !matchFound) {
-                setPlayingItem(i);
-                matchFound = true;
+            if (GeneralSettings::lastPlayedFile().contains(id)) {
+                playingRow = row;
             }
         } else {
             // when videoId is available set the item with the same id as playing
-            if (videoId == id && !matchFound) {
-                setPlayingItem(i);
-                matchFound = true;
+            if (videoId == id) {
+                playingRow = row;
             }
         }
     }
 
-    if (!matchFound) {
-        setPlayingItem(0);
-    }
+    setPlayingItem(std::max(playingRow, 0));
 }
 
 void PlaylistModel::updateFileInfo(YTVideoInfo info, QVariantMap data)
 {
-    const auto row = data.value(QStringLiteral("row")).toUInt();
-    const auto item{m_playlist[row]};
-    if (info.url != item.url) {
+    // the item may have moved or been removed while yt-dlp was running,
+    // the title is empty when yt-dlp failed, the item keeps its url as name
+    const int row = rowOfId(data.value(QStringLiteral("id")).toUInt());
+    if (row < 0 || info.mediaTitle.isEmpty()) {
         return;
     }
 
     m_playlist[row].mediaTitle = info.mediaTitle;
     m_playlist[row].filename = info.mediaTitle;
-    m_playlist[row].formattedDuration = MiscUtils::formatTime(info.duration);
     m_playlist[row].duration = info.duration;
 
-    --m_httpItemCounter;
-
-    Q_EMIT dataChanged(index(row, 0), index(row, 0));
+    markItemChanged(row, {NameRole, TitleRole, DurationRole, DurationValueRole});
 }
 
 bool PlaylistModel::isVideoOrAudioMimeType(const QString &mimeType)
@@ -387,6 +680,16 @@ bool PlaylistModel::isVideoOrAudioMimeType(const QString &mimeType)
     // clang-format on
 }
 
+QString PlaylistModel::internFolder(const QString &folder)
+{
+    auto it = m_folders.constFind(folder);
+    if (it != m_folders.cend()) {
+        return *it;
+    }
+    m_folders.insert(folder);
+    return folder;
+}
+
 void PlaylistModel::setPlayingItem(uint i)
 {
     if (i >= m_playlist.size()) {
@@ -396,103 +699,213 @@ void PlaylistModel::setPlayingItem(uint i)
     uint previousItem{m_playingItem};
     m_playingItem = i;
     m_isPlaying = true;
-    Q_EMIT dataChanged(index(previousItem, 0), index(previousItem, 0));
-    Q_EMIT dataChanged(index(i, 0), index(i, 0));
+    m_shuffleQueue.setCurrent(m_playlist[i].id);
+    Q_EMIT dataChanged(index(previousItem, 0), index(previousItem, 0), {PlayingRole});
+    Q_EMIT dataChanged(index(i, 0), index(i, 0), {PlayingRole});
 
     Q_EMIT playingItemChanged(m_playlistName);
 
-    GeneralSettings::setLastPlayedFile(m_playlist[i].url.toString());
+    GeneralSettings::setLastPlayedFile(m_playlist[i].location);
     GeneralSettings::setLastPlaylist(m_playlistPath);
-    GeneralSettings::self()->save();
+    m_settingsSaveTimer.start();
 }
 
-void PlaylistModel::getMetaData(uint i, const QString &path)
+void PlaylistModel::getMetaData(quint32 id, const QString &path)
 {
-    m_threadPool.start([this, i, path]() {
-        using namespace KFileMetaData;
+    auto url = QUrl::fromUserInput(path);
+    if (url.scheme() != QStringLiteral("file")) {
+        return;
+    }
+    const auto scheduler = TaskScheduler::instance();
+    const auto disk = TaskScheduler::diskKey(url.toLocalFile());
+    scheduler->submit(TaskScheduler::Lane::VisibleMetadata, TaskScheduler::Resource::Disk, disk, m_metaDataTasks, [this, id, url]() {
+        extractMetaData(id, url);
+    });
+}
 
-        auto url = QUrl::fromUserInput(path);
-        if (url.scheme() != QStringLiteral("file")) {
+void PlaylistModel::getChangedMetaData(quint32 id, const QString &path, qint64 unchangedSince)
+{
+    auto url = QUrl::fromUserInput(path);
+    if (url.scheme() != QStringLiteral("file")) {
+        return;
+    }
+    // checking the files of a restored playlist is not something the user waits for
+    const auto scheduler = TaskScheduler::instance();
+    const auto disk = TaskScheduler::diskKey(url.toLocalFile());
+    scheduler->submit(TaskScheduler::Lane::Background, TaskScheduler::Resource::Disk, disk, m_metaDataTasks, [this, id, url, unchangedSince]() {
+        const QFileInfo fileInfo(url.toLocalFile());
+        if (!fileInfo.exists() || fileInfo.lastModified().toMSecsSinceEpoch() <= unchangedSince) {
             return;
         }
+        extractMetaData(id, url);
+    });
+}
 
-        QString mimeType = MiscUtils::mimeType(url);
-        ExtractorCollection exCol;
-        QList<Extractor *> extractors = exCol.fetchExtractors(mimeType);
-        SimpleExtractionResult result(url.toLocalFile(), mimeType, ExtractionResult::ExtractMetaData);
+void PlaylistModel::extractMetaData(quint32 id, const QUrl &url)
+{
+    using namespace KFileMetaData;
 
-        if (extractors.isEmpty()) {
-            return;
-        }
+    QString mimeType = MiscUtils::mimeType(url);
+    ExtractorCollection exCol;
+    QList<Extractor *> extractors = exCol.fetchExtractors(mimeType);
+    SimpleExtractionResult result(url.toLocalFile(), mimeType, ExtractionResult::ExtractMetaData);
+
+    if (extractors.isEmpty()) {
+        return;
+    }
 
-        Extractor *ex = extractors.first();
-        ex->extract(&result);
+    Extractor *ex = extractors.first();
+    ex->extract(&result);
 
-        Q_EMIT metaDataReady(i, url, result.properties());
-    });
+    Q_EMIT metaDataReady(id, url, result.properties());
 }
 
-void PlaylistModel::onMetaDataReady(uint i, const QUrl &url, KFileMetaData::PropertyMultiMap properties)
+void PlaylistModel::onMetaDataReady(quint32 id, const QUrl &url, KFileMetaData::PropertyMultiMap properties)
 {
-    if (m_playlist.empty() || static_cast<uint>(i) >= m_playlist.size()) {
+    // rows shift while the thread pool works, the item is looked up by its id;
+    // it's gone when it was removed and the data is stale when it was renamed
+    const int row = rowOfId(id);
+    if (row < 0 || m_playlist[row].location != url.toString()) {
         return;
     }
 
-    if (m_playlist[i].url == url) {
-        auto duration = properties.value(KFileMetaData::Property::Duration).toInt();
-        auto title = properties.value(KFileMetaData::Property::Title).toString();
+    auto duration = properties.value(KFileMetaData::Property::Duration).toInt();
+    auto title = properties.value(KFileMetaData::Property::Title).toString();
+    auto trackNumber = properties.value(KFileMetaData::Property::TrackNumber).toInt();
 
-        m_playlist[i].formattedDuration = MiscUtils::formatTime(duration);
-        m_playlist[i].duration = duration;
-        m_playlist[i].mediaTitle = title;
+    m_playlist[row].duration = duration;
+    m_playlist[row].mediaTitle = title;
+    m_playlist[row].trackNumber = trackNumber;
 
-        Q_EMIT dataChanged(index(i, 0), index(i, 0));
-    } else {
-        qDebug() << "\n"
-                 << QStringLiteral("Data mismatch: the url at position %1 received from the threadpool:").arg(i) << "\n"
-                 << QStringLiteral("%1").arg(url.toString()) << "\n"
-                 << QStringLiteral("is different than the url in m_playlist at position %2").arg(i) << "\n"
-                 << QStringLiteral("%1").arg(m_playlist[i].url.toString());
+    markItemChanged(row, {TitleRole, DurationRole, DurationValueRole, TrackNumberRole});
+}
+
+void PlaylistModel::markItemChanged(int row, const QList<int> &roles)
+{
+    if (row < 0 || row >= static_cast<int>(m_playlist.size())) {
+        return;
+    }
+
+    quint32 &mask = m_pendingChanges[row];
+    for (const auto role : roles) {
+        mask |= 1u << (role - NameRole);
+    }
+
+    if (!m_changesTimer.isActive()) {
+        m_changesTimer.start();
     }
 }
 
-void PlaylistModel::shuffleIndexes(std::vector<int> includedIndices)
+void PlaylistModel::flushChanges()
 {
-    if (m_playlist.size() <= 0) {
+    m_changesTimer.stop();
+    if (m_pendingChanges.isEmpty()) {
         return;
     }
-    m_currentShuffledIndex = 0;
-    if (includedIndices.empty()) {
-        // All indices are included, no filtering
-        m_shuffledIndexes.resize(m_playlist.size());
-        std::iota(m_shuffledIndexes.begin(), m_shuffledIndexes.end(), 0);
-    } else {
-        m_shuffledIndexes = includedIndices;
+
+    auto rows = m_pendingChanges.keys();
+    std::sort(rows.begin(), rows.end());
+
+    auto emitRange = [this](int first, int last, quint32 mask) {
+        QList<int> roles;
+        for (int bit = 0; mask != 0; ++bit, mask >>= 1) {
+            if (mask & 1u) {
+                roles.append(NameRole + bit);
+            }
+        }
+        Q_EMIT dataChanged(index(first, 0), index(last, 0), roles);
+    };
+
+    // merge adjacent rows into a single range, the range gets the union of their roles
+    int first = rows.first();
+    int last = first;
+    quint32 mask = m_pendingChanges.value(first);
+    for (qsizetype i = 1; i < rows.size(); ++i) {
+        const int row = rows.at(i);
+        if (row == last + 1) {
+            last = row;
+            mask |= m_pendingChanges.value(row);
+            continue;
+        }
+        emitRange(first, last, mask);
+        first = row;
+        last = row;
+        mask = m_pendingChanges.value(row);
     }
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::shuffle(m_shuffledIndexes.begin(), m_shuffledIndexes.end(), gen);
+    emitRange(first, last, mask);
+
+    m_pendingChanges.clear();
+}
 
-    // Move current item to start
-    auto it = std::find(m_shuffledIndexes.begin(), m_shuffledIndexes.end(), m_playingItem);
-    if (it != m_shuffledIndexes.end()) {
-        std::rotate(m_shuffledIndexes.begin(), it, it + 1);
+void PlaylistModel::discardChanges()
+{
+    m_changesTimer.stop();
+    m_pendingChanges.clear();
+}
+
+void PlaylistModel::shuffleIndexes()
+{
+    // the items not fetched yet would never be played
+    fetchAll();
+
+    std::vector<quint32> ids;
+    ids.reserve(m_playlist.size());
+    for (const auto &item : m_playlist) {
+        ids.push_back(item.id);
     }
+    const auto playingId = m_playingItem < m_playlist.size() ? m_playlist[m_playingItem].id : ShuffleQueue::NoId;
+    m_shuffleQueue.reset(std::move(ids), playingId);
 }
 
-std::vector<int> PlaylistModel::shuffledIndexes() const
+int PlaylistModel::rowOfId(quint32 id) const
 {
-    return m_shuffledIndexes;
+    return m_rowsById.value(id, -1);
 }
 
-int PlaylistModel::currentShuffledIndex() const
+std::vector<int> PlaylistModel::rowsOfLocation(const QUrl &url) const
 {
-    return m_currentShuffledIndex;
+    std::vector<int> rows;
+    const auto ids = m_idsByLocation.values(locationKey(url));
+    rows.reserve(ids.size());
+    for (const auto id : ids) {
+        const int row = rowOfId(id);
+        if (row >= 0) {
+            rows.push_back(row);
+        }
+    }
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+
+int PlaylistModel::rowOfLocation(const QUrl &url) const
+{
+    const auto rows = rowsOfLocation(url);
+    return rows.empty() ? -1 : rows.front();
+}
+
+void PlaylistModel::setItemUrl(int row, const QUrl &url)
+{
+    auto &item = m_playlist[row];
+    m_idsByLocation.remove(locationKey(QUrl(item.location)), item.id);
+    item.setUrl(url);
+    m_idsByLocation.insert(locationKey(url), item.id);
+}
+
+QString PlaylistModel::locationKey(const QUrl &url)
+{
+    if (url.isLocalFile()) {
+        // in flatpak the file dialog gives a percent encoded path,
+        // toLocalFile decodes it
+        return QUrl::fromLocalFile(QDir::cleanPath(url.toLocalFile())).toString();
+    }
+    return url.adjusted(QUrl::NormalizePathSegments).toString();
 }
 
-void PlaylistModel::setCurrentShuffledIndex(int shuffledIndex)
+void PlaylistModel::indexItem(int row)
 {
-    m_currentShuffledIndex = shuffledIndex;
+    const auto &item = m_playlist[row];
+    m_idsByLocation.insert(locationKey(QUrl(item.location)), item.id);
+    m_rowsById.insert(item.id, row);
 }
 
 #include "moc_playlistmodel.cpp"
@@ -8,26 +8,77 @@
 #define PLAYLISTMODEL_H
 
 #include <QAbstractListModel>
-#include <QThreadPool>
+#include <QMultiHash>
+#include <QSet>
+#include <QTimer>
 #include <QUrl>
 #include <QtQml/qqmlregistration.h>
 
 #include <kfilemetadata/properties.h>
 
+#include <limits>
+#include <memory>
+#include <vector>
 
+#include "shufflequeue.h"
+#include "taskscheduler.h"
 #include "youtube.h"
 
+class M3uReader;
 struct YTVideoInfo;
 
 struct PlaylistItem {
-    QUrl url;
+    enum Flag : quint8 {
+        LocalFile = 0x1,
+        Http = 0x2,
+        YouTube = 0x4,
+    };
+
+    // the url is kept as a string, parsing it into a QUrl costs more memory
+    // than the string itself and most items never need it
+    QUrl url() const
+    {
+        return QUrl(location);
+    }
+    // sets location and the flags derived from the url
+    void setUrl(const QUrl &url);
+
+    // url.toString()
+    QString location;
     QString filename;
     QString mediaTitle;
+    // shared by the items of the same folder, see PlaylistModel::internFolder()
     QString folderPath;
-    QString formattedDuration;
     double duration{0.0};
+    qint64 fileSize{0};
+    // msecs since epoch
+    qint64 lastModified{0};
+    // stable for the lifetime of the item, unlike its row
+    quint32 id{0};
+    int trackNumber{0};
+    quint8 flags{0};
 };
 
+// removes the elements at rows (ascending, no duplicates), every element moves at most once;
+// rows past the end are ignored, so it works on vectors that only cover a prefix of the playlist
+template<typename T>
+void eraseRows(std::vector<T> &v, const std::vector<int> &rows)
+{
+    auto next = rows.cbegin();
+    if (next == rows.cend() || static_cast<std::size_t>(*next) >= v.size()) {
+        return;
+    }
+    std::size_t write = *next;
+    for (std::size_t read = write; read < v.size(); ++read) {
+        if (next != rows.cend() && static_cast<std::size_t>(*next) == read) {
+            ++next;
+            continue;
+        }
+        v[write++] = std::move(v[read]);
+    }
+    v.erase(v.begin() + write, v.end());
+}
+
 class PlaylistModel : public QAbstractListModel
 {
     Q_OBJECT
@@ -38,8 +89,10 @@ public:
     ~PlaylistModel();
     friend class PlaylistMultiProxiesModel;
     friend class PlaylistFilterProxyModel;
-    friend class PlaylistProxyModel;
-    friend class PlaylistSortProxyModel;
+    friend class PlaylistGlobalSearchModel;
+    friend class PlaylistFolderWatcher;
+    friend class PlaylistSearchIndex;
+    friend class PlaylistStore;
     friend class MpvItem;
 
     enum Roles {
@@ -51,6 +104,11 @@ public:
         PlayingRole,
         IsLocalRole,
         IsSelectedRole,
+        // unformatted values, used for sorting
+        DurationValueRole,
+        LastModifiedRole,
+        FileSizeRole,
+        TrackNumberRole,
     };
     Q_ENUM(Roles)
 
@@ -65,27 +123,71 @@ public:
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
     QHash<int, QByteArray> roleNames() const override;
+    // the items of an m3u file are created in batches, as the view asks for them
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+    // creates the items not fetched yet, for code that needs the whole playlist
+    void fetchAll();
 
     void clear();
     void addItem(const QUrl &url, PlaylistModel::Behavior behavior);
     void stop();
 
 Q_SIGNALS:
-    void itemAdded(uint index, const QString &path, QString playlistName);
+    // id is the PlaylistItem::id, results of async work are routed by it, since rows shift
+    void itemAdded(quint32 id, const QString &path, QString playlistName);
     void playingItemChanged(QString playlistName);
-    void metaDataReady(uint index, const QUrl &url, KFileMetaData::PropertyMultiMap metadata);
+    void metaDataReady(quint32 id, const QUrl &url, KFileMetaData::PropertyMultiMap metadata);
+    // emitted by removeItems() around the rowsAboutToBeRemoved()/rowsRemoved() of each range,
+    // rows are ascending and not shifted; PlaylistFilterProxyModel and PlaylistStore
+    // handle a removal once with these instead of once per range
+    void itemsAboutToBeRemoved(const std::vector<int> &rows);
+    void itemsRemoved(const std::vector<int> &rows);
+    // the media files of folder were added
+    void folderLoaded(const QString &folder, bool recursive);
 
 private:
-    void appendItem(const QUrl &url);
-    void removeItem(const uint row);
+    // returns the row of the item, the row of the item already there when duplicates
+    // are skipped, or -1 when nothing was added
+    int appendItem(const QUrl &url);
+    // removes all the rows with a single pass over the items, rows don't have to be sorted
+    void removeItems(std::vector<int> rows);
     void getSiblingItems(const QUrl &url);
+    // the entries are read lazily, see M3uReader and fetchMore()
     void addM3uItems(const QUrl &url, PlaylistModel::Behavior behavior);
+    // creates the items of the next count m3u entries; the files are not checked,
+    // an entry that isn't playable fails when it's played
+    void fetchM3uItems(qsizetype count);
+    // the items of the next count m3u entries with their ids, without adding them
+    std::vector<PlaylistItem> readM3uItems(qsizetype count);
+    // the items of the m3u entries not fetched yet, for the store of a playlist being
+    // destroyed; they are not added, the model doesn't change
+    std::vector<PlaylistItem> takeUnfetchedM3uItems();
+    // reads the size and modification time of the local files that don't have them yet,
+    // the items of m3u entries; blocks, for sorting by those
+    void readFileInfo();
+    // appends items read from a PlaylistStore, their ids are kept and must not be in use
+    void restoreItems(std::vector<PlaylistItem> items);
     void addYouTubePlaylist(QJsonArray playlist, const QString &videoId, const QString &playlistId);
     void updateFileInfo(YTVideoInfo info, QVariantMap data);
     bool isVideoOrAudioMimeType(const QString &mimeType);
+    // returns the shared copy of folder, so items of the same folder don't each hold one
+    QString internFolder(const QString &folder);
     void setPlayingItem(uint i);
-    void getMetaData(uint i, const QString &path);
-    void onMetaDataReady(uint i, const QUrl &url, KFileMetaData::PropertyMultiMap properties);
+    void getMetaData(quint32 id, const QString &path);
+    // only reads the metadata when the file was modified after unchangedSince (msecs since epoch)
+    void getChangedMetaData(quint32 id, const QString &path, qint64 unchangedSince);
+    // runs on a TaskScheduler thread
+    void extractMetaData(quint32 id, const QUrl &url);
+    void onMetaDataReady(quint32 id, const QUrl &url, KFileMetaData::PropertyMultiMap properties);
+
+    // change aggregation
+    // metadata arrives one item at a time from the thread pool and yt-dlp,
+    // instead of emitting dataChanged for every item, the changed rows and roles
+    // are collected and flushed once per frame as contiguous ranges
+    void markItemChanged(int row, const QList<int> &roles);
+    void flushChanges();
+    void discardChanges();
 
     std::vector<PlaylistItem> m_playlist;
     QString m_playlistName{u"Default"};
@@ -93,40 +195,59 @@ private:
     bool m_isPlaying{false};
     uint m_playingItem{0};
     QString m_playlistPath;
-    int m_httpItemCounter{0};
     YouTube youtube;
-    QThreadPool m_threadPool;
+    // the metadata reads of the items, see TaskScheduler
+    TaskToken m_metaDataTasks;
+    QSet<QString> m_folders;
+    // m3u file whose items are still being fetched, m_m3uNext is its next entry;
+    // the global search reads the entries not fetched yet on its tasks
+    std::shared_ptr<M3uReader> m_m3u;
+    qsizetype m_m3uNext{0};
+    // set while the rows inserted are items the playlist already had: restored
+    // from its store or by undo, or the next entries of its m3u file; not additions
+    bool m_insertingExisting{false};
 
     // shuffling
-    // when shuffling is on, instead of using an m_playlist index to determine
-    // the next and previous item to play, an index (m_currentShuffledRow) of m_shuffledIndexes is used
-
-    // m_playlist          m_shuffledIndexes
-    // 0 file_0            0 m_playlist.index_4 (file_4}
-    // 1 file_1            1 m_playlist.index_3 (file_3)
-    // 2 file_2            2 m_playlist.index_1 (file_1)
-    // 3 file_3            3 m_playlist.index_2 (file_2)
-    // 4 file_4            4 m_playlist.index_0 (file_0)
-    //
-    // if the current file is file_3 at index m_playlist.index_3
-    // when shuffle if OFF m_playlist.index_3 in incremented/decremented by 1 for the next/previous item
-    // previous file: m_playlist.index_2 file_2
-    //  current file: m_playlist.index_3 file_3
-    //     next file: m_playlist.index_4 file_4
-    //
-    // when shuffle if ON m_shuffledIndexes.index_1 in incremented/decremented by 1 for the next/previous item
-    // previous file: m_shuffledIndexes.index_0 -> m_playlist.index_4 file_4
-    //  current file: m_shuffledIndexes.index_1 -> m_playlist.index_3 file_3
-    //     next file: m_shuffledIndexes.index_2 -> m_playlist.index_1 file_1
-
-    // when shuffling the playing item is moved to the front
-    void shuffleIndexes(std::vector<int> included = std::vector<int>());
-    std::vector<int> shuffledIndexes() const;
-    int currentShuffledIndex() const;
-    void setCurrentShuffledIndex(int shuffledIndex);
-
-    std::vector<int> m_shuffledIndexes;
-    int m_currentShuffledIndex{-1};
+    // when shuffling is on, the next and previous item are taken from m_shuffleQueue,
+    // a random order of item ids that grows and shrinks with the playlist,
+    // see ShuffleQueue
+    void shuffleIndexes();
+
+    ShuffleQueue m_shuffleQueue;
+    quint32 m_nextId{1};
+
+    // lookup by identity
+    // items are found by id or by url without scanning m_playlist; both indexes are
+    // updated on every add and removal, the location index also on renames; rows only
+    // shift on removals, which update the rows after the first removed one
+    // -1 when there is no item with this id
+    int rowOfId(quint32 id) const;
+    // rows of the items with the url, ascending
+    std::vector<int> rowsOfLocation(const QUrl &url) const;
+    // the first of rowsOfLocation(), -1 when the url is not in the playlist
+    int rowOfLocation(const QUrl &url) const;
+    // changes the url of the item at row, keeping the location index in sync
+    void setItemUrl(int row, const QUrl &url);
+    // the same file can be written differently (percent encoding, "." and ".." segments)
+    static QString locationKey(const QUrl &url);
+    // adds the item at row to the indexes
+    void indexItem(int row);
+
+    // normalized url -> ids of the items with that url
+    QMultiHash<QString, quint32> m_idsByLocation;
+    // id -> row
+    QHash<quint32, int> m_rowsById;
+
+    // row -> bitmask of changed roles, bit n is role NameRole + n
+    QHash<int, quint32> m_pendingChanges;
+    QTimer m_changesTimer;
+    // delays saving the last played file, see setPlayingItem()
+    QTimer m_settingsSaveTimer;
+
+    // while removeItems() emits the range signals, the removed items of the ranges
+    // done so far are stored at [m_removalGapBegin, m_removalGapBegin + m_removalGapSize)
+    int m_removalGapBegin{std::numeric_limits<int>::max()};
+    int m_removalGapSize{0};
 };
 
 Q_DECLARE_METATYPE(PlaylistModel::Behavior)
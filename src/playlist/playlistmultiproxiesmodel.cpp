@@ -7,6 +7,9 @@
 #include "playlistmultiproxiesmodel.h"
 #include "playlistfilterproxymodel.h"
 
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QLineEdit>
@@ -15,9 +18,12 @@
 #include <KIO/RenameFileDialog>
 #include <KLocalizedString>
 
+#include "asyncfilewriter.h"
 #include "miscutils.h"
 #include "pathutils.h"
+#include "performancelog.h"
 #include "playlistrenamevalidator.h"
+#include "playliststore.h"
 #include "playlisttypes.h"
 
 using namespace Qt::StringLiterals;
@@ -25,6 +31,20 @@ using namespace Qt::StringLiterals;
 PlaylistMultiProxiesModel::PlaylistMultiProxiesModel(QObject *parent)
     : QAbstractListModel{parent}
 {
+    QElapsedTimer timer;
+    timer.start();
+
+    m_globalSearch = std::make_unique<PlaylistGlobalSearchModel>(this);
+
+    m_cacheTimer.setInterval(500);
+    m_cacheTimer.setSingleShot(true);
+    connect(&m_cacheTimer, &QTimer::timeout, this, &PlaylistMultiProxiesModel::writePlaylistCache);
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, [this]() {
+        if (m_cacheTimer.isActive()) {
+            writePlaylistCache();
+        }
+    });
+
     addPlaylist(QString(QStringLiteral("Default")), QUrl());
     // Add Internet Radio playlist
     addRadioPlaylist();
@@ -66,9 +86,10 @@ PlaylistMultiProxiesModel::PlaylistMultiProxiesModel(QObject *parent)
             if (playlistUrl.isEmpty()) {
                 continue;
             }
-            addPlaylist(playlistName, playlistUrl);
-
+            // only the playlist that was playing is read now, the others when they are opened
             bool active = playlist.value(u"isActive").toBool();
+            addPlaylist(playlistName, playlistUrl, !active, playlist.value(u"itemCount").toInt());
+
             if (active) {
                 uint index = playlist.value(u"currentItem").toInt();
                 setActiveIndex(i);
@@ -76,6 +97,16 @@ PlaylistMultiProxiesModel::PlaylistMultiProxiesModel(QObject *parent)
             }
         }
     }
+
+    qCDebug(HARUNA_PERFORMANCE) << "PlaylistMultiProxiesModel:" << m_playlistFilterProxyModels.size() << "playlists," << m_unloaded.size()
+                                << "not loaded, ready in" << timer.elapsed() << "ms";
+}
+
+PlaylistMultiProxiesModel::~PlaylistMultiProxiesModel()
+{
+    for (auto &unloaded : m_unloaded) {
+        unloaded.loadTask.cancelAndWait();
+    }
 }
 
 uint PlaylistMultiProxiesModel::activeIndex()
@@ -88,6 +119,8 @@ void PlaylistMultiProxiesModel::setActiveIndex(uint pIndex)
     if (m_activeIndex == pIndex) {
         return;
     }
+    // the items are needed right away to play them
+    loadPlaylist(pIndex, true);
 
     uint prev = m_activeIndex;
     m_activeIndex = pIndex;
@@ -98,6 +131,11 @@ void PlaylistMultiProxiesModel::setActiveIndex(uint pIndex)
     Q_EMIT activeIndexChanged();
 }
 
+PlaylistGlobalSearchModel *PlaylistMultiProxiesModel::globalSearch() const
+{
+    return m_globalSearch.get();
+}
+
 uint PlaylistMultiProxiesModel::visibleIndex()
 {
     return m_visibleIndex;
@@ -108,6 +146,7 @@ void PlaylistMultiProxiesModel::setVisibleIndex(uint pIndex)
     if (m_visibleIndex == pIndex) {
         return;
     }
+    loadPlaylist(pIndex, false);
 
     uint prev = m_visibleIndex;
     m_visibleIndex = pIndex;
@@ -136,6 +175,11 @@ QVariant PlaylistMultiProxiesModel::data(const QModelIndex &index, int role) con
         return QVariant(static_cast<int>(m_visibleIndex) == index.row());
     case ActiveRole:
         return QVariant(static_cast<int>(m_activeIndex) == index.row());
+    case ItemCountRole: {
+        const auto proxy = m_playlistFilterProxyModels[index.row()].get();
+        auto it = m_unloaded.constFind(proxy);
+        return QVariant(it != m_unloaded.cend() ? it->itemCount : proxy->playlistModel()->rowCount());
+    }
     }
 
     return QVariant();
@@ -148,13 +192,14 @@ QHash<int, QByteArray> PlaylistMultiProxiesModel::roleNames() const
     {NameRole,     QByteArrayLiteral("name")},
     {VisibleRole, QByteArrayLiteral("isVisible")},
     {ActiveRole,   QByteArrayLiteral("isActive")},
+    {ItemCountRole, QByteArrayLiteral("itemCount")},
     };
     // clang-format on
 
     return roles;
 }
 
-void PlaylistMultiProxiesModel::addPlaylist(QString playlistName, QUrl internalUrl)
+void PlaylistMultiProxiesModel::addPlaylist(QString playlistName, QUrl internalUrl, bool lazy, int itemCount)
 {
     uint playlistsSize = m_playlistFilterProxyModels.size();
     for (uint i = 0; i < playlistsSize; ++i) {
@@ -169,8 +214,36 @@ void PlaylistMultiProxiesModel::addPlaylist(QString playlistName, QUrl internalU
     auto filterModel = std::make_unique<PlaylistFilterProxyModel>();
     filterModel->playlistModel()->m_playlistName = playlistName;
 
-    if (!internalUrl.isEmpty()) {
-        filterModel->playlistModel()->addM3uItems(internalUrl, PlaylistModel::Behavior::Append);
+    if (playlistName != QStringLiteral("Default")) {
+        const QString storePath = getPlaylistPath(playlistName);
+        const QString internalPath = internalUrl.toLocalFile();
+        std::vector<PlaylistItem> items;
+        qsizetype recordCount{0};
+        qint64 validSize{0};
+        if (internalPath.endsWith(PlaylistStore::suffix())) {
+            if (lazy) {
+                m_unloaded.insert(filterModel.get(), {internalPath, itemCount, TaskToken()});
+                // editing it before it was read would give new items the ids of stored ones
+                auto proxy = filterModel.get();
+                filterModel->m_load = [this, proxy]() {
+                    loadPlaylist(rowOf(proxy), true);
+                };
+            } else {
+                const bool loaded = PlaylistStore::load(internalPath, items, &recordCount, &validSize);
+                openStore(filterModel.get(), internalPath, loaded, std::move(items), recordCount, validSize);
+            }
+        } else {
+            filterModel->m_store = std::make_unique<PlaylistStore>(storePath, filterModel.get());
+            // playlists used to be stored as m3u files, read it once and convert it
+            if (!internalUrl.isEmpty()) {
+                filterModel->playlistModel()->addM3uItems(internalUrl, PlaylistModel::Behavior::Append);
+                filterModel->m_store->compact();
+                AsyncFileWriter::instance()->flush();
+                if (QFile::exists(storePath)) {
+                    QFile::remove(internalPath);
+                }
+            }
+        }
     }
 
     connect(filterModel->playlistModel(), &PlaylistModel::playingItemChanged, this, [=](QString pName) {
@@ -192,24 +265,151 @@ void PlaylistMultiProxiesModel::addPlaylist(QString playlistName, QUrl internalU
         Q_EMIT playingItemChanged();
     });
 
-    // When underlying models change, either by remove, insert, move or sort: save the playlist
-    connect(filterModel.get(), &PlaylistFilterProxyModel::itemsSorted, this, &PlaylistMultiProxiesModel::saveVisiblePlaylist);
-    connect(filterModel.get(), &PlaylistFilterProxyModel::itemsMoved, this, &PlaylistMultiProxiesModel::saveVisiblePlaylist);
-    connect(filterModel.get(), &PlaylistFilterProxyModel::itemsRemoved, this, &PlaylistMultiProxiesModel::saveVisiblePlaylist);
-    connect(filterModel.get(), &PlaylistFilterProxyModel::itemsInserted, this, &PlaylistMultiProxiesModel::saveVisiblePlaylist);
-
     filterModel->playlistModel()->stop();
 
+    // the tabs show the item count
+    auto proxy = filterModel.get();
+    auto countChanged = [this, proxy]() {
+        const int row = rowOf(proxy);
+        if (row >= 0) {
+            Q_EMIT dataChanged(index(row, 0), index(row, 0), {ItemCountRole});
+        }
+    };
+    connect(proxy->playlistModel(), &QAbstractItemModel::rowsInserted, this, countChanged);
+    connect(proxy->playlistModel(), &PlaylistModel::itemsRemoved, this, countChanged);
+    connect(proxy->playlistModel(), &QAbstractItemModel::modelReset, this, countChanged);
+
     beginInsertRows(QModelIndex(), playlistsSize, playlistsSize);
     m_playlistFilterProxyModels.push_back(std::move(filterModel));
     endInsertRows();
 }
 
+void PlaylistMultiProxiesModel::loadPlaylist(uint pIndex, bool wait)
+{
+    if (pIndex >= m_playlistFilterProxyModels.size()) {
+        return;
+    }
+    auto proxy = m_playlistFilterProxyModels[pIndex].get();
+    auto it = m_unloaded.constFind(proxy);
+    if (it == m_unloaded.cend()) {
+        return;
+    }
+    const QString path = it->path;
+    TaskToken token = it->loadTask;
+
+    if (wait) {
+        // a background read that started is waited for, its result is dropped in finishLoading
+        token.cancelAndWait();
+        std::vector<PlaylistItem> items;
+        qsizetype recordCount{0};
+        qint64 validSize{0};
+        const bool loaded = PlaylistStore::load(path, items, &recordCount, &validSize);
+        finishLoading(proxy, loaded, std::move(items), recordCount, validSize);
+        return;
+    }
+
+    if (proxy->loading()) {
+        return;
+    }
+    proxy->setLoading(true);
+    // counts against the reads of the drive, after the metadata and thumbnails on screen
+    const auto diskKey = TaskScheduler::diskKey(path);
+    TaskScheduler::instance()->submit(TaskScheduler::Lane::Background, TaskScheduler::Resource::Disk, diskKey, token, [this, proxy, path]() {
+        auto items = std::make_shared<std::vector<PlaylistItem>>();
+        qsizetype recordCount{0};
+        qint64 validSize{0};
+        const bool loaded = PlaylistStore::load(path, *items, &recordCount, &validSize);
+        // proxy is only compared here, it may have been removed meanwhile
+        QMetaObject::invokeMethod(
+            this,
+            [this, proxy, loaded, items, recordCount, validSize]() {
+                finishLoading(proxy, loaded, std::move(*items), recordCount, validSize);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+void PlaylistMultiProxiesModel::finishLoading(PlaylistFilterProxyModel *proxy,
+                                              bool loaded,
+                                              std::vector<PlaylistItem> items,
+                                              qsizetype recordCount,
+                                              qint64 validSize)
+{
+    auto it = m_unloaded.find(proxy);
+    if (it == m_unloaded.end()) {
+        // loaded already, or removed
+        return;
+    }
+    const QString path = it->path;
+    m_unloaded.erase(it);
+    proxy->m_load = nullptr;
+
+    QElapsedTimer timer;
+    timer.start();
+    openStore(proxy, path, loaded, std::move(items), recordCount, validSize);
+    proxy->setLoading(false);
+    Q_EMIT proxy->itemCountChanged();
+    qCDebug(HARUNA_PERFORMANCE) << "PlaylistMultiProxiesModel: loaded" << proxy->playlistModel()->m_playlistName << "in" << timer.elapsed() << "ms";
+
+    const int row = rowOf(proxy);
+    if (row >= 0) {
+        Q_EMIT dataChanged(index(row, 0), index(row, 0), {ItemCountRole});
+    }
+    m_globalSearch->playlistLoaded(proxy);
+}
+
+void PlaylistMultiProxiesModel::openStore(PlaylistFilterProxyModel *proxy,
+                                          const QString &path,
+                                          bool loaded,
+                                          std::vector<PlaylistItem> items,
+                                          qsizetype recordCount,
+                                          qint64 validSize)
+{
+    // the stored items come first, nothing may be added before the store is attached
+    Q_ASSERT(proxy->playlistModel()->m_playlist.empty());
+    if (loaded) {
+        proxy->playlistModel()->restoreItems(std::move(items));
+        // the last record was cut short, new ones would end up behind it and never be read;
+        // the store appends to the file from now on, no reader of it truncates it
+        if (QFileInfo(path).size() > validSize) {
+            QFile::resize(path, validSize);
+        }
+    } else {
+        // keep the unreadable file around, but start a new one
+        QFile::remove(path + QStringLiteral(".bak"));
+        QFile::rename(path, path + QStringLiteral(".bak"));
+        recordCount = 0;
+    }
+    const QString storePath = getPlaylistPath(proxy->playlistModel()->m_playlistName);
+    proxy->m_store = std::make_unique<PlaylistStore>(storePath, proxy, recordCount);
+}
+
+int PlaylistMultiProxiesModel::rowOf(const PlaylistFilterProxyModel *proxy) const
+{
+    for (std::size_t i = 0; i < m_playlistFilterProxyModels.size(); ++i) {
+        if (m_playlistFilterProxyModels[i].get() == proxy) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
 // Used by QML side. Makes sure newly added playlists are saved.
 void PlaylistMultiProxiesModel::createNewPlaylist(QString playlistName)
 {
+    auto playlistsSize = m_playlistFilterProxyModels.size();
     addPlaylist(playlistName, QUrl());
-    savePlaylist(playlistName, m_playlistFilterProxyModels.back().get());
+    if (m_playlistFilterProxyModels.size() == playlistsSize) {
+        // not added, the name is taken
+        return;
+    }
+
+    auto store = m_playlistFilterProxyModels.back()->m_store.get();
+    if (store) {
+        // write the empty playlist, so it's found on the next start
+        store->compact();
+    }
+    savePlaylistCache();
 }
 
 void PlaylistMultiProxiesModel::removePlaylist(uint pIndex)
@@ -240,6 +440,16 @@ void PlaylistMultiProxiesModel::removePlaylist(uint pIndex)
     }
 
     // Remove the deleted playlist
+    auto unloaded = m_unloaded.find(m_playlistFilterProxyModels[pIndex].get());
+    if (unloaded != m_unloaded.end()) {
+        // its read may be running, the store file is removed below
+        unloaded->loadTask.cancelAndWait();
+        m_unloaded.erase(unloaded);
+    }
+    auto store = m_playlistFilterProxyModels[pIndex]->m_store.get();
+    if (store) {
+        store->remove();
+    }
     QUrl playlistUrl = getPlaylistUrl(playlistName);
     if (!playlistUrl.isEmpty()) {
         QFile playlistFile(playlistUrl.toString(QUrl::PreferLocalFile));
@@ -306,15 +516,18 @@ void PlaylistMultiProxiesModel::renamePlaylist(uint pIndex)
         return;
     }
 
-    QString tabName = m_playlistFilterProxyModels[pIndex]->playlistModel()->m_playlistName;
-    auto playlistsPath = PathUtils::instance()->playlistsFolder();
-    QUrl url(playlistsPath + tabName + QStringLiteral(".m3u"));
-    if (url.scheme().isEmpty()) {
-        url.setScheme(QStringLiteral("file"));
+    loadPlaylist(pIndex, true);
+    auto store = m_playlistFilterProxyModels[pIndex]->m_store.get();
+    if (!store) {
+        return;
     }
-    KFileItem item(url);
+    // the file has to exist to be renamed
+    store->compact();
+    AsyncFileWriter::instance()->flush();
+
+    KFileItem item(QUrl::fromLocalFile(store->path()));
     auto renameDialog = new KIO::RenameFileDialog(KFileItemList({item}), nullptr);
-    // Hack into line edit to override erasing '.m3u' extension
+    // Hack into line edit to override erasing the extension
     QLineEdit *edit = renameDialog->findChild<QLineEdit *>();
     if (edit) {
         edit->setValidator(new PlaylistRenameValidator());
@@ -323,8 +536,9 @@ void PlaylistMultiProxiesModel::renamePlaylist(uint pIndex)
 
     connect(renameDialog, &KIO::RenameFileDialog::renamingFinished, this, [=](const QList<QUrl> &urls) {
         QString inputText = urls.first().fileName();
-        QString playlistName = inputText.first(inputText.length() - 4); // '.m3u' 4 chars
+        QString playlistName = inputText.chopped(PlaylistStore::suffix().length());
 
+        store->setPath(urls.first().toLocalFile());
         m_playlistFilterProxyModels[pIndex]->playlistModel()->m_playlistName = playlistName;
         savePlaylistCache();
         Q_EMIT dataChanged(index(pIndex, 0), index(pIndex, 0));
@@ -386,10 +600,19 @@ QUrl PlaylistMultiProxiesModel::getPlaylistCacheUrl()
     return url;
 }
 
-QUrl PlaylistMultiProxiesModel::getPlaylistUrl(QString playlistName)
+QString PlaylistMultiProxiesModel::getPlaylistPath(const QString &playlistName)
 {
     auto playlistsPath = PathUtils::instance()->playlistsFolder();
-    auto filePath = playlistsPath.append(playlistName).append(QStringLiteral(".m3u"));
+    return playlistsPath.append(playlistName).append(PlaylistStore::suffix());
+}
+
+QUrl PlaylistMultiProxiesModel::getPlaylistUrl(QString playlistName)
+{
+    auto filePath = getPlaylistPath(playlistName);
+    if (!QFile::exists(filePath)) {
+        // playlists saved by older versions
+        filePath = PathUtils::instance()->playlistsFolder().append(playlistName).append(QStringLiteral(".m3u"));
+    }
 
     QUrl url = QUrl::fromLocalFile(filePath);
     QFile playlistFile(url.toString(QUrl::PreferLocalFile));
@@ -400,39 +623,26 @@ QUrl PlaylistMultiProxiesModel::getPlaylistUrl(QString playlistName)
     return url;
 }
 
-void PlaylistMultiProxiesModel::saveVisiblePlaylist()
+void PlaylistMultiProxiesModel::savePlaylistCache()
 {
-    QString visiblePlaylistName = m_playlistFilterProxyModels[m_visibleIndex]->playlistModel()->m_playlistName;
-    savePlaylist(visiblePlaylistName, visibleFilterProxy());
+    // the cache is saved on every playing item change, bursts are merged into one write
+    if (!m_cacheTimer.isActive()) {
+        m_cacheTimer.start();
+    }
 }
 
-void PlaylistMultiProxiesModel::savePlaylist(QString playlistName, PlaylistFilterProxyModel *proxyModel)
+void PlaylistMultiProxiesModel::writePlaylistCache()
 {
-    // Note: this method saves unfiltered whole list.
-    auto playlistsPath = PathUtils::instance()->playlistsFolder();
+    m_cacheTimer.stop();
 
-    if (playlistName == u"Default") {
-        return;
-    }
+    QElapsedTimer timer;
+    timer.start();
 
-    proxyModel->saveInternalPlaylist(playlistsPath, playlistName);
-    savePlaylistCache();
-    Q_EMIT dataChanged(index(m_visibleIndex, 0), index(m_visibleIndex, 0));
-}
-
-void PlaylistMultiProxiesModel::savePlaylistCache()
-{
     QUrl cacheUrl = getPlaylistCacheUrl();
     if (cacheUrl.isEmpty()) {
         return;
     }
 
-    QFile cacheFile(cacheUrl.toString(QUrl::PreferLocalFile));
-    if (!cacheFile.open(QFile::WriteOnly)) {
-        qDebug() << "Can't open internal playlist file";
-        return;
-    }
-
     QJsonArray array;
     uint playlistsSize = m_playlistFilterProxyModels.size();
     for (uint i = 0; i < playlistsSize; ++i) {
@@ -440,11 +650,12 @@ void PlaylistMultiProxiesModel::savePlaylistCache()
         json[u"name"] = m_playlistFilterProxyModels[i]->playlistModel()->m_playlistName;
         json[u"isActive"] = QJsonValue(m_activeIndex == i);
         json[u"currentItem"] = double(m_playlistFilterProxyModels[i]->playlistModel()->m_playingItem);
+        json[u"itemCount"] = data(index(i, 0), ItemCountRole).toInt();
         array.append(json);
     }
     QJsonDocument doc(array);
-    cacheFile.write(doc.toJson(QJsonDocument::Indented));
-    cacheFile.close();
+    AsyncFileWriter::instance()->replace(cacheUrl.toString(QUrl::PreferLocalFile), doc.toJson(QJsonDocument::Indented));
+    AsyncFileWriter::instance()->addGuiThreadTime(timer.nsecsElapsed());
 }
 
 void PlaylistMultiProxiesModel::init()
@@ -8,10 +8,18 @@
 #define PLAYLISTMULTIPROXIESMODEL_H
 
 #include <QAbstractListModel>
+#include <QHash>
+#include <QTimer>
+#include "playlistglobalsearchmodel.h"
 #include "playlisttypes.h" // contains Playlist::PlaylistType
+#include "taskscheduler.h"
 #include <qqml.h>
 
+#include <memory>
+#include <vector>
+
 class PlaylistFilterProxyModel;
+struct PlaylistItem;
 
 class PlaylistMultiProxiesModel : public QAbstractListModel
 {
@@ -20,12 +28,15 @@ class PlaylistMultiProxiesModel : public QAbstractListModel
 
 public:
     explicit PlaylistMultiProxiesModel(QObject *parent = nullptr);
+    ~PlaylistMultiProxiesModel() override;
     friend class MpvItem;
+    friend class PlaylistGlobalSearchModel;
 
     enum Roles {
         NameRole = Qt::UserRole,
         VisibleRole,
         ActiveRole,
+        ItemCountRole,
     };
     Q_ENUM(Roles)
 
@@ -37,6 +48,10 @@ public:
     uint visibleIndex();
     void setVisibleIndex(uint index);
 
+    // searches the items of all playlists
+    Q_PROPERTY(PlaylistGlobalSearchModel *globalSearch READ globalSearch CONSTANT)
+    PlaylistGlobalSearchModel *globalSearch() const;
+
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
 
@@ -60,17 +75,46 @@ private:
     PlaylistFilterProxyModel *getFilterProxy(QString playlistName);
 
     void init();
-    void addPlaylist(QString playlistName, QUrl internalUrl);
+    // a lazy playlist only gets its name and itemCount, its items are read
+    // the first time it's shown or played, see loadPlaylist()
+    void addPlaylist(QString playlistName, QUrl internalUrl, bool lazy = false, int itemCount = 0);
+    // reads the items of a lazy playlist, in the background unless wait is true
+    void loadPlaylist(uint pIndex, bool wait);
+    // restores the items read from the store file at path and attaches a store to proxy,
+    // validSize is what PlaylistStore::load() could read of the file
+    void openStore(PlaylistFilterProxyModel *proxy,
+                   const QString &path,
+                   bool loaded,
+                   std::vector<PlaylistItem> items,
+                   qsizetype recordCount,
+                   qint64 validSize);
+    void finishLoading(PlaylistFilterProxyModel *proxy, bool loaded, std::vector<PlaylistItem> items, qsizetype recordCount, qint64 validSize);
+    int rowOf(const PlaylistFilterProxyModel *proxy) const;
     QUrl getPlaylistCacheUrl();
+    QString getPlaylistPath(const QString &playlistName);
     QUrl getPlaylistUrl(QString playlistName);
-    void saveVisiblePlaylist();
-    void savePlaylist(QString playlistName, PlaylistFilterProxyModel *proxyModel);
     void savePlaylistCache();
+    void writePlaylistCache();
     void addRadioPlaylist();
 
     std::vector<std::unique_ptr<PlaylistFilterProxyModel>> m_playlistFilterProxyModels;
     uint m_activeIndex{0};
     uint m_visibleIndex{0};
+    QTimer m_cacheTimer;
+
+    struct UnloadedPlaylist {
+        // the store file
+        QString path;
+        // from playlist.json, shown until the items are read
+        int itemCount{0};
+        // the background read of the store
+        TaskToken loadTask;
+    };
+    // lazy playlists whose items were not read yet
+    QHash<PlaylistFilterProxyModel *, UnloadedPlaylist> m_unloaded;
+
+    // after the playlists, its tasks are waited for before they are destroyed
+    std::unique_ptr<PlaylistGlobalSearchModel> m_globalSearch;
 
     // Playlist type tracking
     Playlist::PlaylistType m_playlistType{Playlist::PlaylistType::Regular};
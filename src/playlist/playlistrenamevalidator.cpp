@@ -5,6 +5,7 @@
  */
 
 #include "playlistrenamevalidator.h"
+#include "playliststore.h"
 
 PlaylistRenameValidator::PlaylistRenameValidator(QObject *parent)
     : QValidator{parent}
@@ -25,7 +26,7 @@ QValidator::State PlaylistRenameValidator::validate(QString &input, int &pos) co
     }
 
     QString extension = splitText.last();
-    if (extension != u"m3u") {
+    if (QLatin1Char('.') + extension != PlaylistStore::suffix()) {
         return QValidator::Invalid;
     }
 
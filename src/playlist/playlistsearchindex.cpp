@@ -0,0 +1,247 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "playlistsearchindex.h"
+#include "playlistmodel.h"
+
+#include <QVarLengthArray>
+
+#include <algorithm>
+
+namespace
+{
+// shorter tokens have to match exactly, otherwise almost everything matches
+constexpr qsizetype FuzzyMinTokenLength = 3;
+
+bool containsSubsequence(QStringView key, QStringView query)
+{
+    qsizetype k = 0;
+    for (const QChar c : query) {
+        while (k < key.size() && key[k] != c) {
+            ++k;
+        }
+        if (k == key.size()) {
+            return false;
+        }
+        ++k;
+    }
+    return true;
+}
+
+// approximate substring matching (Sellers), true if some substring
+// of key is at most one insertion, deletion or substitution away from token
+bool containsWithinOneEdit(QStringView key, QStringView token)
+{
+    const qsizetype m = token.size();
+    if (m <= 1) {
+        return true;
+    }
+
+    QVarLengthArray<int, 64> column(m + 1);
+    for (qsizetype i = 0; i <= m; ++i) {
+        column[i] = static_cast<int>(i);
+    }
+
+    for (const QChar c : key) {
+        int diagonal = 0;
+        for (qsizetype i = 1; i <= m; ++i) {
+            const int above = column[i];
+            column[i] = std::min({diagonal + (token[i - 1] == c ? 0 : 1), above + 1, column[i - 1] + 1});
+            diagonal = above;
+        }
+        if (column[m] <= 1) {
+            return true;
+        }
+    }
+    return false;
+}
+} // namespace
+
+PlaylistSearchIndex::PlaylistSearchIndex(const PlaylistModel *model)
+    : m_model{model}
+{
+}
+
+const QString &PlaylistSearchIndex::key(int row, Field field) const
+{
+    ensureSize(row);
+    auto &entry = m_entries[row];
+    if (field == Field::Name) {
+        if (!entry.hasName) {
+            entry.name = fold(rawText(row, field));
+            entry.hasName = true;
+        }
+        return entry.name;
+    }
+
+    if (!entry.hasTitle) {
+        entry.title = fold(rawText(row, field));
+        entry.hasTitle = true;
+    }
+    return entry.title;
+}
+
+bool PlaylistSearchIndex::hasKey(int row, Field field) const
+{
+    if (row < 0 || row >= static_cast<int>(m_entries.size())) {
+        return false;
+    }
+    return field == Field::Name ? m_entries[row].hasName : m_entries[row].hasTitle;
+}
+
+QString PlaylistSearchIndex::rawText(int row, Field field) const
+{
+    const auto &item = m_model->m_playlist[row];
+    if (field == Field::Title && !item.mediaTitle.isEmpty()) {
+        return item.mediaTitle;
+    }
+    return item.filename;
+}
+
+void PlaylistSearchIndex::setKey(int row, Field field, const QString &folded) const
+{
+    ensureSize(row);
+    auto &entry = m_entries[row];
+    if (field == Field::Name) {
+        entry.name = folded;
+        entry.hasName = true;
+    } else {
+        entry.title = folded;
+        entry.hasTitle = true;
+    }
+}
+
+quint64 PlaylistSearchIndex::revision() const
+{
+    return m_revision;
+}
+
+quint64 PlaylistSearchIndex::structureRevision() const
+{
+    return m_structureRevision;
+}
+
+bool PlaylistSearchIndex::changedSince(int row, quint64 revision) const
+{
+    if (row < 0 || row >= static_cast<int>(m_entries.size())) {
+        return false;
+    }
+    return m_entries[row].changed > revision;
+}
+
+void PlaylistSearchIndex::insertRows(int first, int last)
+{
+    ++m_revision;
+    if (first >= static_cast<int>(m_entries.size())) {
+        // appended rows are picked up by ensureSize
+        return;
+    }
+    ++m_structureRevision;
+    Entry entry;
+    entry.changed = m_revision;
+    m_entries.insert(m_entries.begin() + first, last - first + 1, entry);
+}
+
+void PlaylistSearchIndex::removeRows(const std::vector<int> &rows)
+{
+    ++m_revision;
+    ++m_structureRevision;
+    eraseRows(m_entries, rows);
+}
+
+void PlaylistSearchIndex::invalidateRows(int first, int last)
+{
+    ++m_revision;
+    Entry entry;
+    entry.changed = m_revision;
+    const int end = std::min(last + 1, static_cast<int>(m_entries.size()));
+    for (int row = first; row < end; ++row) {
+        m_entries[row] = entry;
+    }
+}
+
+void PlaylistSearchIndex::clear()
+{
+    ++m_revision;
+    ++m_structureRevision;
+    m_entries.clear();
+}
+
+void PlaylistSearchIndex::ensureSize(int row) const
+{
+    if (row >= static_cast<int>(m_entries.size())) {
+        m_entries.resize(row + 1);
+    }
+}
+
+QString PlaylistSearchIndex::fold(const QString &text)
+{
+    // decompose so accents become separate combining marks that can be dropped
+    const QString decomposed = text.normalized(QString::NormalizationForm_KD);
+    QString folded;
+    folded.reserve(decomposed.size());
+    for (const QChar c : decomposed) {
+        if (c.isMark()) {
+            continue;
+        }
+        folded.append(c.toCaseFolded());
+    }
+    return folded;
+}
+
+QStringList PlaylistSearchIndex::tokenize(const QString &foldedQuery)
+{
+    return foldedQuery.split(QLatin1Char(' '), Qt::SkipEmptyParts);
+}
+
+PlaylistSearchIndex::Mode PlaylistSearchIndex::modeFromString(const QString &mode)
+{
+    if (mode == QStringLiteral("Subsequence")) {
+        return Mode::Subsequence;
+    }
+    if (mode == QStringLiteral("Fuzzy")) {
+        return Mode::Fuzzy;
+    }
+    return Mode::Substring;
+}
+
+bool PlaylistSearchIndex::matches(const QString &key, const QStringList &tokens, Mode mode)
+{
+    switch (mode) {
+    case Mode::Subsequence:
+        return containsSubsequence(key, tokens.join(QString()));
+    case Mode::Fuzzy:
+        return std::all_of(tokens.cbegin(), tokens.cend(), [&key](const QString &token) {
+            if (key.contains(token)) {
+                return true;
+            }
+            return token.size() >= FuzzyMinTokenLength && containsWithinOneEdit(key, token);
+        });
+    case Mode::Substring:
+        break;
+    }
+
+    return std::all_of(tokens.cbegin(), tokens.cend(), [&key](const QString &token) {
+        return key.contains(token);
+    });
+}
+
+bool PlaylistSearchIndex::narrows(const QStringList &oldTokens, const QStringList &newTokens, Mode mode)
+{
+    if (oldTokens.isEmpty() || newTokens.size() < oldTokens.size()) {
+        return false;
+    }
+    for (qsizetype i = 0; i < oldTokens.size(); ++i) {
+        const bool isLast = i == oldTokens.size() - 1;
+        // only the last token can grow, the ones before it must be unchanged
+        if (isLast ? !newTokens[i].startsWith(oldTokens[i]) : newTokens[i] != oldTokens[i]) {
+            return false;
+        }
+        // a token that becomes long enough for fuzzy matching can match more than before
+        if (mode == Mode::Fuzzy && oldTokens[i].size() < FuzzyMinTokenLength && newTokens[i].size() >= FuzzyMinTokenLength) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,82 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef PLAYLISTSEARCHINDEX_H
+#define PLAYLISTSEARCHINDEX_H
+
+#include <QString>
+#include <QStringList>
+
+#include <vector>
+
+class PlaylistModel;
+
+/**
+ * Case and accent folded search keys for the items of a PlaylistModel,
+ * indexed by PlaylistModel row. Keys are folded lazily on first use
+ * and dropped when the item's name or title changes.
+ */
+class PlaylistSearchIndex
+{
+public:
+    enum class Field {
+        Name,
+        Title,
+    };
+
+    enum class Mode {
+        // every token must be a substring of the key
+        Substring,
+        // the query's characters must appear in the key in order
+        Subsequence,
+        // like Substring, but tokens may be one edit away
+        Fuzzy,
+    };
+
+    explicit PlaylistSearchIndex(const PlaylistModel *model);
+
+    const QString &key(int row, Field field) const;
+    bool hasKey(int row, Field field) const;
+    QString rawText(int row, Field field) const;
+    void setKey(int row, Field field, const QString &folded) const;
+
+    // bumped on every change
+    quint64 revision() const;
+    // bumped when rows are inserted in the middle or removed, i.e. when rows shift
+    quint64 structureRevision() const;
+    // whether the key of row was invalidated after revision
+    bool changedSince(int row, quint64 revision) const;
+
+    void insertRows(int first, int last);
+    // rows ascending, as emitted by PlaylistModel::itemsRemoved()
+    void removeRows(const std::vector<int> &rows);
+    void invalidateRows(int first, int last);
+    void clear();
+
+    static QString fold(const QString &text);
+    static QStringList tokenize(const QString &foldedQuery);
+    static Mode modeFromString(const QString &mode);
+    static bool matches(const QString &key, const QStringList &tokens, Mode mode);
+    // whether the matches of newTokens are a subset of the matches of oldTokens,
+    // so a search for newTokens only has to look at the previous matches
+    static bool narrows(const QStringList &oldTokens, const QStringList &newTokens, Mode mode);
+
+private:
+    struct Entry {
+        QString name;
+        QString title;
+        bool hasName{false};
+        bool hasTitle{false};
+        quint64 changed{0};
+    };
+
+    void ensureSize(int row) const;
+
+    const PlaylistModel *m_model{nullptr};
+    mutable std::vector<Entry> m_entries;
+    quint64 m_revision{0};
+    quint64 m_structureRevision{0};
+};
+
+#endif // PLAYLISTSEARCHINDEX_H
@@ -0,0 +1,457 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "playliststore.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+
+#include <algorithm>
+
+#include "asyncfilewriter.h"
+#include "playlistfilterproxymodel.h"
+
+namespace
+{
+constexpr quint32 Magic = 0x48504c53; // "HPLS"
+constexpr quint16 Version = 1;
+constexpr QDataStream::Version StreamVersion = QDataStream::Qt_6_0;
+// rewrite the journal when it has this many more records than the playlist has items
+constexpr qsizetype CompactionSlack = 1024;
+
+void writeItem(QDataStream &stream, const PlaylistItem &item)
+{
+    stream << item.id << item.location << item.filename << item.mediaTitle << item.folderPath << item.duration << item.fileSize
+           << item.lastModified << qint32(item.trackNumber);
+}
+
+void readItem(QDataStream &stream, PlaylistItem &item)
+{
+    QString url;
+    qint32 trackNumber{0};
+    stream >> item.id >> url >> item.filename >> item.mediaTitle >> item.folderPath >> item.duration >> item.fileSize >> item.lastModified
+        >> trackNumber;
+    item.setUrl(QUrl(url));
+    item.trackNumber = trackNumber;
+}
+
+} // namespace
+
+PlaylistStore::PlaylistStore(const QString &path, PlaylistFilterProxyModel *proxyModel, qsizetype recordCount, QObject *parent)
+    : QObject{parent}
+    , m_path{path}
+    , m_proxyModel{proxyModel}
+    , m_model{proxyModel->playlistModel()}
+    , m_recordCount{recordCount}
+{
+    m_syncTimer.setInterval(1000);
+    m_syncTimer.setSingleShot(true);
+    connect(&m_syncTimer, &QTimer::timeout, this, &PlaylistStore::sync);
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &PlaylistStore::sync);
+
+    connect(m_model, &QAbstractItemModel::rowsInserted, this, &PlaylistStore::onRowsInserted);
+    connect(m_model, &PlaylistModel::itemsAboutToBeRemoved, this, &PlaylistStore::onItemsAboutToBeRemoved);
+    connect(m_model, &QAbstractItemModel::dataChanged, this, &PlaylistStore::onDataChanged);
+    connect(m_model, &QAbstractItemModel::modelReset, this, &PlaylistStore::onModelReset);
+
+    connect(proxyModel, &PlaylistFilterProxyModel::orderChanged, this, &PlaylistStore::onOrderChanged);
+}
+
+PlaylistStore::~PlaylistStore()
+{
+    // the proxy is being destroyed, fetching would insert rows into it; the m3u entries
+    // not fetched yet are read without the model and appended after the rest
+    std::vector<PlaylistItem> unfetched;
+    if (!m_removed) {
+        unfetched = m_model->takeUnfetchedM3uItems();
+    }
+    // nothing is left to fetch
+    sync();
+    if (unfetched.empty()) {
+        return;
+    }
+
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(StreamVersion);
+    QByteArray payload;
+    for (const auto &item : unfetched) {
+        payload.clear();
+        QDataStream record(&payload, QIODevice::WriteOnly);
+        record.setVersion(StreamVersion);
+        writeItem(record, item);
+        stream << static_cast<quint8>(Record::ItemAdded) << payload;
+        ++m_recordCount;
+    }
+    AsyncFileWriter::instance()->append(m_path, data, header());
+}
+
+QString PlaylistStore::suffix()
+{
+    return QStringLiteral(".hpl");
+}
+
+bool PlaylistStore::load(const QString &path, std::vector<PlaylistItem> &items, qsizetype *recordCount, qint64 *validSize)
+{
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(StreamVersion);
+
+    quint32 magic{0};
+    quint16 version{0};
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != Magic || version > Version) {
+        qWarning() << "Not a playlist store:" << path;
+        return false;
+    }
+
+    std::vector<PlaylistItem> added;
+    QHash<quint32, qsizetype> positions;
+    std::vector<quint32> order;
+    qsizetype records{0};
+    qint64 readSize = file.pos();
+
+    while (!stream.atEnd()) {
+        quint8 type{0};
+        QByteArray payload;
+        stream >> type >> payload;
+        if (stream.status() != QDataStream::Ok) {
+            // a record that was cut short by a crash, everything before it is fine
+            qWarning() << "Ignoring incomplete record at the end of" << path;
+            break;
+        }
+        ++records;
+        readSize = file.pos();
+
+        QDataStream record(payload);
+        record.setVersion(StreamVersion);
+        switch (static_cast<Record>(type)) {
+        case Record::ItemAdded: {
+            PlaylistItem item;
+            readItem(record, item);
+            positions.insert(item.id, static_cast<qsizetype>(added.size()));
+            order.push_back(item.id);
+            added.push_back(std::move(item));
+            break;
+        }
+        case Record::ItemUpdated: {
+            PlaylistItem item;
+            readItem(record, item);
+            auto it = positions.constFind(item.id);
+            if (it != positions.cend()) {
+                added[it.value()] = std::move(item);
+            }
+            break;
+        }
+        case Record::ItemsRemoved: {
+            QList<quint32> ids;
+            record >> ids;
+            for (auto id : std::as_const(ids)) {
+                positions.remove(id);
+            }
+            break;
+        }
+        case Record::Order: {
+            QList<quint32> ids;
+            record >> ids;
+            order.assign(ids.cbegin(), ids.cend());
+            break;
+        }
+        case Record::Clear:
+            added.clear();
+            positions.clear();
+            order.clear();
+            break;
+        }
+    }
+
+    items.clear();
+    items.reserve(positions.size());
+    for (auto id : order) {
+        auto it = positions.constFind(id);
+        if (it == positions.cend()) {
+            continue;
+        }
+        items.push_back(std::move(added[it.value()]));
+        // an id can only appear once in the playlist
+        positions.erase(it);
+    }
+
+    if (recordCount) {
+        *recordCount = records;
+    }
+    if (validSize) {
+        *validSize = readSize;
+    }
+    return true;
+}
+
+QString PlaylistStore::path() const
+{
+    return m_path;
+}
+
+void PlaylistStore::setPath(const QString &path)
+{
+    m_path = path;
+}
+
+void PlaylistStore::sync()
+{
+    m_syncTimer.stop();
+    if (m_removed) {
+        return;
+    }
+    // the file has to hold the whole playlist, not the part the view has fetched
+    m_model->fetchAll();
+
+    const bool hasChanges = m_pendingClear || m_orderChanged || !m_pendingAdded.empty() || !m_pendingUpdated.isEmpty() || !m_pendingRemoved.empty();
+    if (!hasChanges) {
+        return;
+    }
+
+    if (m_recordCount > 2 * static_cast<qsizetype>(m_model->m_playlist.size()) + CompactionSlack) {
+        compact();
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // the records are serialized here and written by AsyncFileWriter
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(StreamVersion);
+
+    auto writeRecord = [this, &stream](Record type, const QByteArray &payload) {
+        stream << static_cast<quint8>(type) << payload;
+        ++m_recordCount;
+    };
+
+    if (m_pendingClear) {
+        writeRecord(Record::Clear, {});
+    }
+
+    if (!m_pendingRemoved.empty()) {
+        QByteArray payload;
+        QDataStream record(&payload, QIODevice::WriteOnly);
+        record.setVersion(StreamVersion);
+        record << QList<quint32>(m_pendingRemoved.cbegin(), m_pendingRemoved.cend());
+        writeRecord(Record::ItemsRemoved, payload);
+    }
+
+    if (!m_pendingAdded.empty() || !m_pendingUpdated.isEmpty()) {
+        // the items are written with their current data, so metadata that arrived
+        // since they were added doesn't need a separate record
+        QHash<quint32, int> rows;
+        rows.reserve(m_pendingAddedSet.size() + m_pendingUpdated.size());
+        for (int row = 0; row < static_cast<int>(m_model->m_playlist.size()); ++row) {
+            const auto id = m_model->m_playlist[row].id;
+            if (m_pendingAddedSet.contains(id) || m_pendingUpdated.contains(id)) {
+                rows.insert(id, row);
+            }
+        }
+
+        auto writeItemRecord = [&](Record type, quint32 id) {
+            auto it = rows.constFind(id);
+            if (it == rows.cend()) {
+                return;
+            }
+            QByteArray payload;
+            QDataStream record(&payload, QIODevice::WriteOnly);
+            record.setVersion(StreamVersion);
+            writeItem(record, m_model->m_playlist[it.value()]);
+            writeRecord(type, payload);
+        };
+
+        for (auto id : m_pendingAdded) {
+            writeItemRecord(Record::ItemAdded, id);
+        }
+        for (auto id : std::as_const(m_pendingUpdated)) {
+            if (!m_pendingAddedSet.contains(id)) {
+                writeItemRecord(Record::ItemUpdated, id);
+            }
+        }
+    }
+
+    if (m_orderChanged) {
+        const auto ids = orderedIds();
+        QByteArray payload;
+        QDataStream record(&payload, QIODevice::WriteOnly);
+        record.setVersion(StreamVersion);
+        record << QList<quint32>(ids.cbegin(), ids.cend());
+        writeRecord(Record::Order, payload);
+    }
+
+    clearPending();
+    AsyncFileWriter::instance()->append(m_path, data, header());
+    AsyncFileWriter::instance()->addGuiThreadTime(timer.nsecsElapsed());
+}
+
+void PlaylistStore::compact()
+{
+    m_syncTimer.stop();
+    if (m_removed) {
+        return;
+    }
+    // same as sync(), e.g. a converted m3u file is removed right after it's compacted
+    m_model->fetchAll();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QByteArray data = header();
+    QDataStream stream(&data, QIODevice::WriteOnly | QIODevice::Append);
+    stream.setVersion(StreamVersion);
+
+    QHash<quint32, int> rows;
+    rows.reserve(m_model->m_playlist.size());
+    for (int row = 0; row < static_cast<int>(m_model->m_playlist.size()); ++row) {
+        rows.insert(m_model->m_playlist[row].id, row);
+    }
+
+    // items are written in playlist order, so no order record is needed
+    qsizetype records{0};
+    QByteArray payload;
+    for (auto id : orderedIds()) {
+        payload.clear();
+        QDataStream record(&payload, QIODevice::WriteOnly);
+        record.setVersion(StreamVersion);
+        writeItem(record, m_model->m_playlist[rows.value(id)]);
+        stream << static_cast<quint8>(Record::ItemAdded) << payload;
+        ++records;
+    }
+
+    m_recordCount = records;
+    clearPending();
+    AsyncFileWriter::instance()->replace(m_path, data);
+    AsyncFileWriter::instance()->addGuiThreadTime(timer.nsecsElapsed());
+}
+
+void PlaylistStore::remove()
+{
+    m_syncTimer.stop();
+    m_removed = true;
+    AsyncFileWriter::instance()->remove(m_path);
+}
+
+void PlaylistStore::clearPending()
+{
+    m_pendingClear = false;
+    m_orderChanged = false;
+    m_pendingAdded.clear();
+    m_pendingAddedSet.clear();
+    m_pendingUpdated.clear();
+    m_pendingRemoved.clear();
+}
+
+QByteArray PlaylistStore::header()
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(StreamVersion);
+    stream << Magic << Version;
+    return data;
+}
+
+void PlaylistStore::onRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent)
+
+    for (int row = first; row <= last; ++row) {
+        const auto id = m_model->m_playlist[row].id;
+        m_pendingAdded.push_back(id);
+        m_pendingAddedSet.insert(id);
+    }
+    scheduleSync();
+}
+
+void PlaylistStore::onItemsAboutToBeRemoved(const std::vector<int> &rows)
+{
+    bool removedPendingAdded{false};
+    for (const int row : rows) {
+        const auto id = m_model->m_playlist[row].id;
+        m_pendingUpdated.remove(id);
+        if (m_pendingAddedSet.remove(id)) {
+            // never written, nothing to remove from the file
+            removedPendingAdded = true;
+            continue;
+        }
+        m_pendingRemoved.push_back(id);
+    }
+    if (removedPendingAdded) {
+        // in one pass, not once per removed item
+        m_pendingAdded.erase(std::remove_if(m_pendingAdded.begin(),
+                                            m_pendingAdded.end(),
+                                            [this](quint32 id) {
+                                                return !m_pendingAddedSet.contains(id);
+                                            }),
+                             m_pendingAdded.end());
+    }
+    scheduleSync();
+}
+
+void PlaylistStore::onDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QList<int> &roles)
+{
+    // only the stored fields matter, not the playing or selected state
+    static const QList<int> storedRoles{PlaylistModel::NameRole,
+                                        PlaylistModel::TitleRole,
+                                        PlaylistModel::DurationRole,
+                                        PlaylistModel::PathRole,
+                                        PlaylistModel::TrackNumberRole};
+    if (!roles.isEmpty() && std::none_of(roles.cbegin(), roles.cend(), [](int role) {
+            return storedRoles.contains(role);
+        })) {
+        return;
+    }
+
+    for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+        m_pendingUpdated.insert(m_model->m_playlist[row].id);
+    }
+    scheduleSync();
+}
+
+void PlaylistStore::onModelReset()
+{
+    clearPending();
+    m_pendingClear = true;
+    // items added after the reset still arrive through rowsInserted
+    for (const auto &item : m_model->m_playlist) {
+        m_pendingAdded.push_back(item.id);
+        m_pendingAddedSet.insert(item.id);
+    }
+    scheduleSync();
+}
+
+void PlaylistStore::onOrderChanged()
+{
+    m_orderChanged = true;
+    scheduleSync();
+}
+
+void PlaylistStore::scheduleSync()
+{
+    if (!m_syncTimer.isActive()) {
+        m_syncTimer.start();
+    }
+}
+
+std::vector<quint32> PlaylistStore::orderedIds() const
+{
+    std::vector<quint32> ids;
+    ids.reserve(m_proxyModel->m_order.size());
+    for (const int row : m_proxyModel->m_order) {
+        ids.push_back(m_model->m_playlist[row].id);
+    }
+    return ids;
+}
+
+#include "moc_playliststore.cpp"
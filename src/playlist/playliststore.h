@@ -0,0 +1,90 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef PLAYLISTSTORE_H
+#define PLAYLISTSTORE_H
+
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+
+#include <vector>
+
+#include "playlistmodel.h"
+
+class PlaylistFilterProxyModel;
+
+/**
+ * On-disk store of an internal playlist.
+ *
+ * The file is an append-only journal of binary records (items added, updated
+ * and removed, the order of the items, clear) written with QDataStream.
+ * Changes to the playlist are collected and appended at most once per second,
+ * when the journal gets much bigger than the playlist it is rewritten as a snapshot.
+ * The records are serialized on the calling thread and written by AsyncFileWriter.
+ * Items are stored with their metadata, so loading doesn't touch the media files.
+ */
+class PlaylistStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    // attaches to proxyModel, the items already in it are assumed to be in the file
+    explicit PlaylistStore(const QString &path, PlaylistFilterProxyModel *proxyModel, qsizetype recordCount = 0, QObject *parent = nullptr);
+    ~PlaylistStore() override;
+
+    static QString suffix();
+    // reads the items in playlist order, returns false if the file can't be read;
+    // validSize is the size of the records read, less than the file's when the last one was
+    // cut short, the file isn't changed, only the one who appends to it may truncate it
+    static bool load(const QString &path, std::vector<PlaylistItem> &items, qsizetype *recordCount = nullptr, qint64 *validSize = nullptr);
+
+    QString path() const;
+    void setPath(const QString &path);
+
+    // writes the pending changes
+    void sync();
+    // rewrites the whole file from the playlist
+    void compact();
+    // deletes the file, the store stops recording
+    void remove();
+
+private:
+    enum class Record : quint8 {
+        ItemAdded,
+        ItemUpdated,
+        ItemsRemoved,
+        Order,
+        Clear,
+    };
+
+    void onRowsInserted(const QModelIndex &parent, int first, int last);
+    void onItemsAboutToBeRemoved(const std::vector<int> &rows);
+    void onDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QList<int> &roles);
+    void onModelReset();
+    void onOrderChanged();
+    void scheduleSync();
+    void clearPending();
+    static QByteArray header();
+    std::vector<quint32> orderedIds() const;
+
+    QString m_path;
+    PlaylistFilterProxyModel *m_proxyModel{nullptr};
+    PlaylistModel *m_model{nullptr};
+
+    // changes not written yet
+    bool m_pendingClear{false};
+    bool m_orderChanged{false};
+    std::vector<quint32> m_pendingAdded;
+    QSet<quint32> m_pendingAddedSet;
+    QSet<quint32> m_pendingUpdated;
+    std::vector<quint32> m_pendingRemoved;
+
+    // records in the file, used to decide when to compact
+    qsizetype m_recordCount{0};
+    bool m_removed{false};
+    QTimer m_syncTimer;
+};
+
+#endif // PLAYLISTSTORE_H
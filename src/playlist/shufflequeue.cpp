@@ -0,0 +1,186 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "shufflequeue.h"
+
+#include <algorithm>
+
+namespace
+{
+// don't bother compacting tiny queues
+constexpr qsizetype MinRemovedBeforeCompacting = 32;
+} // namespace
+
+void ShuffleQueue::reset(std::vector<quint32> ids, quint32 currentId)
+{
+    m_queue = std::move(ids);
+    std::shuffle(m_queue.begin(), m_queue.end(), m_generator);
+
+    auto it = std::find(m_queue.begin(), m_queue.end(), currentId);
+    if (currentId != NoId && it != m_queue.end()) {
+        std::rotate(m_queue.begin(), it, it + 1);
+        m_cursor = 0;
+    } else {
+        m_cursor = -1;
+    }
+
+    m_removedCount = 0;
+    m_positions.clear();
+    m_positions.reserve(m_queue.size());
+    for (qsizetype i = 0; i < static_cast<qsizetype>(m_queue.size()); ++i) {
+        m_positions.insert(m_queue[i], i);
+    }
+}
+
+void ShuffleQueue::clear()
+{
+    m_queue.clear();
+    m_positions.clear();
+    m_cursor = -1;
+    m_removedCount = 0;
+}
+
+void ShuffleQueue::insert(quint32 id)
+{
+    if (id == NoId || m_positions.contains(id)) {
+        return;
+    }
+
+    // append, then swap with a random position of the part that wasn't played yet
+    // (the new id may stay where it is), every unplayed order stays equally likely
+    m_queue.push_back(id);
+    const auto last = static_cast<qsizetype>(m_queue.size()) - 1;
+    m_positions.insert(id, last);
+
+    std::uniform_int_distribution<qsizetype> distribution(m_cursor + 1, last);
+    swap(distribution(m_generator), last);
+}
+
+void ShuffleQueue::remove(quint32 id)
+{
+    auto it = m_positions.constFind(id);
+    if (it == m_positions.cend()) {
+        return;
+    }
+
+    m_queue[it.value()] = NoId;
+    m_positions.erase(it);
+    ++m_removedCount;
+
+    if (m_removedCount >= MinRemovedBeforeCompacting && m_removedCount * 2 >= static_cast<qsizetype>(m_queue.size())) {
+        compact();
+    }
+}
+
+void ShuffleQueue::setCurrent(quint32 id)
+{
+    auto it = m_positions.constFind(id);
+    if (it == m_positions.cend()) {
+        return;
+    }
+
+    const qsizetype position = it.value();
+    if (position <= m_cursor) {
+        // already played, go back to it in the history
+        m_cursor = position;
+        return;
+    }
+
+    swap(position, m_cursor + 1);
+    ++m_cursor;
+}
+
+quint32 ShuffleQueue::current() const
+{
+    if (m_cursor < 0 || m_cursor >= static_cast<qsizetype>(m_queue.size())) {
+        return NoId;
+    }
+    return m_queue[m_cursor];
+}
+
+quint32 ShuffleQueue::step(int direction, const std::function<bool(quint32)> &accept)
+{
+    const qsizetype position = find(direction, accept);
+    if (position < 0) {
+        return NoId;
+    }
+    m_cursor = position;
+    return m_queue[position];
+}
+
+quint32 ShuffleQueue::peek(int direction, const std::function<bool(quint32)> &accept) const
+{
+    const qsizetype position = find(direction, accept);
+    return position < 0 ? NoId : m_queue[position];
+}
+
+qsizetype ShuffleQueue::find(int direction, const std::function<bool(quint32)> &accept) const
+{
+    const auto size = static_cast<qsizetype>(m_queue.size());
+    qsizetype position = m_cursor;
+    for (qsizetype i = 0; i < size; ++i) {
+        position += direction;
+        if (position >= size) {
+            position = 0;
+        } else if (position < 0) {
+            position = size - 1;
+        }
+
+        const quint32 id = m_queue[position];
+        if (id != NoId && accept(id)) {
+            return position;
+        }
+    }
+    return -1;
+}
+
+bool ShuffleQueue::hasNext(const std::function<bool(quint32)> &accept) const
+{
+    for (auto position = m_cursor + 1; position < static_cast<qsizetype>(m_queue.size()); ++position) {
+        const quint32 id = m_queue[position];
+        if (id != NoId && accept(id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ShuffleQueue::swap(qsizetype a, qsizetype b)
+{
+    if (a == b) {
+        return;
+    }
+    std::swap(m_queue[a], m_queue[b]);
+    if (m_queue[a] != NoId) {
+        m_positions[m_queue[a]] = a;
+    }
+    if (m_queue[b] != NoId) {
+        m_positions[m_queue[b]] = b;
+    }
+}
+
+void ShuffleQueue::compact()
+{
+    std::vector<quint32> compacted;
+    compacted.reserve(m_queue.size() - m_removedCount);
+
+    // the cursor ends up on the last live id at or before it,
+    // so stepping forward continues with the same item as before
+    qsizetype cursor{-1};
+    for (qsizetype i = 0; i < static_cast<qsizetype>(m_queue.size()); ++i) {
+        const quint32 id = m_queue[i];
+        if (id == NoId) {
+            continue;
+        }
+        if (i <= m_cursor) {
+            cursor = static_cast<qsizetype>(compacted.size());
+        }
+        m_positions[id] = static_cast<qsizetype>(compacted.size());
+        compacted.push_back(id);
+    }
+
+    m_queue = std::move(compacted);
+    m_cursor = cursor;
+    m_removedCount = 0;
+}
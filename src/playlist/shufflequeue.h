@@ -0,0 +1,63 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef SHUFFLEQUEUE_H
+#define SHUFFLEQUEUE_H
+
+#include <QHash>
+
+#include <functional>
+#include <random>
+#include <vector>
+
+/**
+ * Random playback order of playlist item ids.
+ *
+ * Everything up to and including the cursor has already been played,
+ * that part is never reordered so going back retraces the history.
+ * New ids are placed at a random position after the cursor, removed ids
+ * are left as holes that are skipped and compacted away once they make
+ * up half of the queue.
+ */
+class ShuffleQueue
+{
+public:
+    // item ids start at 1, 0 marks a removed entry
+    static constexpr quint32 NoId = 0;
+
+    // shuffles ids, currentId (if present) becomes the first played item
+    void reset(std::vector<quint32> ids, quint32 currentId);
+    void clear();
+    void insert(quint32 id);
+    void remove(quint32 id);
+
+    // marks id as playing, when it was not played yet it becomes
+    // the item after the current one in the history
+    void setCurrent(quint32 id);
+    quint32 current() const;
+
+    // moves the cursor forward (direction 1) or backward (direction -1) to the next
+    // id for which accept returns true, wraps around at the ends; returns NoId when
+    // no id is accepted
+    quint32 step(int direction, const std::function<bool(quint32)> &accept);
+    // the id step() would return, without moving the cursor
+    quint32 peek(int direction, const std::function<bool(quint32)> &accept) const;
+    // whether there is an accepted id after the cursor, without wrapping around
+    bool hasNext(const std::function<bool(quint32)> &accept) const;
+
+private:
+    // position of the id step() would move to, -1 when there is none
+    qsizetype find(int direction, const std::function<bool(quint32)> &accept) const;
+    void swap(qsizetype a, qsizetype b);
+    void compact();
+
+    std::vector<quint32> m_queue;
+    QHash<quint32, qsizetype> m_positions;
+    // position of the current item, -1 when nothing was played yet
+    qsizetype m_cursor{-1};
+    qsizetype m_removedCount{0};
+    std::mt19937 m_generator{std::random_device{}()};
+};
+
+#endif // SHUFFLEQUEUE_H
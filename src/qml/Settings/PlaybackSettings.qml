@@ -199,6 +199,25 @@ SettingsBasePage {
             }
         }
 
+        Item { Layout.preferredWidth: 1 }
+
+        CheckBox {
+            id: gaplessPlaybackCheckBox
+
+            text: i18nc("@option:check", "Gapless playback")
+            checked: PlaybackSettings.gaplessPlayback
+            onClicked: {
+                PlaybackSettings.gaplessPlayback = checked
+                PlaybackSettings.save()
+            }
+
+            ToolTip {
+                text: i18nc("@info:tooltip gapless playback setting",
+                            "Opens the next playlist item before the current one ends, so there is no pause between them. "
+                            + "Items opened this way start from the beginning.")
+            }
+        }
+
         // ------------------------------------
         // Playback position
         // ------------------------------------
@@ -210,6 +210,26 @@ SettingsBasePage {
             }
         }
 
+        Item { Layout.preferredWidth: 1; Layout.preferredHeight: 1 }
+        CheckBox {
+            checked: PlaylistSettings.watchFolders
+            text: i18nc("@option:check", "Update playlists when files are added to or removed from their folders")
+            onClicked: {
+                PlaylistSettings.watchFolders = checked
+                PlaylistSettings.save()
+            }
+        }
+
+        Item { Layout.preferredWidth: 1; Layout.preferredHeight: 1 }
+        CheckBox {
+            checked: PlaylistSettings.skipDuplicates
+            text: i18nc("@option:check", "Don't add files that are already in the playlist")
+            onClicked: {
+                PlaylistSettings.skipDuplicates = checked
+                PlaylistSettings.save()
+            }
+        }
+
         Item { Layout.preferredWidth: 1; Layout.preferredHeight: 1 }
         CheckBox {
             checked: PlaylistSettings.showRowNumber
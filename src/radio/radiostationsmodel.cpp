@@ -30,6 +30,11 @@ RadioStationsModel::RadioStationsModel(QObject *parent)
     loadFavorites();
 }
 
+RadioStationsModel::~RadioStationsModel()
+{
+    m_parseTasks.cancelAndWait();
+}
+
 void RadioStationsModel::discoverServers()
 {
     // Not needed - using static list of known working servers
@@ -329,38 +334,62 @@ void RadioStationsModel::handleSearchReply(QNetworkReply *reply)
 
 void RadioStationsModel::processStations(const QByteArray &data)
 {
-    QJsonParseError parseError;
-    QJsonDocument doc = QJsonDocument::fromJson(data, &parseError);
+    // a search with thousands of results takes a while to parse, the gui thread doesn't wait for it
+    m_parseTasks.cancel();
+    const auto generation = ++m_parseGeneration;
+    const auto scheduler = TaskScheduler::instance();
+    scheduler->submit(TaskScheduler::Lane::Interactive, TaskScheduler::Resource::Cpu, QString(), m_parseTasks, [this, data, generation]() {
+        QString error;
+        QList<RadioStation> stations;
+
+        QJsonParseError parseError;
+        QJsonDocument doc = QJsonDocument::fromJson(data, &parseError);
+        if (parseError.error != QJsonParseError::NoError) {
+            error = QStringLiteral("JSON parse error: ") + parseError.errorString();
+        } else if (!doc.isArray()) {
+            error = QStringLiteral("Expected JSON array");
+        } else {
+            const QJsonArray array = doc.array();
+            stations.reserve(array.size());
+            for (const QJsonValue &value : array) {
+                if (value.isObject()) {
+                    RadioStation station(value.toObject());
+                    if (station.isValid()) {
+                        stations.append(station);
+                    }
+                }
+            }
+        }
 
-    if (parseError.error != QJsonParseError::NoError) {
-        m_lastError = QStringLiteral("JSON parse error: ") + parseError.errorString();
-        Q_EMIT lastErrorChanged();
-        qWarning() << m_lastError;
+        QMetaObject::invokeMethod(
+            this,
+            [this, generation, error, stations]() {
+                applyStations(generation, error, stations);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+void RadioStationsModel::applyStations(quint64 generation, const QString &error, const QList<RadioStation> &stations)
+{
+    if (generation != m_parseGeneration) {
+        // another search was made or the results were replaced
         return;
     }
 
-    if (!doc.isArray()) {
-        m_lastError = QStringLiteral("Expected JSON array");
+    if (!error.isEmpty()) {
+        m_lastError = error;
         Q_EMIT lastErrorChanged();
         qWarning() << m_lastError;
         return;
     }
 
     beginResetModel();
-    m_stations.clear();
-
-    QJsonArray array = doc.array();
-    for (const QJsonValue &value : array) {
-        if (value.isObject()) {
-            RadioStation station(value.toObject());
-            if (station.isValid()) {
-                // Check if this station is in favorites
-                station.isFavorite = isFavoriteStation(station.stationuuid);
-                m_stations.append(station);
-            }
-        }
+    m_stations = stations;
+    for (RadioStation &station : m_stations) {
+        // Check if this station is in favorites
+        station.isFavorite = isFavoriteStation(station.stationuuid);
     }
-
     endResetModel();
 
     qDebug() << "Loaded" << m_stations.count() << "radio stations";
@@ -369,6 +398,7 @@ void RadioStationsModel::processStations(const QByteArray &data)
 
 void RadioStationsModel::showFavorites()
 {
+    ++m_parseGeneration;
     beginResetModel();
     m_stations = m_favoriteStations;
     endResetModel();
@@ -428,6 +458,7 @@ void RadioStationsModel::playStation(int index)
 
 void RadioStationsModel::clearResults()
 {
+    ++m_parseGeneration;
     beginResetModel();
     m_stations.clear();
     endResetModel();
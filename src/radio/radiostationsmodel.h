@@ -12,6 +12,7 @@
 #include <QHostInfo>
 #include <qqml.h>
 #include "radiostation.h"
+#include "taskscheduler.h"
 
 
 class RadioStationsModel : public QAbstractListModel
@@ -44,7 +45,7 @@ public:
     };
 
     explicit RadioStationsModel(QObject *parent = nullptr);
-    ~RadioStationsModel() override = default;
+    ~RadioStationsModel() override;
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
@@ -76,7 +77,9 @@ private:
     void searchByTag(const QString &tag);
     void retrySearch();
     void handleSearchReply(QNetworkReply *reply);
+    // parses the reply on a TaskScheduler thread, the stations are set by applyStations
     void processStations(const QByteArray &data);
+    void applyStations(quint64 generation, const QString &error, const QList<RadioStation> &stations);
     QString getFavoritesFilePath() const;
     bool isFavoriteStation(const QString &uuid) const;
     void discoverServers();
@@ -103,6 +106,10 @@ private:
     
     // Track current request to prevent crashes
     QNetworkReply *m_currentReply{nullptr};
+
+    // bumped when the results change, so the results of an older parse are dropped
+    quint64 m_parseGeneration{0};
+    TaskToken m_parseTasks;
     
     // Server discovery
     bool m_serversDiscovered{false};
@@ -0,0 +1,522 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "thumbnailcache.h"
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QStandardPaths>
+#include <QUrl>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "performancelog.h"
+#include "taskscheduler.h"
+
+namespace
+{
+constexpr std::array<int, 4> BucketWidths{128, 256, 512, 1024};
+constexpr int JpegQuality = 85;
+// decoded thumbnails kept in memory, in KiB
+constexpr qint64 MemoryCacheSize = 64 * 1024;
+// a pack is compacted when at least this much of it, and more than half, are replaced records
+constexpr qint64 MinCompactSize = 16 * 1024 * 1024;
+// a bigger pack loses its least recently used thumbnails when it's opened,
+// down to EvictedPackSize, so it isn't rewritten on every start
+constexpr qint64 MaxPackSize = 128 * 1024 * 1024;
+constexpr qint64 EvictedPackSize = MaxPackSize * 3 / 4;
+constexpr qint64 PathHashSize = 16;
+
+constexpr char PackMagic[8] = {'H', 'T', 'H', 'U', 'M', 'B', '0', '1'};
+constexpr qint64 PackHeaderSize = sizeof(PackMagic);
+constexpr quint32 RecordMagic = 0x48544d42;
+// the header appended to a pack that was replaced by its compacted copy
+constexpr quint32 ReplacedMagic = 0x48545250;
+// how long a thumbnail task waits for another instance using the pack
+constexpr int LockTimeout = 5000;
+
+// the cache is not shared between machines, the header is written in native byte order
+struct RecordHeader {
+    quint32 magic;
+    quint32 size;
+    char pathHash[16];
+    qint64 lastModified;
+    qint64 fileSize;
+};
+static_assert(sizeof(RecordHeader) == 40);
+constexpr qint64 RecordHeaderSize = sizeof(RecordHeader);
+} // namespace
+
+ThumbnailCache *ThumbnailCache::instance()
+{
+    static ThumbnailCache c;
+    return &c;
+}
+
+ThumbnailCache::ThumbnailCache()
+{
+    m_memory.setMaxCost(MemoryCacheSize);
+
+    // made on a thumbnail task, the thread has no event loop to queue to
+    if (QCoreApplication::instance()) {
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, QCoreApplication::instance(), [this]() {
+            saveUsage();
+            printStats();
+        });
+    }
+
+    const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+    TaskScheduler::instance()->submit(TaskScheduler::Lane::Background,
+                                      TaskScheduler::Resource::Disk,
+                                      TaskScheduler::diskKey(cacheDir),
+                                      &ThumbnailCache::removeLegacyThumbnails);
+}
+
+ThumbnailCache::~ThumbnailCache() = default;
+
+ThumbnailCache::Key ThumbnailCache::key(const QString &path, int width)
+{
+    Key key;
+    const QFileInfo fileInfo(path);
+    if (!fileInfo.isFile()) {
+        return key;
+    }
+    key.pathHash = QCryptographicHash::hash(QUrl::fromUserInput(path).toString().toUtf8(), QCryptographicHash::Md5);
+    key.lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+    key.fileSize = fileInfo.size();
+    key.bucketWidth = bucketWidth(width);
+    return key;
+}
+
+int ThumbnailCache::bucketWidth(int width)
+{
+    for (const int bucket : BucketWidths) {
+        if (width <= bucket) {
+            return bucket;
+        }
+    }
+    return BucketWidths.back();
+}
+
+QImage ThumbnailCache::find(const Key &key)
+{
+    if (!key.isValid()) {
+        return QImage();
+    }
+
+    const auto memoryKey = ThumbnailCache::memoryKey(key);
+    QByteArray data;
+    {
+        QMutexLocker locker(&m_mutex);
+        auto pack = this->pack(key.bucketWidth);
+        const auto entry = m_memory.object(memoryKey);
+        if (entry && entry->lastModified == key.lastModified && entry->fileSize == key.fileSize) {
+            ++m_memoryHits;
+            if (pack) {
+                const auto it = pack->records.find(key.pathHash);
+                if (it != pack->records.end()) {
+                    it->lastUsed = ++pack->useCount;
+                }
+            }
+            return entry->image;
+        }
+
+        if (!pack) {
+            ++m_misses;
+            return QImage();
+        }
+        const auto it = pack->records.find(key.pathHash);
+        if (it == pack->records.end()) {
+            ++m_misses;
+            return QImage();
+        }
+        if (it->lastModified != key.lastModified || it->fileSize != key.fileSize) {
+            ++m_staleEntries;
+            return QImage();
+        }
+        it->lastUsed = ++pack->useCount;
+        if (it->offset + it->size <= pack->mappedSize) {
+            // the mapping stays valid until the pack is closed, it's only decoded outside the lock
+            data = QByteArray::fromRawData(reinterpret_cast<const char *>(pack->map + it->offset), it->size);
+        } else if (pack->file.seek(it->offset)) {
+            data = pack->file.read(it->size);
+        }
+    }
+
+    QImage image = QImage::fromData(data, "JPG");
+
+    QMutexLocker locker(&m_mutex);
+    if (image.isNull()) {
+        ++m_misses;
+        return image;
+    }
+    ++m_diskHits;
+    m_memory.insert(memoryKey, new MemoryEntry{image, key.lastModified, key.fileSize}, image.sizeInBytes() / 1024 + 1);
+    return image;
+}
+
+void ThumbnailCache::insert(const Key &key, const QImage &image)
+{
+    if (!key.isValid() || image.isNull()) {
+        return;
+    }
+
+    // jpeg encodes several times faster than png and is a fraction of the size for video frames
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    if (!image.save(&buffer, "JPG", JpegQuality)) {
+        qDebug() << "ThumbnailCache: could not encode thumbnail";
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_memory.insert(memoryKey(key), new MemoryEntry{image, key.lastModified, key.fileSize}, image.sizeInBytes() / 1024 + 1);
+
+    if (!this->pack(key.bucketWidth)) {
+        return;
+    }
+    QLockFile lock(lockPath(packPath(key.bucketWidth)));
+    if (!lock.tryLock(LockTimeout)) {
+        qDebug() << "ThumbnailCache: could not lock" << lock.error();
+        return;
+    }
+    // appended after the records of the other instances, not over them
+    auto pack = readAppended(key.bucketWidth);
+    if (!pack) {
+        return;
+    }
+    RecordHeader header{RecordMagic, static_cast<quint32>(data.size()), {}, key.lastModified, key.fileSize};
+    std::memcpy(header.pathHash, key.pathHash.constData(), std::min<qsizetype>(key.pathHash.size(), sizeof(header.pathHash)));
+
+    if (!pack->file.seek(pack->size) || pack->file.write(reinterpret_cast<const char *>(&header), RecordHeaderSize) != RecordHeaderSize
+        || pack->file.write(data) != data.size()) {
+        qDebug() << "ThumbnailCache: could not write to" << pack->file.fileName();
+        // nothing maps past pack->size yet
+        pack->file.resize(pack->size);
+        return;
+    }
+
+    const auto previous = pack->records.constFind(key.pathHash);
+    if (previous != pack->records.cend()) {
+        pack->deadBytes += RecordHeaderSize + previous->size;
+    }
+    pack->records.insert(key.pathHash,
+                         {pack->size + RecordHeaderSize, static_cast<quint32>(data.size()), key.lastModified, key.fileSize, ++pack->useCount});
+    pack->size += RecordHeaderSize + data.size();
+    m_bytesWritten += RecordHeaderSize + data.size();
+}
+
+int ThumbnailCache::bucketIndex(int bucketWidth)
+{
+    for (std::size_t i = 0; i < BucketWidths.size(); ++i) {
+        if (BucketWidths[i] == bucketWidth) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+QString ThumbnailCache::memoryKey(const Key &key)
+{
+    return QString::fromLatin1(key.pathHash.toHex()) + QLatin1Char('/') + QString::number(key.bucketWidth);
+}
+
+QString ThumbnailCache::packPath(int bucketWidth) const
+{
+    const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+    return QStringLiteral("%1/haruna/thumbnails/%2.pack").arg(cacheDir, QString::number(bucketWidth));
+}
+
+QString ThumbnailCache::usedPath(const QString &packPath)
+{
+    return packPath + QStringLiteral(".used");
+}
+
+QString ThumbnailCache::lockPath(const QString &packPath)
+{
+    return packPath + QStringLiteral(".lock");
+}
+
+ThumbnailCache::Pack *ThumbnailCache::pack(int bucketWidth)
+{
+    const int index = bucketIndex(bucketWidth);
+    if (index < 0) {
+        return nullptr;
+    }
+    auto &pack = m_packs[index];
+    if (!pack) {
+        const auto path = packPath(bucketWidth);
+        if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+            qDebug() << "ThumbnailCache: could not create the folder of" << path;
+            return nullptr;
+        }
+        QLockFile lock(lockPath(path));
+        if (!lock.tryLock(LockTimeout)) {
+            // tried again on the next use
+            qDebug() << "ThumbnailCache: could not lock" << path << lock.error();
+            return nullptr;
+        }
+        pack = std::make_unique<Pack>();
+        if (openPack(pack.get(), path) && ((pack->deadBytes >= MinCompactSize && pack->deadBytes * 2 > pack->size) || pack->size > MaxPackSize)) {
+            compactPack(pack.get(), path);
+        }
+    }
+    return pack->opened ? pack.get() : nullptr;
+}
+
+bool ThumbnailCache::openPack(Pack *pack, const QString &path)
+{
+    pack->file.setFileName(path);
+    // the other instances append to it too, nothing may be read from a stale buffer
+    if (!pack->file.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+        qDebug() << "ThumbnailCache: could not open" << path;
+        return false;
+    }
+    if (pack->file.read(PackHeaderSize) != QByteArray(PackMagic, PackHeaderSize)) {
+        // new, or written by an incompatible version
+        pack->file.resize(0);
+        pack->file.write(PackMagic, PackHeaderSize);
+    }
+
+    pack->size = pack->file.size();
+    if (pack->size > PackHeaderSize) {
+        pack->map = pack->file.map(0, pack->size);
+    }
+    pack->mappedSize = pack->map ? pack->size : 0;
+
+    // a replaced mark here is left from a compaction that couldn't rename its copy, it's dropped like a torn record
+    const qint64 position = indexRecords(pack, PackHeaderSize, pack->size, nullptr);
+    if (position < pack->size) {
+        // appends are made holding the lock, this one was cut short by a crash
+        qDebug() << "ThumbnailCache: dropping" << pack->size - position << "bytes of a torn record in" << path;
+        pack->file.resize(position);
+        pack->size = position;
+        pack->mappedSize = std::min(pack->mappedSize, position);
+    }
+    pack->openedUseCount = pack->useCount;
+
+    // the records used after the pack was written, least recently used first
+    QFile usedFile(usedPath(path));
+    if (usedFile.open(QIODevice::ReadOnly)) {
+        const auto used = usedFile.readAll();
+        for (qsizetype i = 0; i + PathHashSize <= used.size(); i += PathHashSize) {
+            const auto it = pack->records.find(used.mid(i, PathHashSize));
+            if (it != pack->records.end()) {
+                it->lastUsed = ++pack->useCount;
+            }
+        }
+    }
+
+    pack->opened = true;
+    return true;
+}
+
+ThumbnailCache::Pack *ThumbnailCache::readAppended(int bucketWidth)
+{
+    auto &pack = m_packs[bucketIndex(bucketWidth)];
+    const qint64 end = pack->file.size();
+    bool replaced{false};
+    const qint64 position = indexRecords(pack.get(), pack->size, end, &replaced);
+    if (replaced) {
+        qDebug() << "ThumbnailCache: reopening" << pack->file.fileName() << "replaced by another instance";
+        m_replacedPacks.push_back(std::move(pack));
+        pack = std::make_unique<Pack>();
+        openPack(pack.get(), packPath(bucketWidth));
+        return pack->opened ? pack.get() : nullptr;
+    }
+    if (position < end) {
+        qDebug() << "ThumbnailCache: dropping" << end - position << "bytes of a torn record in" << pack->file.fileName();
+        pack->file.resize(position);
+    }
+    pack->size = position;
+    return pack.get();
+}
+
+qint64 ThumbnailCache::indexRecords(Pack *pack, qint64 position, qint64 end, bool *replaced)
+{
+    // the records appended after the pack was mapped are read from the file
+    auto readAt = [pack](qint64 offset, qint64 size) {
+        if (offset + size <= pack->mappedSize) {
+            return QByteArray::fromRawData(reinterpret_cast<const char *>(pack->map + offset), size);
+        }
+        pack->file.seek(offset);
+        return pack->file.read(size);
+    };
+
+    while (position + RecordHeaderSize <= end) {
+        RecordHeader header;
+        const auto headerData = readAt(position, RecordHeaderSize);
+        if (headerData.size() != RecordHeaderSize) {
+            break;
+        }
+        std::memcpy(&header, headerData.constData(), RecordHeaderSize);
+        if (header.magic == ReplacedMagic && replaced) {
+            *replaced = true;
+            break;
+        }
+        if (header.magic != RecordMagic || position + RecordHeaderSize + header.size > end) {
+            break;
+        }
+        const QByteArray pathHash(header.pathHash, sizeof(header.pathHash));
+        const auto previous = pack->records.constFind(pathHash);
+        if (previous != pack->records.cend()) {
+            pack->deadBytes += RecordHeaderSize + previous->size;
+        }
+        pack->records.insert(pathHash, {position + RecordHeaderSize, header.size, header.lastModified, header.fileSize, ++pack->useCount});
+        position += RecordHeaderSize + header.size;
+    }
+    return position;
+}
+
+void ThumbnailCache::compactPack(Pack *pack, const QString &path)
+{
+    const auto newPath = path + QStringLiteral(".new");
+    QFile newFile(newPath);
+    if (!newFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return;
+    }
+    newFile.write(PackMagic, PackHeaderSize);
+
+    // written least recently used first, the order is the recency when it's opened again
+    std::vector<QHash<QByteArray, Record>::const_iterator> records;
+    records.reserve(pack->records.size());
+    qint64 liveSize{PackHeaderSize};
+    for (auto it = pack->records.cbegin(); it != pack->records.cend(); ++it) {
+        records.push_back(it);
+        liveSize += RecordHeaderSize + it->size;
+    }
+    std::sort(records.begin(), records.end(), [](const auto &a, const auto &b) {
+        return a->lastUsed < b->lastUsed;
+    });
+    auto first = records.cbegin();
+    if (liveSize > MaxPackSize) {
+        while (first != records.cend() && liveSize > EvictedPackSize) {
+            liveSize -= RecordHeaderSize + (*first)->size;
+            ++first;
+        }
+    }
+
+    for (auto record = first; record != records.cend(); ++record) {
+        const auto &it = *record;
+        QByteArray data;
+        if (it->offset + it->size <= pack->mappedSize) {
+            data = QByteArray::fromRawData(reinterpret_cast<const char *>(pack->map + it->offset), it->size);
+        } else if (pack->file.seek(it->offset)) {
+            data = pack->file.read(it->size);
+        }
+        if (data.size() != static_cast<qsizetype>(it->size)) {
+            continue;
+        }
+        RecordHeader header{RecordMagic, it->size, {}, it->lastModified, it->fileSize};
+        std::memcpy(header.pathHash, it.key().constData(), std::min<qsizetype>(it.key().size(), sizeof(header.pathHash)));
+        newFile.write(reinterpret_cast<const char *>(&header), RecordHeaderSize);
+        newFile.write(data);
+    }
+    if (!newFile.flush()) {
+        newFile.remove();
+        return;
+    }
+    newFile.close();
+
+    const auto before = pack->size;
+    // the instances that have the old file open reopen the pack when they see it
+    const RecordHeader replaced{ReplacedMagic, 0, {}, 0, 0};
+    if (!pack->file.seek(pack->size) || pack->file.write(reinterpret_cast<const char *>(&replaced), RecordHeaderSize) != RecordHeaderSize) {
+        newFile.remove();
+        return;
+    }
+    // closing the file unmaps it
+    pack->file.close();
+    pack->map = nullptr;
+    pack->mappedSize = 0;
+    pack->size = 0;
+    pack->deadBytes = 0;
+    pack->records.clear();
+    pack->opened = false;
+    QFile::remove(path);
+    QFile::rename(newPath, path);
+    QFile::remove(usedPath(path));
+    openPack(pack, path);
+    qCDebug(HARUNA_PERFORMANCE) << "ThumbnailCache: compacted" << path << "from" << before / 1024 << "KiB to" << pack->size / 1024 << "KiB";
+}
+
+void ThumbnailCache::saveUsage()
+{
+    QMutexLocker locker(&m_mutex);
+    for (std::size_t i = 0; i < m_packs.size(); ++i) {
+        const auto &pack = m_packs[i];
+        if (!pack || !pack->opened) {
+            continue;
+        }
+        std::vector<QHash<QByteArray, Record>::const_iterator> used;
+        for (auto it = pack->records.cbegin(); it != pack->records.cend(); ++it) {
+            if (it->lastUsed > pack->openedUseCount) {
+                used.push_back(it);
+            }
+        }
+        const auto path = usedPath(packPath(BucketWidths[i]));
+        if (used.empty()) {
+            QFile::remove(path);
+            continue;
+        }
+        std::sort(used.begin(), used.end(), [](const auto &a, const auto &b) {
+            return a->lastUsed < b->lastUsed;
+        });
+        QByteArray data;
+        data.reserve(used.size() * PathHashSize);
+        for (const auto &it : used) {
+            data.append(it.key());
+        }
+        QFile file(path);
+        if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            file.write(data);
+        }
+    }
+}
+
+void ThumbnailCache::removeLegacyThumbnails()
+{
+    const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/haruna");
+    const QString marker = cacheDir + QStringLiteral("/thumbnails/legacy-removed");
+    if (QFile::exists(marker)) {
+        return;
+    }
+
+    // only the folders holding the png named like them, md5 hex of the url
+    const QDir dir(cacheDir);
+    const auto entries = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const auto &entry : entries) {
+        const bool md5Name = entry.size() == 32 && std::all_of(entry.cbegin(), entry.cend(), [](QChar c) {
+                                 return c.isDigit() || (c >= u'a' && c <= u'f');
+                             });
+        if (md5Name && QFileInfo::exists(dir.filePath(entry + u'/' + entry + QStringLiteral(".png")))) {
+            QDir(dir.filePath(entry)).removeRecursively();
+        }
+    }
+
+    QDir().mkpath(QFileInfo(marker).absolutePath());
+    QFile file(marker);
+    file.open(QIODevice::WriteOnly);
+}
+
+void ThumbnailCache::printStats()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_memoryHits + m_diskHits + m_staleEntries + m_misses == 0) {
+        return;
+    }
+    qCDebug(HARUNA_PERFORMANCE) << "ThumbnailCache:" << m_memoryHits << "memory hits," << m_diskHits << "disk hits," << m_staleEntries << "outdated,"
+                                << m_misses << "misses," << m_bytesWritten / 1024 << "KiB written";
+}
+
+#include "moc_thumbnailcache.cpp"
@@ -0,0 +1,154 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QFile>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+
+#include <array>
+#include <memory>
+#include <vector>
+
+/**
+ * Disk and memory cache of the playlist thumbnails.
+ *
+ * Thumbnails are made in a few widths (buckets), a request gets the smallest bucket
+ * at least as wide as it asked for. Each bucket is a single pack file of JPEG images
+ * appended one after the other, the pack is memory mapped and indexed when first used,
+ * so a lookup is a hash lookup and decoding from the mapping, no file is opened per hit.
+ * An entry is only used while the modification time and size of the file are the ones
+ * it was made from, a replaced file gets a new thumbnail.
+ *
+ * A pack is kept under MaxPackSize: when it's opened bigger than that, it's rewritten
+ * without the least recently used thumbnails. The order of a pack is its recency,
+ * the thumbnails used after it was written are saved to a .used file next to it on
+ * exit and moved to the end when it's opened.
+ *
+ * The packs are shared by the running instances of Haruna. Opening, compacting and
+ * appending to a pack is done holding a lock file next to it; before appending, an
+ * instance indexes the records the others appended since it last looked. Compacting
+ * replaces the file, the old one is marked so the instances still using it reopen
+ * the pack. A pack is only cut down to its last complete record, the mappings of the
+ * other instances never reach past it.
+ *
+ * The recently used thumbnails are also kept decoded in memory.
+ *
+ * Thread safe, used by the thumbnail tasks.
+ */
+class ThumbnailCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ThumbnailCache *instance();
+
+    struct Key {
+        // md5 of the url of the file
+        QByteArray pathHash;
+        qint64 lastModified{0};
+        qint64 fileSize{0};
+        int bucketWidth{0};
+
+        bool isValid() const
+        {
+            return !pathHash.isEmpty();
+        }
+    };
+
+    // invalid when path is not an existing file
+    static Key key(const QString &path, int width);
+    // the width thumbnails requested with width are made with
+    static int bucketWidth(int width);
+
+    // null when there is no thumbnail for key, or it was made from an older version of the file
+    QImage find(const Key &key);
+    void insert(const Key &key, const QImage &image);
+
+private:
+    ThumbnailCache();
+    ~ThumbnailCache();
+
+    ThumbnailCache(const ThumbnailCache &) = delete;
+    ThumbnailCache &operator=(const ThumbnailCache &) = delete;
+    ThumbnailCache(ThumbnailCache &&) = delete;
+    ThumbnailCache &operator=(ThumbnailCache &&) = delete;
+
+    static constexpr int BucketCount = 4;
+
+    struct Record {
+        // of the image data, after the record header
+        qint64 offset{0};
+        quint32 size{0};
+        qint64 lastModified{0};
+        qint64 fileSize{0};
+        // Pack::useCount when it was last found or written
+        qint64 lastUsed{0};
+    };
+
+    struct Pack {
+        QFile file;
+        // the whole file as it was when it was opened, records appended later are read from file
+        uchar *map{nullptr};
+        qint64 mappedSize{0};
+        qint64 size{0};
+        // bytes of records replaced by newer ones
+        qint64 deadBytes{0};
+        QHash<QByteArray, Record> records;
+        // the records up to it were not used since the pack was opened
+        qint64 openedUseCount{0};
+        qint64 useCount{0};
+        bool opened{false};
+    };
+
+    struct MemoryEntry {
+        QImage image;
+        qint64 lastModified;
+        qint64 fileSize;
+    };
+
+    static int bucketIndex(int bucketWidth);
+    static QString memoryKey(const Key &key);
+    QString packPath(int bucketWidth) const;
+    static QString usedPath(const QString &packPath);
+    static QString lockPath(const QString &packPath);
+    // opens and indexes the pack of the bucket on first use, must be called with m_mutex locked
+    Pack *pack(int bucketWidth);
+    // the functions below must be called with m_mutex locked and the lock file of the pack held
+    bool openPack(Pack *pack, const QString &path);
+    // indexes the records other instances appended since pack->size, reopens the pack when
+    // one of them replaced it; null when it can't be opened again
+    Pack *readAppended(int bucketWidth);
+    // indexes the complete records between position and end, returns where they end;
+    // replaced is set when it reached the mark compactPack() leaves in the file it replaces
+    static qint64 indexRecords(Pack *pack, qint64 position, qint64 end, bool *replaced);
+    // rewrites the pack in recency order, without the records that were replaced
+    // and, when it's bigger than MaxPackSize, the least recently used ones
+    void compactPack(Pack *pack, const QString &path);
+    // writes the records used since the packs were opened to their .used files
+    void saveUsage();
+    // thumbnails used to be a png per file in ~/.cache/haruna/<md5>/, they are deleted once
+    static void removeLegacyThumbnails();
+    void printStats();
+
+    QMutex m_mutex;
+    std::array<std::unique_ptr<Pack>, BucketCount> m_packs;
+    // packs another instance replaced, find() may still be decoding from their mappings
+    std::vector<std::unique_ptr<Pack>> m_replacedPacks;
+    QCache<QString, MemoryEntry> m_memory;
+
+    qint64 m_memoryHits{0};
+    qint64 m_diskHits{0};
+    qint64 m_staleEntries{0};
+    qint64 m_misses{0};
+    qint64 m_bytesWritten{0};
+};
+
+#endif // THUMBNAILCACHE_H
@@ -6,14 +6,59 @@
 
 #include "thumbnailimageprovider.h"
 
+#include <QCoreApplication>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QIcon>
+#include <QMutex>
+
+#include <algorithm>
 
 #include "miscutils.h"
+#include "performancelog.h"
+#include "thumbnailcache.h"
 #include "worker.h"
 
 using namespace Qt::StringLiterals;
 
+namespace
+{
+// how long it takes to fill a screen of thumbnails: from the first request after
+// an idle moment until no request is waiting anymore
+struct FillStats {
+    QMutex mutex;
+    QElapsedTimer timer;
+    int waiting{0};
+    int delivered{0};
+    int cancelled{0};
+
+    void requested()
+    {
+        QMutexLocker locker(&mutex);
+        if (waiting++ == 0) {
+            timer.start();
+            delivered = 0;
+            cancelled = 0;
+        }
+    }
+
+    void done(bool wasCancelled)
+    {
+        QMutexLocker locker(&mutex);
+        ++(wasCancelled ? cancelled : delivered);
+        if (--waiting == 0) {
+            qCDebug(HARUNA_PERFORMANCE) << "ThumbnailImageProvider:" << delivered << "thumbnails in" << timer.elapsed() << "ms," << cancelled << "cancelled";
+        }
+    }
+};
+
+FillStats &fillStats()
+{
+    static FillStats stats;
+    return stats;
+}
+} // namespace
+
 ThumbnailImageProvider::ThumbnailImageProvider()
 {
 }
@@ -24,59 +69,171 @@ QQuickImageResponse *ThumbnailImageProvider::requestImageResponse(const QString
     return response;
 }
 
+ThumbnailJobs *ThumbnailJobs::instance()
+{
+    static ThumbnailJobs j;
+    return &j;
+}
+
+ThumbnailJobs::ThumbnailJobs()
+{
+    if (QCoreApplication::instance()) {
+        QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, QCoreApplication::instance(), [this]() {
+            printStats();
+        });
+    }
+}
+
+void ThumbnailJobs::request(ThumbnailResponse *response, const QString &path, int width)
+{
+    const auto key = path + QLatin1Char('/') + QString::number(ThumbnailCache::bucketWidth(width));
+
+    QMutexLocker locker(&m_mutex);
+    ++m_requests;
+    m_keys.insert(response, key);
+    auto it = m_jobs.find(key);
+    if (it != m_jobs.end()) {
+        ++m_sharedRequests;
+        it->responses.push_back(response);
+        return;
+    }
+
+    it = m_jobs.insert(key, Job());
+    it->responses.push_back(response);
+    Worker::instance()->makePlaylistThumbnail(path, width, it->token, [this, key](const QImage &image) {
+        finish(key, image);
+    });
+}
+
+void ThumbnailJobs::cancel(ThumbnailResponse *response)
+{
+    QMutexLocker locker(&m_mutex);
+    const auto key = m_keys.take(response);
+    auto it = m_jobs.find(key);
+    if (key.isEmpty() || it == m_jobs.end()) {
+        return;
+    }
+    it->responses.erase(std::remove(it->responses.begin(), it->responses.end(), response), it->responses.end());
+    if (it->responses.empty()) {
+        it->token.cancel();
+        m_jobs.erase(it);
+    }
+}
+
+void ThumbnailJobs::finish(const QString &key, const QImage &image)
+{
+    // the responses are posted to while the lock is held, a response being
+    // destroyed waits for it in cancel(), then its pending events are dropped with it
+    QMutexLocker locker(&m_mutex);
+    const auto job = m_jobs.take(key);
+    if (image.isNull()) {
+        ++m_failures;
+    }
+    for (const auto response : job.responses) {
+        m_keys.remove(response);
+        QMetaObject::invokeMethod(
+            response,
+            [response, image]() {
+                response->deliver(image);
+            },
+            Qt::QueuedConnection);
+    }
+}
+
+void ThumbnailJobs::printStats()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_requests == 0) {
+        return;
+    }
+    qCDebug(HARUNA_PERFORMANCE) << "ThumbnailJobs:" << m_requests << "requests," << m_sharedRequests << "shared a thumbnail being made," << m_failures
+                                << "failed";
+}
+
 ThumbnailResponse::ThumbnailResponse(const QString &id, const QSize &requestedSize)
+    : m_id{id}
+    , m_requestedSize{requestedSize}
 {
-    connect(
-        Worker::instance(),
-        &Worker::thumbnailSuccess,
-        this,
-        [=](const QString &path, const QImage &image) {
-            if (path == QUrl::fromUserInput(id).toLocalFile()) {
-                m_texture = QQuickTextureFactory::textureFactoryForImage(image);
-                Q_EMIT finished();
-            }
-        },
-        Qt::QueuedConnection);
-
-    connect(
-        Worker::instance(),
-        &Worker::thumbnailFail,
-        this,
-        [=]() {
-            auto url = QUrl::fromUserInput(id);
-            if (url.scheme() != QStringLiteral("file")) {
-                return;
-            }
-            QString mimeType = MiscUtils::mimeType(url);
-            QString iconName;
-            if (mimeType.startsWith(QStringLiteral("video/"))) {
-                iconName = QStringLiteral("video-x-generic");
-            } else if (mimeType.startsWith(QStringLiteral("audio/"))) {
-                iconName = QStringLiteral("audio-x-generic");
-            } else {
-                return;
-            }
-            auto icon = QIcon::fromTheme(iconName).pixmap(requestedSize);
-            m_texture = QQuickTextureFactory::textureFactoryForImage(icon.toImage());
-
-            Q_EMIT finished();
-        },
-        Qt::QueuedConnection);
     getPreview(id, requestedSize);
 }
 
+ThumbnailResponse::~ThumbnailResponse()
+{
+    if (m_queued) {
+        ThumbnailJobs::instance()->cancel(this);
+    }
+}
+
 void ThumbnailResponse::getPreview(const QString &id, const QSize &requestedSize)
 {
     auto url = QUrl::fromUserInput(id);
     if (QFile(url.toLocalFile()).exists()) {
-        Worker::instance()->makePlaylistThumbnail(url.toLocalFile(), requestedSize.width());
+        m_queued = true;
+        fillStats().requested();
+        ThumbnailJobs::instance()->request(this, url.toLocalFile(), requestedSize.width());
+        return;
     }
 
     if (url.scheme() == QStringLiteral("http") || url.scheme() == QStringLiteral("https")) {
         auto icon = QIcon::fromTheme(QStringLiteral("im-youtube"), QIcon::fromTheme(QStringLiteral("video-x-generic")));
         m_texture = QQuickTextureFactory::textureFactoryForImage(icon.pixmap(requestedSize).toImage());
-        Q_EMIT finished();
     }
+    finish();
+}
+
+void ThumbnailResponse::deliver(const QImage &image)
+{
+    if (m_finished) {
+        return;
+    }
+    if (!image.isNull()) {
+        m_texture = QQuickTextureFactory::textureFactoryForImage(image);
+        finish();
+        return;
+    }
+
+    // no thumbnail, audio and video files get an icon
+    const auto url = QUrl::fromUserInput(m_id);
+    const QString mimeType = MiscUtils::mimeType(url);
+    QString iconName;
+    if (mimeType.startsWith(QStringLiteral("video/"))) {
+        iconName = QStringLiteral("video-x-generic");
+    } else if (mimeType.startsWith(QStringLiteral("audio/"))) {
+        iconName = QStringLiteral("audio-x-generic");
+    }
+    if (!iconName.isEmpty()) {
+        auto icon = QIcon::fromTheme(iconName).pixmap(m_requestedSize);
+        m_texture = QQuickTextureFactory::textureFactoryForImage(icon.toImage());
+    }
+    finish();
+}
+
+void ThumbnailResponse::cancel()
+{
+    if (m_finished) {
+        return;
+    }
+    if (m_queued) {
+        ThumbnailJobs::instance()->cancel(this);
+        fillStats().done(true);
+        m_queued = false;
+    }
+    // the engine still waits for finished() to clean up
+    m_finished = true;
+    Q_EMIT finished();
+}
+
+void ThumbnailResponse::finish()
+{
+    if (m_finished) {
+        return;
+    }
+    if (m_queued) {
+        fillStats().done(false);
+        m_queued = false;
+    }
+    m_finished = true;
+    Q_EMIT finished();
 }
 
 QQuickTextureFactory *ThumbnailResponse::textureFactory() const
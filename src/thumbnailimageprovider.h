@@ -7,8 +7,16 @@
 #ifndef THUMBNAILIMAGEPROVIDER_H
 #define THUMBNAILIMAGEPROVIDER_H
 
+#include <QHash>
+#include <QMutex>
 #include <QQuickAsyncImageProvider>
 
+#include <vector>
+
+#include "taskscheduler.h"
+
+class ThumbnailResponse;
+
 class ThumbnailImageProvider : public QQuickAsyncImageProvider
 {
 public:
@@ -16,15 +24,75 @@ public:
     QQuickImageResponse *requestImageResponse(const QString &id, const QSize &requestedSize) override;
 };
 
+/**
+ * The thumbnails being made for ThumbnailResponses.
+ *
+ * Requests for the same file and thumbnail width bucket share one job, the image
+ * is delivered only to the responses waiting for it. A job is cancelled when the
+ * last of its responses is.
+ */
+class ThumbnailJobs
+{
+public:
+    static ThumbnailJobs *instance();
+
+    void request(ThumbnailResponse *response, const QString &path, int width);
+    // also called when the response is destroyed, nothing is delivered to it afterwards
+    void cancel(ThumbnailResponse *response);
+
+private:
+    ThumbnailJobs();
+    ~ThumbnailJobs() = default;
+
+    ThumbnailJobs(const ThumbnailJobs &) = delete;
+    ThumbnailJobs &operator=(const ThumbnailJobs &) = delete;
+    ThumbnailJobs(ThumbnailJobs &&) = delete;
+    ThumbnailJobs &operator=(ThumbnailJobs &&) = delete;
+
+    struct Job {
+        TaskToken token;
+        std::vector<ThumbnailResponse *> responses;
+    };
+
+    // called on the thread that made the thumbnail
+    void finish(const QString &key, const QImage &image);
+    void printStats();
+
+    QMutex m_mutex;
+    // keyed by path and width bucket
+    QHash<QString, Job> m_jobs;
+    QHash<ThumbnailResponse *, QString> m_keys;
+
+    qint64 m_requests{0};
+    qint64 m_sharedRequests{0};
+    qint64 m_failures{0};
+};
+
 class ThumbnailResponse : public QQuickImageResponse
 {
 public:
     ThumbnailResponse(const QString &id, const QSize &requestedSize);
+    ~ThumbnailResponse() override;
 
     QQuickTextureFactory *textureFactory() const override;
+    // called when the delegate showing the image is destroyed, e.g. scrolled out of the view
+    void cancel() override;
     void getPreview(const QString &id, const QSize &requestedSize);
 
     QQuickTextureFactory *m_texture{nullptr};
+
+private:
+    friend class ThumbnailJobs;
+
+    // the result of the job, a null image when it failed
+    void deliver(const QImage &image);
+    // emits finished() once, the engine deletes the response after it
+    void finish();
+
+    QString m_id;
+    QSize m_requestedSize;
+    bool m_queued{false};
+    bool m_finished{false};
 };
 
 #endif // THUMBNAILIMAGEPROVIDER_H
@@ -0,0 +1,164 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "asyncfilewriter.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSaveFile>
+
+#include "performancelog.h"
+
+AsyncFileWriter *AsyncFileWriter::instance()
+{
+    static AsyncFileWriter w;
+    return &w;
+}
+
+AsyncFileWriter::AsyncFileWriter()
+{
+    // one thread, so requests are written in the order they were made
+    m_threadPool.setMaxThreadCount(1);
+
+    if (QCoreApplication::instance()) {
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, [this]() {
+            flush();
+            printStats();
+        });
+    }
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+    // requests made while the application was shutting down
+    flush();
+}
+
+void AsyncFileWriter::replace(const QString &path, const QByteArray &data)
+{
+    ++m_requests;
+
+    QMutexLocker locker(&m_mutex);
+    auto &requests = m_pending[path];
+    // whatever was queued before is overwritten anyway
+    requests.clear();
+    requests.push_back({Operation::Replace, data, {}});
+    schedule();
+}
+
+void AsyncFileWriter::append(const QString &path, const QByteArray &data, const QByteArray &header)
+{
+    ++m_requests;
+
+    QMutexLocker locker(&m_mutex);
+    auto &requests = m_pending[path];
+    if (!requests.empty() && requests.back().operation != Operation::Remove) {
+        // appending to a queued replace or append, the header is already taken care of
+        requests.back().data.append(data);
+    } else {
+        requests.push_back({Operation::Append, data, header});
+    }
+    schedule();
+}
+
+void AsyncFileWriter::remove(const QString &path)
+{
+    ++m_requests;
+
+    QMutexLocker locker(&m_mutex);
+    auto &requests = m_pending[path];
+    requests.clear();
+    requests.push_back({Operation::Remove, {}, {}});
+    schedule();
+}
+
+void AsyncFileWriter::flush()
+{
+    m_threadPool.waitForDone();
+}
+
+void AsyncFileWriter::addGuiThreadTime(qint64 nsecs)
+{
+    m_guiThreadNsecs += nsecs;
+}
+
+void AsyncFileWriter::schedule()
+{
+    // must be called with m_mutex locked
+    if (m_scheduled) {
+        return;
+    }
+    m_scheduled = true;
+    m_threadPool.start([this]() {
+        writePending();
+    });
+}
+
+void AsyncFileWriter::writePending()
+{
+    QHash<QString, std::vector<Request>> pending;
+    {
+        QMutexLocker locker(&m_mutex);
+        pending.swap(m_pending);
+        m_scheduled = false;
+    }
+
+    for (auto it = pending.cbegin(); it != pending.cend(); ++it) {
+        for (const auto &request : it.value()) {
+            QElapsedTimer timer;
+            timer.start();
+            if (write(it.key(), request)) {
+                ++m_writes;
+                m_bytes += request.data.size();
+            }
+            m_writeNsecs += timer.nsecsElapsed();
+        }
+    }
+}
+
+bool AsyncFileWriter::write(const QString &path, const Request &request)
+{
+    switch (request.operation) {
+    case Operation::Replace: {
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            qWarning() << "Could not write" << path << file.errorString();
+            return false;
+        }
+        file.write(request.data);
+        if (!file.commit()) {
+            qWarning() << "Could not write" << path << file.errorString();
+            return false;
+        }
+        return true;
+    }
+    case Operation::Append: {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            qWarning() << "Could not write" << path << file.errorString();
+            return false;
+        }
+        if (file.size() == 0) {
+            file.write(request.header);
+        }
+        return file.write(request.data) == request.data.size();
+    }
+    case Operation::Remove:
+        return QFile::remove(path);
+    }
+    return false;
+}
+
+void AsyncFileWriter::printStats()
+{
+    if (m_requests == 0) {
+        return;
+    }
+    qCDebug(HARUNA_PERFORMANCE) << "AsyncFileWriter:" << m_requests << "requests," << m_writes << "writes," << m_bytes << "bytes,"
+             << m_writeNsecs / 1000000.0 << "ms writing," << m_guiThreadNsecs / 1000000.0 << "ms on the gui thread";
+}
+
+#include "moc_asyncfilewriter.cpp"
@@ -0,0 +1,82 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef ASYNCFILEWRITER_H
+#define ASYNCFILEWRITER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+
+#include <atomic>
+#include <vector>
+
+/**
+ * Writes files on a background thread.
+ *
+ * Callers hand over the complete data (a snapshot), so nothing is shared with the writer.
+ * Requests for the same file that are still waiting are merged: a replace drops
+ * everything queued before it and consecutive appends become a single write.
+ * Replaced files are written atomically through QSaveFile.
+ */
+class AsyncFileWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    static AsyncFileWriter *instance();
+
+    // replaces the file with data
+    void replace(const QString &path, const QByteArray &data);
+    // appends data to the file, header is written first when the file is empty or doesn't exist
+    void append(const QString &path, const QByteArray &data, const QByteArray &header = QByteArray());
+    void remove(const QString &path);
+
+    // blocks until all queued requests are written
+    void flush();
+
+    // time the gui thread spent preparing data for the writer
+    void addGuiThreadTime(qint64 nsecs);
+
+private:
+    AsyncFileWriter();
+    ~AsyncFileWriter();
+
+    AsyncFileWriter(const AsyncFileWriter &) = delete;
+    AsyncFileWriter &operator=(const AsyncFileWriter &) = delete;
+    AsyncFileWriter(AsyncFileWriter &&) = delete;
+    AsyncFileWriter &operator=(AsyncFileWriter &&) = delete;
+
+    enum class Operation {
+        Replace,
+        Append,
+        Remove,
+    };
+
+    struct Request {
+        Operation operation;
+        QByteArray data;
+        QByteArray header;
+    };
+
+    void schedule();
+    void writePending();
+    bool write(const QString &path, const Request &request);
+    void printStats();
+
+    QMutex m_mutex;
+    QHash<QString, std::vector<Request>> m_pending;
+    bool m_scheduled{false};
+    QThreadPool m_threadPool;
+
+    std::atomic<qint64> m_requests{0};
+    std::atomic<qint64> m_writes{0};
+    std::atomic<qint64> m_bytes{0};
+    std::atomic<qint64> m_writeNsecs{0};
+    std::atomic<qint64> m_guiThreadNsecs{0};
+};
+
+#endif // ASYNCFILEWRITER_H
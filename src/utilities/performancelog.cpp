@@ -0,0 +1,7 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "performancelog.h"
+
+Q_LOGGING_CATEGORY(HARUNA_PERFORMANCE, "org.kde.haruna.performance", QtInfoMsg)
@@ -0,0 +1,14 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef PERFORMANCELOG_H
+#define PERFORMANCELOG_H
+
+#include <QLoggingCategory>
+
+// counters and timings of the playlist, thumbnail and background work,
+// off by default, enabled with QT_LOGGING_RULES="org.kde.haruna.performance.debug=true"
+Q_DECLARE_LOGGING_CATEGORY(HARUNA_PERFORMANCE)
+
+#endif // PERFORMANCELOG_H
@@ -0,0 +1,317 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "taskscheduler.h"
+#include "performancelog.h"
+
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QStorageInfo>
+#include <QThread>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace
+{
+// tasks of a lane that can't start (their resource is busy) before the next lane is looked at,
+// so a long queue for a busy disk isn't walked on every dispatch
+constexpr int MaxSkipped = 64;
+
+constexpr const char *LaneNames[] = {"interactive", "visible metadata", "thumbnails", "background"};
+} // namespace
+
+struct ResourceSlot::Holder {
+    explicit Holder(const QString &group)
+        : resourceGroup{group}
+    {
+    }
+    ~Holder()
+    {
+        TaskScheduler::instance()->release(resourceGroup);
+    }
+
+    QString resourceGroup;
+};
+
+TaskToken::TaskToken()
+    : d{std::make_shared<State>()}
+{
+}
+
+void TaskToken::cancel()
+{
+    ++d->generation;
+}
+
+void TaskToken::cancelAndWait()
+{
+    cancel();
+    QMutexLocker locker(&d->mutex);
+    while (d->running > 0) {
+        d->idle.wait(&d->mutex);
+    }
+}
+
+TaskScheduler *TaskScheduler::instance()
+{
+    static TaskScheduler s;
+    return &s;
+}
+
+TaskScheduler::TaskScheduler()
+{
+    // one of the threads is only used by the Interactive lane
+    m_maxThreads = std::max(2, QThread::idealThreadCount());
+    m_threadPool.setMaxThreadCount(m_maxThreads);
+
+    if (QCoreApplication::instance()) {
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &TaskScheduler::printStats);
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        for (auto &queue : m_queues) {
+            queue.clear();
+        }
+    }
+    m_threadPool.waitForDone();
+}
+
+void TaskScheduler::submit(Lane lane, Resource resource, const QString &key, const TaskToken &token, std::function<void()> task)
+{
+    auto &stats = m_stats[static_cast<int>(lane)];
+    ++stats.submitted;
+
+    QMutexLocker locker(&m_mutex);
+    auto &queue = m_queues[static_cast<int>(lane)];
+    Task queued{lane, resource, group(resource, key), token, token.d->generation, std::move(task), {}};
+    queued.queued.start();
+    if (lane == Lane::Thumbnails) {
+        // the latest requests are for what is on screen now, the older ones were mostly scrolled away
+        queue.push_front(std::move(queued));
+    } else {
+        queue.push_back(std::move(queued));
+    }
+    const int depth = static_cast<int>(queue.size());
+    if (depth > stats.maxQueueDepth) {
+        stats.maxQueueDepth = depth;
+    }
+    dispatch();
+    auto grants = std::exchange(m_grants, {});
+    locker.unlock();
+    deliver(std::move(grants));
+}
+
+void TaskScheduler::submit(Lane lane, Resource resource, const QString &key, std::function<void()> task)
+{
+    submit(lane, resource, key, TaskToken(), std::move(task));
+}
+
+void TaskScheduler::acquire(Lane lane, Resource resource, const QString &key, QObject *context, std::function<void(ResourceSlot)> granted)
+{
+    ++m_stats[static_cast<int>(lane)].submitted;
+
+    QMutexLocker locker(&m_mutex);
+    TaskToken token;
+    Task queued{lane, resource, group(resource, key), token, token.d->generation, {}, {}, context, std::move(granted)};
+    queued.queued.start();
+    m_queues[static_cast<int>(lane)].push_back(std::move(queued));
+    ++m_queuedSlots;
+    dispatch();
+    auto grants = std::exchange(m_grants, {});
+    locker.unlock();
+    deliver(std::move(grants));
+}
+
+void TaskScheduler::deliver(std::vector<Grant> grants)
+{
+    for (auto &grant : grants) {
+        if (!grant.context) {
+            continue;
+        }
+        // when context is destroyed before it runs, the functor and the slot go with it
+        QMetaObject::invokeMethod(
+            grant.context.data(),
+            [granted = std::move(grant.granted), slot = std::move(grant.slot)]() {
+                granted(slot);
+            },
+            Qt::QueuedConnection);
+    }
+}
+
+void TaskScheduler::release(const QString &resourceGroup)
+{
+    QMutexLocker locker(&m_mutex);
+    if (--m_runningPerGroup[resourceGroup] == 0) {
+        m_runningPerGroup.remove(resourceGroup);
+    }
+    dispatch();
+    auto grants = std::exchange(m_grants, {});
+    locker.unlock();
+    deliver(std::move(grants));
+}
+
+QString TaskScheduler::diskKey(const QString &path)
+{
+    // looking up the mount point reads the mount table, folders are looked up once
+    static QMutex mutex;
+    static QHash<QString, QString> devices;
+
+    const auto folder = QFileInfo(path).absolutePath();
+    QMutexLocker locker(&mutex);
+    auto it = devices.constFind(folder);
+    if (it == devices.cend()) {
+        it = devices.insert(folder, QString::fromUtf8(QStorageInfo(folder).device()));
+    }
+    return it.value();
+}
+
+int TaskScheduler::queueDepth(Lane lane) const
+{
+    QMutexLocker locker(&m_mutex);
+    return static_cast<int>(m_queues[static_cast<int>(lane)].size());
+}
+
+bool TaskScheduler::isCancelled(const Task &task)
+{
+    return task.generation != task.token.d->generation;
+}
+
+QString TaskScheduler::group(Resource resource, const QString &key)
+{
+    switch (resource) {
+    case Resource::Cpu:
+        return QStringLiteral("cpu");
+    case Resource::Disk:
+        return QStringLiteral("disk:") + key;
+    case Resource::Network:
+        return QStringLiteral("network");
+    case Resource::Process:
+        return QStringLiteral("process");
+    }
+    return QString();
+}
+
+int TaskScheduler::limit(Resource resource)
+{
+    switch (resource) {
+    case Resource::Cpu:
+        // only limited by the threads
+        return std::numeric_limits<int>::max();
+    case Resource::Disk:
+        // more readers only make a spinning disk seek
+        return 2;
+    case Resource::Network:
+        return 4;
+    case Resource::Process:
+        return 2;
+    }
+    return 1;
+}
+
+void TaskScheduler::dispatch()
+{
+    for (int lane = 0; lane < LaneCount; ++lane) {
+        const int threads = lane == static_cast<int>(Lane::Interactive) ? m_maxThreads : m_maxThreads - 1;
+        auto &queue = m_queues[lane];
+        int skipped{0};
+        for (auto it = queue.begin(); it != queue.end() && skipped < MaxSkipped;) {
+            const bool slot = static_cast<bool>(it->granted);
+            if (isCancelled(*it)) {
+                ++m_stats[lane].cancelled;
+                m_queuedSlots -= slot ? 1 : 0;
+                it = queue.erase(it);
+                continue;
+            }
+            if (!slot && m_running >= threads) {
+                // only the slots can still be granted
+                if (m_queuedSlots == 0) {
+                    break;
+                }
+                ++skipped;
+                ++it;
+                continue;
+            }
+            auto &running = m_runningPerGroup[it->resourceGroup];
+            if (running >= limit(it->resource)) {
+                ++skipped;
+                ++it;
+                continue;
+            }
+
+            ++running;
+            if (slot) {
+                --m_queuedSlots;
+                ++m_stats[lane].completed;
+                m_stats[lane].waitNsecs += it->queued.nsecsElapsed();
+                Grant grant{it->context, std::move(it->granted), {}};
+                grant.slot.d = std::make_shared<ResourceSlot::Holder>(it->resourceGroup);
+                m_grants.push_back(std::move(grant));
+                it = queue.erase(it);
+                continue;
+            }
+            ++m_running;
+            {
+                QMutexLocker locker(&it->token.d->mutex);
+                ++it->token.d->running;
+            }
+            m_stats[lane].waitNsecs += it->queued.nsecsElapsed();
+            m_threadPool.start([this, task = std::move(*it)]() mutable {
+                run(std::move(task));
+            });
+            it = queue.erase(it);
+        }
+    }
+}
+
+void TaskScheduler::run(Task task)
+{
+    const int lane = static_cast<int>(task.lane);
+    // cancelled while waiting for the thread
+    if (isCancelled(task)) {
+        ++m_stats[lane].cancelled;
+    } else {
+        task.run();
+        ++m_stats[lane].completed;
+    }
+
+    {
+        auto &state = *task.token.d;
+        QMutexLocker locker(&state.mutex);
+        if (--state.running == 0) {
+            state.idle.wakeAll();
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+    --m_running;
+    if (--m_runningPerGroup[task.resourceGroup] == 0) {
+        m_runningPerGroup.remove(task.resourceGroup);
+    }
+    dispatch();
+    auto grants = std::exchange(m_grants, {});
+    locker.unlock();
+    deliver(std::move(grants));
+}
+
+void TaskScheduler::printStats()
+{
+    for (int lane = 0; lane < LaneCount; ++lane) {
+        const auto &stats = m_stats[lane];
+        if (stats.submitted == 0) {
+            continue;
+        }
+        const qint64 started = std::max<qint64>(1, stats.completed);
+        qCDebug(HARUNA_PERFORMANCE) << "TaskScheduler:" << LaneNames[lane] << "lane," << stats.submitted << "submitted," << stats.completed
+                                    << "completed," << stats.cancelled << "cancelled," << stats.maxQueueDepth << "max queue depth,"
+                                    << stats.waitNsecs / started / 1000000.0 << "ms average wait";
+    }
+}
+
+#include "moc_taskscheduler.cpp"
@@ -0,0 +1,195 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * Groups the tasks of an owner, so they can be cancelled together.
+ *
+ * Copies share the same state. cancel() drops the tasks submitted with the token
+ * that haven't started, tasks submitted after it run normally.
+ */
+class TaskToken
+{
+public:
+    TaskToken();
+
+    void cancel();
+    // cancels, then blocks until the tasks of the token that are running are done;
+    // call it before destroying what the tasks use
+    void cancelAndWait();
+
+private:
+    friend class TaskScheduler;
+
+    struct State {
+        // bumped by cancel(), tasks submitted before it are dropped
+        std::atomic<quint64> generation{0};
+        QMutex mutex;
+        QWaitCondition idle;
+        int running{0};
+    };
+
+    std::shared_ptr<State> d;
+};
+
+/**
+ * A resource slot taken with TaskScheduler::acquire(), for work that doesn't need
+ * a thread, e.g. a subprocess driven by its signals.
+ *
+ * Copies share the slot, it's given back when the last one is destroyed.
+ */
+class ResourceSlot
+{
+public:
+    ResourceSlot() = default;
+
+    bool isValid() const
+    {
+        return d != nullptr;
+    }
+
+private:
+    friend class TaskScheduler;
+
+    struct Holder;
+    std::shared_ptr<Holder> d;
+};
+
+/**
+ * Runs the background work of the application on a single thread pool.
+ *
+ * Tasks go in a lane, the lanes are served in priority order. A thread is kept
+ * for the Interactive lane, so a queue of background work can't delay what the
+ * user is waiting for. The Thumbnails lane is served newest first, the others in
+ * the order the tasks were submitted.
+ *
+ * Tasks also say which resource they use. Disk tasks are limited per device,
+ * so reading metadata and thumbnails of a slow drive doesn't starve another one,
+ * network and subprocess tasks have a limit for the whole application. Work that
+ * waits on signals instead of a thread takes a slot of its resource with acquire().
+ */
+class TaskScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    // highest priority first
+    enum class Lane {
+        Interactive,
+        VisibleMetadata,
+        Thumbnails,
+        Background,
+    };
+
+    enum class Resource {
+        Cpu,
+        Disk,
+        Network,
+        Process,
+    };
+
+    static TaskScheduler *instance();
+
+    // key splits the resource, for Disk tasks it's the device, see diskKey()
+    void submit(Lane lane, Resource resource, const QString &key, const TaskToken &token, std::function<void()> task);
+    void submit(Lane lane, Resource resource, const QString &key, std::function<void()> task);
+    // queued like a task, granted is called on the thread of context when a slot of the resource
+    // is free; the slot counts against the limit of the resource until the ResourceSlot is destroyed
+    void acquire(Lane lane, Resource resource, const QString &key, QObject *context, std::function<void(ResourceSlot)> granted);
+
+    // the tasks and slots of resource that run at once, for each key
+    static int limit(Resource resource);
+
+    // the device path is on
+    static QString diskKey(const QString &path);
+
+    // tasks of lane waiting for a thread or a resource
+    int queueDepth(Lane lane) const;
+
+private:
+    friend struct ResourceSlot::Holder;
+
+    TaskScheduler();
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler &) = delete;
+    TaskScheduler &operator=(const TaskScheduler &) = delete;
+    TaskScheduler(TaskScheduler &&) = delete;
+    TaskScheduler &operator=(TaskScheduler &&) = delete;
+
+    static constexpr int LaneCount = 4;
+
+    struct Task {
+        Lane lane;
+        Resource resource;
+        // see group()
+        QString resourceGroup;
+        TaskToken token;
+        quint64 generation;
+        std::function<void()> run;
+        QElapsedTimer queued;
+        // set for acquire(), instead of run
+        QPointer<QObject> context;
+        std::function<void(ResourceSlot)> granted;
+    };
+
+    struct Grant {
+        QPointer<QObject> context;
+        std::function<void(ResourceSlot)> granted;
+        ResourceSlot slot;
+    };
+
+    struct LaneStats {
+        std::atomic<qint64> submitted{0};
+        std::atomic<qint64> completed{0};
+        std::atomic<qint64> cancelled{0};
+        std::atomic<qint64> waitNsecs{0};
+        std::atomic<int> maxQueueDepth{0};
+    };
+
+    static bool isCancelled(const Task &task);
+    // tasks of the same resource group count against the same limit
+    static QString group(Resource resource, const QString &key);
+
+    // starts the queued tasks that can run, must be called with m_mutex locked;
+    // the slots it grants are collected in m_grants
+    void dispatch();
+    // calls granted of the slots dispatch() granted, must be called with m_mutex unlocked,
+    // a slot whose context is gone is given back
+    void deliver(std::vector<Grant> grants);
+    void release(const QString &resourceGroup);
+    void run(Task task);
+    void printStats();
+
+    mutable QMutex m_mutex;
+    std::array<std::deque<Task>, LaneCount> m_queues;
+    QHash<QString, int> m_runningPerGroup;
+    int m_running{0};
+    // acquire() requests in the queues
+    int m_queuedSlots{0};
+    std::vector<Grant> m_grants;
+    int m_maxThreads{1};
+    QThreadPool m_threadPool;
+
+    std::array<LaneStats, LaneCount> m_stats;
+};
+
+#endif // TASKSCHEDULER_H
@@ -6,9 +6,9 @@
 
 #include "worker.h"
 
-#include <QCryptographicHash>
 #include <QDir>
 #include <QDirIterator>
+#include <QFile>
 #include <QFileInfo>
 #include <QImage>
 #include <QProcess>
@@ -25,57 +25,64 @@
 #include "framedecoder.h"
 #include "pathutils.h"
 #include "subtitlessettings.h"
+#include "taskscheduler.h"
+#include "thumbnailcache.h"
 #include "youtube.h"
 
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#endif
+
 using namespace Qt::StringLiterals;
 
+namespace
+{
+// enough for the headers and the first seconds of a typical audio or video file
+constexpr qint64 PrefetchSize = 8 * 1024 * 1024;
+} // namespace
+
 Worker *Worker::instance()
 {
     static Worker w;
     return &w;
 }
 
-void Worker::makePlaylistThumbnail(const QString &path, int width)
+void Worker::makePlaylistThumbnail(const QString &path, int width, const TaskToken &token, ThumbnailCallback done)
 {
-    QImage image;
-
-    auto file = QUrl::fromUserInput(path);
-
-    // figure out absolute path of the thumbnail
-    auto md5Hash = QCryptographicHash::hash(file.toString().toUtf8(), QCryptographicHash::Md5);
-    QString cacheDir(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation));
-    QString appDir(QStringLiteral("haruna"));
-    QString fileDir(QString::fromUtf8(md5Hash.toHex()));
-    QString filename(QString::fromUtf8(md5Hash.toHex()).append(QStringLiteral(".png")));
-    QString cachedFilePath = QStringLiteral("%1/%2/%3/%4").arg(cacheDir, appDir, fileDir, filename);
+    // decoding the frame takes longer than reading it, so thumbnails are made on all the threads
+    const auto scheduler = TaskScheduler::instance();
+    scheduler->submit(TaskScheduler::Lane::Thumbnails, TaskScheduler::Resource::Cpu, QString(), token, [this, path, width, done = std::move(done)]() {
+        createPlaylistThumbnail(path, width, done);
+    });
+}
 
-    // load existing thumbnail if there is one
-    if (QFileInfo::exists(cachedFilePath) && image.load(cachedFilePath)) {
-        Q_EMIT thumbnailSuccess(path, image);
+void Worker::createPlaylistThumbnail(const QString &path, int width, const ThumbnailCallback &done)
+{
+    const auto cache = ThumbnailCache::instance();
+    const auto key = ThumbnailCache::key(path, width);
+    QImage image = cache->find(key);
+    if (!image.isNull()) {
+        done(image);
         return;
     }
 
-    image = frameToImage(path, width);
+    // made as wide as the bucket, so it's reused by the requests of other widths in the bucket
+    image = frameToImage(path, ThumbnailCache::bucketWidth(width));
 
     if (image.isNull()) {
         qDebug() << QStringLiteral("Failed to create thumbnail for file: %1").arg(path);
+        done(image);
         return;
     }
-    Q_EMIT thumbnailSuccess(path, image);
+    done(image);
 
-    QFileInfo fi(cachedFilePath);
-    // create folders where the file will be saved
-    if (QDir().mkpath(fi.absolutePath())) {
-        if (!image.save(cachedFilePath)) {
-            qDebug() << QStringLiteral("Failed to save thumbnail for file: %1").arg(path);
-        }
-    }
+    cache->insert(key, image);
 }
 
 QImage Worker::frameToImage(const QString &path, int width)
 {
     QImage image;
-    FrameDecoder frameDecoder(path, nullptr);
+    FrameDecoder frameDecoder(path, nullptr, FrameDecoder::Mode::Thumbnail, width);
     if (!frameDecoder.getInitialized()) {
         return image;
     }
@@ -84,9 +91,8 @@ QImage Worker::frameToImage(const QString &path, int width)
         return image;
     }
 
-    int secondToSeekTo = frameDecoder.getDuration() * 20 / 100;
-    frameDecoder.seek(secondToSeekTo);
-    frameDecoder.getScaledVideoFrame(width, true, image);
+    const qint64 timeMs = frameDecoder.getDuration() * 1000LL * 20 / 100;
+    image = frameDecoder.frameAt(timeMs, width);
 
     return image;
 }
@@ -94,7 +100,7 @@ QImage Worker::frameToImage(const QString &path, int width)
 void Worker::mprisThumbnail(const QString &path, int width)
 {
     QImage image;
-    FrameDecoder frameDecoder(path, nullptr);
+    FrameDecoder frameDecoder(path, nullptr, FrameDecoder::Mode::Thumbnail, width);
     if (!frameDecoder.getInitialized()) {
         return;
     }
@@ -103,14 +109,22 @@ void Worker::mprisThumbnail(const QString &path, int width)
         return;
     }
 
-    int secondToSeekTo = frameDecoder.getDuration() * 20 / 100;
-    frameDecoder.seek(secondToSeekTo);
-    frameDecoder.getScaledVideoFrame(width, true, image);
+    const qint64 timeMs = frameDecoder.getDuration() * 1000LL * 20 / 100;
+    image = frameDecoder.frameAt(timeMs, width);
 
     Q_EMIT mprisThumbnailSuccess(image);
 }
 
 void Worker::findRecursiveSubtitles(const QUrl &playingUrl)
+{
+    const auto path = playingUrl.toLocalFile();
+    const auto scheduler = TaskScheduler::instance();
+    scheduler->submit(TaskScheduler::Lane::Interactive, TaskScheduler::Resource::Disk, TaskScheduler::diskKey(path), [this, playingUrl]() {
+        searchRecursiveSubtitles(playingUrl);
+    });
+}
+
+void Worker::searchRecursiveSubtitles(const QUrl &playingUrl)
 {
     const auto playingFileInfo = QFileInfo(playingUrl.toLocalFile());
     const auto parentFolder = playingFileInfo.absolutePath();
@@ -165,6 +179,31 @@ void Worker::findRecursiveSubtitles(const QUrl &playingUrl)
     Q_EMIT subtitlesFound(foundSubs);
 }
 
+void Worker::prefetchFile(const QString &path)
+{
+    const auto scheduler = TaskScheduler::instance();
+    scheduler->submit(TaskScheduler::Lane::Interactive, TaskScheduler::Resource::Disk, TaskScheduler::diskKey(path), [path]() {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return;
+        }
+#if defined(Q_OS_LINUX)
+        // the kernel reads it in the background, nothing is copied here
+        ::posix_fadvise(file.handle(), 0, PrefetchSize, POSIX_FADV_WILLNEED);
+#else
+        QByteArray buffer(64 * 1024, Qt::Uninitialized);
+        qint64 total{0};
+        while (total < PrefetchSize) {
+            const auto read = file.read(buffer.data(), buffer.size());
+            if (read <= 0) {
+                break;
+            }
+            total += read;
+        }
+#endif
+    });
+}
+
 void Worker::savePositionToDB(const QString &md5Hash, const QString &path, double position)
 {
     Database::instance()->addPlaybackPosition(md5Hash, path, position, getDBConnection());
@@ -172,15 +211,18 @@ void Worker::savePositionToDB(const QString &md5Hash, const QString &path, doubl
 
 void Worker::getYtdlpVersion()
 {
-    QProcess ytdlpProcess;
-    YouTube yt;
-    ytdlpProcess.setProgram(yt.youtubeDlExecutable());
-    ytdlpProcess.setArguments({QStringLiteral("--version")});
-    ytdlpProcess.start();
-    ytdlpProcess.waitForFinished();
-    auto ytdlpVersion = ytdlpProcess.readAllStandardOutput().simplified();
-
-    Q_EMIT ytdlpVersionRetrived(ytdlpVersion);
+    const auto scheduler = TaskScheduler::instance();
+    scheduler->submit(TaskScheduler::Lane::Background, TaskScheduler::Resource::Process, QString(), [this]() {
+        QProcess ytdlpProcess;
+        YouTube yt;
+        ytdlpProcess.setProgram(yt.youtubeDlExecutable());
+        ytdlpProcess.setArguments({QStringLiteral("--version")});
+        ytdlpProcess.start();
+        ytdlpProcess.waitForFinished();
+        auto ytdlpVersion = ytdlpProcess.readAllStandardOutput().simplified();
+
+        Q_EMIT ytdlpVersionRetrived(ytdlpVersion);
+    });
 }
 
 QSqlDatabase Worker::getDBConnection()
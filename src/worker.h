@@ -12,8 +12,11 @@
 
 #include <KFileMetaData/KFileMetaData/Properties>
 
+#include <functional>
 #include <memory>
 
+#include "taskscheduler.h"
+
 class KConfig;
 class QImage;
 class QQuickWindow;
@@ -24,19 +27,24 @@ class Worker : public QObject
 public:
     static Worker *instance();
 
+    // called on the thread that made the thumbnail, with a null image when it failed
+    using ThumbnailCallback = std::function<void(const QImage &image)>;
+    // queues the thumbnail on the TaskScheduler, cancelling token drops it while it waits
+    void makePlaylistThumbnail(const QString &path, int width, const TaskToken &token, ThumbnailCallback done);
+
 Q_SIGNALS:
-    void thumbnailSuccess(const QString &path, const QImage &image);
-    void thumbnailFail();
     void mprisThumbnailSuccess(const QImage &image);
     void subtitlesFound(QStringList subs);
     void ytdlpVersionRetrived(const QByteArray &version);
 
 public Q_SLOTS:
-    void makePlaylistThumbnail(const QString &path, int width);
+    // the slots that read files or start processes only queue the work on the TaskScheduler
     QImage frameToImage(const QString &path, int width);
     void savePositionToDB(const QString &md5Hash, const QString &path, double position);
     void mprisThumbnail(const QString &path, int width);
     void findRecursiveSubtitles(const QUrl &playingUrl);
+    // gets the start of the file into the page cache, so opening and probing it doesn't wait for the disk
+    void prefetchFile(const QString &path);
     void getYtdlpVersion();
 
 private:
@@ -48,6 +56,8 @@ private:
     Worker(Worker &&) = delete;
     Worker &operator=(Worker &&) = delete;
 
+    void createPlaylistThumbnail(const QString &path, int width, const ThumbnailCallback &done);
+    void searchRecursiveSubtitles(const QUrl &playingUrl);
     QSqlDatabase getDBConnection();
 };
 
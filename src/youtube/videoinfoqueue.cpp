@@ -0,0 +1,240 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "videoinfoqueue.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QSet>
+
+#include <algorithm>
+#include <utility>
+
+#include "performancelog.h"
+#include "taskscheduler.h"
+#include "youtube.h"
+
+namespace
+{
+// urls given to one yt-dlp process
+constexpr int BatchSize = 25;
+// a url is sent to yt-dlp at most this many times
+constexpr int MaxAttempts = 2;
+// yt-dlp is killed when it prints nothing for this long
+constexpr int NoOutputTimeout = 60000;
+} // namespace
+
+VideoInfoQueue *VideoInfoQueue::instance()
+{
+    static VideoInfoQueue q;
+    return &q;
+}
+
+VideoInfoQueue::VideoInfoQueue()
+{
+    m_batchTimer.setInterval(0);
+    m_batchTimer.setSingleShot(true);
+    connect(&m_batchTimer, &QTimer::timeout, this, &VideoInfoQueue::schedule);
+
+    if (QCoreApplication::instance()) {
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &VideoInfoQueue::printStats);
+    }
+}
+
+void VideoInfoQueue::enqueue(const QUrl &url, const QUrl &requestUrl, YouTube *requester, const QVariantMap &data)
+{
+    ++m_requests;
+
+    const auto key = requestUrl.toString();
+    const bool queued = m_jobs.contains(key);
+    m_jobs[key].requests.push_back({url, requester, data});
+    if (!queued) {
+        m_waiting.push_back(key);
+    }
+    m_batchTimer.start();
+}
+
+void VideoInfoQueue::schedule()
+{
+    if (m_waiting.empty()) {
+        return;
+    }
+
+    YouTube youtube;
+    const auto executable = youtube.youtubeDlExecutable();
+    if (executable.isEmpty()) {
+        qDebug() << "VideoInfoQueue: yt-dlp not found, no info for" << m_waiting.size() << "urls";
+        for (const auto &key : std::exchange(m_waiting, {})) {
+            ++m_failures;
+            deliver(key, QString(), 0.0);
+        }
+        return;
+    }
+
+    // each slot asked for gets at least one url
+    const auto maxProcesses = TaskScheduler::limit(TaskScheduler::Resource::Process);
+    const auto waiting = static_cast<qsizetype>(m_waiting.size());
+    while (m_processes + m_slotRequests < maxProcesses && m_slotRequests < waiting) {
+        ++m_slotRequests;
+        TaskScheduler::instance()->acquire(TaskScheduler::Lane::VisibleMetadata,
+                                           TaskScheduler::Resource::Process,
+                                           QString(),
+                                           this,
+                                           [this, executable](const ResourceSlot &slot) {
+                                               onSlotGranted(executable, slot);
+                                           });
+    }
+}
+
+void VideoInfoQueue::onSlotGranted(const QString &executable, const ResourceSlot &slot)
+{
+    --m_slotRequests;
+
+    // a few urls are split between the slots asked for, instead of all going to the first one
+    const auto freeProcesses = static_cast<qsizetype>(m_slotRequests + 1);
+    const auto waiting = static_cast<qsizetype>(m_waiting.size());
+    const auto size = std::min<qsizetype>(BatchSize, (waiting + freeProcesses - 1) / freeProcesses);
+
+    QStringList urls;
+    while (!m_waiting.empty() && urls.size() < size) {
+        const auto key = m_waiting.front();
+        m_waiting.pop_front();
+        auto it = m_jobs.find(key);
+        if (it == m_jobs.end()) {
+            continue;
+        }
+        ++it->attempts;
+        urls.append(key);
+    }
+    // the slot isn't used, it's given back
+    if (urls.isEmpty()) {
+        return;
+    }
+
+    ++m_processes;
+    ++m_startedProcesses;
+    runBatch(executable, urls, slot);
+}
+
+void VideoInfoQueue::runBatch(const QString &executable, const QStringList &urls, const ResourceSlot &slot)
+{
+    auto process = new QProcess(this);
+    auto timeout = new QTimer(process);
+    timeout->setInterval(NoOutputTimeout);
+    timeout->setSingleShot(true);
+
+    const QSet<QString> batch(urls.cbegin(), urls.cend());
+    auto readLine = [this, urls, batch](const QByteArray &line) {
+        if (line.trimmed().isEmpty()) {
+            return;
+        }
+        const auto info = QJsonDocument::fromJson(line).object();
+        if (info.isEmpty()) {
+            return;
+        }
+        // original_url is the url as it was given, older versions only have webpage_url
+        auto url = info.value(QStringLiteral("original_url")).toString();
+        if (!batch.contains(url)) {
+            url = info.value(QStringLiteral("webpage_url")).toString();
+        }
+        if (!batch.contains(url)) {
+            if (urls.size() != 1) {
+                return;
+            }
+            url = urls.first();
+        }
+        const auto title = info.value(QStringLiteral("title")).toString();
+        const auto duration = info.value(QStringLiteral("duration")).toDouble();
+        deliver(url, title, duration);
+    };
+
+    connect(process, &QProcess::readyReadStandardOutput, this, [process, timeout, readLine]() {
+        timeout->start();
+        while (process->canReadLine()) {
+            readLine(process->readLine());
+        }
+    });
+    connect(timeout, &QTimer::timeout, this, [process]() {
+        qDebug() << "VideoInfoQueue: yt-dlp printed nothing for" << NoOutputTimeout << "ms, stopping it";
+        process->kill();
+    });
+    // the connections hold the slot, it's given back when the process is deleted
+    connect(process, &QProcess::finished, this, [this, process, timeout, readLine, urls, slot]() {
+        timeout->stop();
+        // the last line may not end with a line break
+        readLine(process->readAll());
+        process->deleteLater();
+        onBatchFinished(urls);
+    });
+    // finished is not emitted when it doesn't start
+    connect(process, &QProcess::errorOccurred, this, [this, process, executable, urls, slot](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart) {
+            return;
+        }
+        qDebug() << "VideoInfoQueue: could not start" << executable << process->errorString();
+        process->deleteLater();
+        onBatchFinished(urls);
+    });
+
+    process->setProgram(executable);
+    // one line of json per video, a failing url doesn't stop the others
+    QStringList arguments{QStringLiteral("-j"), QStringLiteral("--no-playlist"), QStringLiteral("--ignore-errors"), QStringLiteral("--no-warnings")};
+    arguments.append(QStringLiteral("--"));
+    arguments.append(urls);
+    process->setArguments(arguments);
+    process->setStandardErrorFile(QProcess::nullDevice());
+    process->start();
+    timeout->start();
+}
+
+void VideoInfoQueue::onBatchFinished(const QStringList &urls)
+{
+    --m_processes;
+
+    for (const auto &key : urls) {
+        const auto it = m_jobs.constFind(key);
+        if (it == m_jobs.cend()) {
+            continue;
+        }
+        if (it->attempts < MaxAttempts) {
+            ++m_retries;
+            m_waiting.push_back(key);
+        } else {
+            ++m_failures;
+            qDebug() << "VideoInfoQueue: no info for" << key;
+            deliver(key, QString(), 0.0);
+        }
+    }
+
+    schedule();
+}
+
+void VideoInfoQueue::deliver(const QString &requestUrl, const QString &title, double duration)
+{
+    const auto job = m_jobs.take(requestUrl);
+    for (const auto &request : job.requests) {
+        if (!request.requester) {
+            continue;
+        }
+        YTVideoInfo info;
+        info.url = request.url;
+        info.mediaTitle = title;
+        info.duration = duration;
+        Q_EMIT request.requester->videoInfoRetrieved(info, request.data);
+    }
+}
+
+void VideoInfoQueue::printStats()
+{
+    if (m_requests == 0) {
+        return;
+    }
+    qCDebug(HARUNA_PERFORMANCE) << "VideoInfoQueue:" << m_requests << "requests," << m_startedProcesses << "yt-dlp processes," << m_retries
+                                << "retries," << m_failures << "failed";
+}
+
+#include "moc_videoinfoqueue.cpp"
@@ -0,0 +1,94 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef VIDEOINFOQUEUE_H
+#define VIDEOINFOQUEUE_H
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+#include <QUrl>
+#include <QVariantMap>
+
+#include <deque>
+#include <vector>
+
+class ResourceSlot;
+class YouTube;
+
+/**
+ * Gets the title and duration of urls from yt-dlp, for YouTube::getVideoInfo.
+ *
+ * Urls requested together (the http items of a playlist) are sent to one yt-dlp
+ * process in batches, its output is read line by line, so an item gets its info
+ * as soon as yt-dlp prints it. Each process takes a Process slot of the
+ * TaskScheduler, so it shares that limit with the other subprocesses, and its
+ * output is read as it comes, without blocking a thread. Urls a process gave no
+ * info for are sent again, in a later batch; when that fails too the requester
+ * gets an empty title.
+ *
+ * Lives on the gui thread.
+ */
+class VideoInfoQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    static VideoInfoQueue *instance();
+
+    // url is what the requester gets back, requestUrl is given to yt-dlp
+    void enqueue(const QUrl &url, const QUrl &requestUrl, YouTube *requester, const QVariantMap &data);
+
+private:
+    VideoInfoQueue();
+    ~VideoInfoQueue() = default;
+
+    VideoInfoQueue(const VideoInfoQueue &) = delete;
+    VideoInfoQueue &operator=(const VideoInfoQueue &) = delete;
+    VideoInfoQueue(VideoInfoQueue &&) = delete;
+    VideoInfoQueue &operator=(VideoInfoQueue &&) = delete;
+
+    struct Request {
+        QUrl url;
+        QPointer<YouTube> requester;
+        QVariantMap data;
+    };
+
+    // the requests for the same url are merged
+    struct Job {
+        std::vector<Request> requests;
+        // processes the url was sent to
+        int attempts{0};
+    };
+
+    // asks the scheduler for process slots while there are urls waiting and its limit isn't reached
+    void schedule();
+    // takes the next batch of the waiting urls when a slot was granted
+    void onSlotGranted(const QString &executable, const ResourceSlot &slot);
+    // starts yt-dlp for urls, the info of each url is delivered as soon as yt-dlp prints it;
+    // the process holds slot until it's deleted
+    void runBatch(const QString &executable, const QStringList &urls, const ResourceSlot &slot);
+    // urls is the whole batch, the ones still in m_jobs got no info
+    void onBatchFinished(const QStringList &urls);
+    // emits YouTube::videoInfoRetrieved for the requests of requestUrl, an empty title when there's no info
+    void deliver(const QString &requestUrl, const QString &title, double duration);
+    void printStats();
+
+    // keyed by the url given to yt-dlp
+    QHash<QString, Job> m_jobs;
+    std::deque<QString> m_waiting;
+    int m_processes{0};
+    // slots asked for and not granted yet
+    int m_slotRequests{0};
+    // requests come one at a time, the batch is made when the event loop is back
+    QTimer m_batchTimer;
+
+    qint64 m_requests{0};
+    qint64 m_startedProcesses{0};
+    qint64 m_retries{0};
+    qint64 m_failures{0};
+};
+
+#endif // VIDEOINFOQUEUE_H
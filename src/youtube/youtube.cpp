@@ -15,6 +15,8 @@
 
 #include <KLocalizedString>
 
+#include "videoinfoqueue.h"
+
 using namespace Qt::StringLiterals;
 
 YouTube::YouTube()
@@ -131,19 +133,5 @@ void YouTube::getVideoInfo(const QUrl &url, QVariantMap data)
         urlWithoutPlaylist = QUrl{QStringLiteral("https://www.youtube.com/watch?v=%1").arg(videoId)};
     }
 
-    auto ytdlProcess = std::make_shared<QProcess>();
-    ytdlProcess->setProgram(youtubeDlExecutable());
-    ytdlProcess->setArguments(QStringList() << QStringLiteral("-j") << urlWithoutPlaylist.toString());
-    ytdlProcess->start();
-
-    connect(ytdlProcess.get(), QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [=](int, QProcess::ExitStatus) {
-        QString json = QString::fromUtf8(ytdlProcess->readAllStandardOutput());
-        QString title = QJsonDocument::fromJson(json.toUtf8())[QStringLiteral("title")].toString();
-        auto duration = QJsonDocument::fromJson(json.toUtf8())[QStringLiteral("duration")].toDouble();
-        YTVideoInfo info;
-        info.url = url;
-        info.mediaTitle = title;
-        info.duration = duration;
-        Q_EMIT videoInfoRetrieved(info, data);
-    });
+    VideoInfoQueue::instance()->enqueue(url, urlWithoutPlaylist, this, data);
 }
@@ -34,6 +34,7 @@ public:
     Q_INVOKABLE void getPlaylist(const QUrl &url);
     Q_INVOKABLE QUrl normalizeUrl(const QUrl &url);
     Q_INVOKABLE bool isYoutubeUrl(const QUrl &url);
+    // the info comes with videoInfoRetrieved, batched with the other requests, see VideoInfoQueue
     Q_INVOKABLE void getVideoInfo(const QUrl &url, QVariantMap data);
 
 Q_SIGNALS: